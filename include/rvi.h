@@ -110,6 +110,10 @@ typedef enum {
  * Notably, the device ID should be a unique ID generated from an external
  * source, e.g., util-linux's uuidgen or Microsoft's guidgen.exe.
  *
+ * An optional "credbundle" entry names a bundle of verified credentials made
+ * by rvi_create_credential.py. If it is valid, it is used instead of reading
+ * the credentials in "creddir".
+ *
  * The ID format is "domain/device-type/uuid".
  *
  * @param configFilename - Path to the file containing RVI config options.
@@ -134,6 +138,20 @@ extern TRviHandle rviInit(char *configFilename);
 
 extern int rviCleanup(TRviHandle handle);
 
+/** @brief Reload the public key of the certificate authority.
+ *
+ * The CA certificate named in the configuration file is read once by
+ * rviInit(), and its public key is kept for verifying every credential. Call
+ * this after replacing the certificate file to start verifying with the new
+ * key. If the file cannot be read, the old key is kept.
+ *
+ * @param handle - The handle to the RVI context.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviRefreshCaKey(TRviHandle handle);
+
 // *************************
 // RVI CONNECTION MANAGEMENT
 // *************************
@@ -263,6 +281,32 @@ extern int rviUnregisterService( TRviHandle handle,
  */
 extern int rviGetServices( TRviHandle handle, char **result, int* len );
 
+/** @brief Get list of services matching a pattern
+ *
+ * This function works like rviGetServices(), but only returns the services
+ * whose fully-qualified names match the pattern. Patterns are written like
+ * the ones in credentials: a '+' segment matches any one segment of the name,
+ * and a pattern matches every name it is a prefix of, e.g.
+ * "genivi.org/vehicle/+/control/" matches the control services of every
+ * vehicle.
+ *
+ * When librvi is configured with --enable-service-trie, the services are kept
+ * in a trie of name segments and only the parts of it that can match are
+ * searched. Otherwise every service is compared to the pattern.
+ *
+ * This operation is entirely local.
+ * 
+ * @param handle - The handle to the RVI context.
+ * @param pattern - The pattern the service names must match
+ * @param result - A pointer to a block of pointers for storing strings
+ * @param len - The maximum number of pointers allocated in result
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviFindServices( TRviHandle handle, const char *pattern, 
+                            char **result, int *len );
+
 /** @brief Invoke a remote service
  *
  * The service name must be the fully-qualified service name (as returned by,
@@ -316,6 +360,56 @@ extern int rviInvokeService( TRviHandle handle,
  */
 extern int rviProcessInput(TRviHandle handle, int* fdArr, int fdLen);
 
+/** @brief Get the time at which the next credential expires.
+ *
+ * This covers the credentials of this node as well as those received from
+ * every remote node. The calling application can use it to bound the time it
+ * waits in (e)poll() or select(), and call rviProcessExpirations() once it
+ * has passed.
+ *
+ * @param handle - The handle to the RVI context.
+ *
+ * @return The unix epoch time of the next expiration,
+ *         0 if no credentials are held.
+ */
+extern long rviGetNextExpiration(TRviHandle handle);
+
+/** @brief Withdraw the rights granted by expired credentials.
+ *
+ * The rights of each expired credential are removed. Local services that
+ * this node may no longer receive are announced as unavailable, and remote
+ * nodes that may no longer invoke a local service are told that it is
+ * unavailable. Services registered by remote nodes that may no longer be used
+ * are forgotten.
+ *
+ * This is also done at the start of rviProcessInput() and
+ * rviRegisterService(), so rights are never checked after they expire.
+ *
+ * @param handle - The handle to the RVI context.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviProcessExpirations(TRviHandle handle);
+
+/** @brief Get the hit and miss counts of the rights decision caches.
+ *
+ * Each rights check on a service name is first looked up in a small cache of
+ * recent decisions. The counts cover the caches of this node and of every
+ * remote node, including those since disconnected, and only ever grow. An
+ * application can sample them to judge how well the caches serve its mix of
+ * services.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param hits   - Set to the number of checks answered from a cache.
+ * @param misses - Set to the number of checks that had to match the rights.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviGetRightsCacheStats(TRviHandle handle, unsigned long *hits,
+                                  unsigned long *misses);
+
 #ifdef __cplusplus
 }
 #endif
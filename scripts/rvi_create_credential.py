@@ -24,6 +24,7 @@ import time
 import json
 import base64
 import struct
+import hashlib
 
 def long2intarr(long_int):
     _bytes = []
@@ -75,6 +76,50 @@ def read_x509_cert_pem_file(file_name):
     # Return string between tags, stripped of \r and \n
     return dev_pem[pem_start: pem_end].replace("\n", "").replace("\r", "")
 
+
+def bundle_string(s):
+    if isinstance(s, unicode):
+        s = s.encode('utf-8')
+    return s + '\0'
+
+def bundle_entry(token, public_key, device_cert):
+    try:
+        claims = jwt.decode(token, public_key)
+    except:
+        print "FAILED: Could not verify credential for bundle: {}".format(token[:32])
+        sys.exit(255)
+
+    if claims.get('device_cert') != device_cert:
+        print "FAILED: Credential for bundle was not issued for --device_cert"
+        sys.exit(255)
+
+    receive = [ r for r in claims.get('right_to_receive') or [] if isinstance(r, basestring) ]
+    invoke = [ i for i in claims.get('right_to_invoke') or [] if isinstance(i, basestring) ]
+    validity = claims.get('validity', {})
+
+    entry = struct.pack('<qqIII', validity.get('start', 0), validity.get('stop', 0),
+                        len(token), len(receive), len(invoke))
+    entry += bundle_string(token)
+    for pattern in receive + invoke:
+        entry += bundle_string(pattern)
+    return entry
+
+# Write a credential bundle that rvi_lib can load at startup in place of
+# reading and verifying every JWT in its credential directory. The format
+# is described next to RVI_BUNDLE_MAGIC in src/rvi.c.
+def write_bundle(bundle_file, tokens, root_key, device_cert):
+    public_key = root_key.publickey()
+    entries = [ bundle_entry(t, public_key.exportKey("PEM"), device_cert) for t in tokens ]
+
+    data = 'RVIB' + struct.pack('<III', 1, len(entries), 0)
+    data += hashlib.sha256(public_key.exportKey("DER")).digest()
+    data += hashlib.sha256(base64.b64decode(device_cert)).digest()
+    data += ''.join(entries)
+    data += hashlib.sha256(data).digest()
+
+    bundle_file.write(data)
+    bundle_file.close()
+
         
 def usage():
     print "Usage:", sys.argv[0], "--id=<id> --invoke='<services>' -receive='<services>' \\"
@@ -109,6 +154,13 @@ def usage():
     print "  --issuer=issuer                 Name of the issuer."
     print "                                  Mandatory"
     print
+    print "  --bundle_out=<file>             File name to store a credential bundle in, holding the new"
+    print "                                  credential and those given by --bundle_jwt."
+    print "                                  Default: Do not create a bundle"
+    print
+    print "  --bundle_jwt='<files>'          JWT files of other credentials for the same device to add"
+    print "                                  to the bundle. Space separate multiple files."
+    print
     print "Root key file is generated by steps described in doc/rvi_protocol.md"
     print
     print "Device X.509 certificate is generated by steps described in doc/rvi_protocol.md"
@@ -133,7 +185,8 @@ try:
     opts, args = getopt.getopt(sys.argv[1:], "", [ 'issuer=', 'invoke=', 'receive=', 
                                                    'root_key=', 'start=', 
                                                    'stop=', 'cred_out=', 'id=',
-                                                   'jwt_out=', 'device_cert='])
+                                                   'jwt_out=', 'device_cert=',
+                                                   'bundle_out=', 'bundle_jwt='])
 except getopt.GetoptError as e:
     print
     print e
@@ -150,6 +203,8 @@ root_key=None
 device_cert=None
 jwt_out_file=None
 cred_out_file=None
+bundle_out_file=None
+bundle_jwt=[]
 id_string=None
 for o, a in opts:
     if o == "--start":
@@ -202,6 +257,23 @@ for o, a in opts:
             print "Could not write to JWT file {0}: {1}".format(a, e.strerror)
             sys.exit(255)
 
+    elif o == '--bundle_out':
+        try:
+            bundle_out_file = open(a, "wb")
+        except IOError as e:
+            print "Could not write to bundle file {0}: {1}".format(a, e.strerror)
+            sys.exit(255)
+
+    elif o == '--bundle_jwt':
+        for f in a.split(' '):
+            try:
+                fp = open(f, "r")
+                bundle_jwt.append(fp.read().strip())
+                fp.close()
+            except IOError as e:
+                print "Could not read JWT file {0}: {1}".format(f, e.strerror)
+                sys.exit(255)
+
     elif o == '--cred_out':
         try:
             cred_out_file = open(a, "w")
@@ -283,3 +355,5 @@ if cred_out_file:
     cred_out_file.write(json.dumps(cred, sort_keys=True, indent=4, separators=(',', ': ')) + '\n')
     cred_out_file.close()
 
+if bundle_out_file:
+    write_bundle(bundle_out_file, [ encoded ] + bundle_jwt, root_key, device_cert)
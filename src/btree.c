@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "btree.h"
 
@@ -39,13 +40,31 @@ static void print_single_node ( btree_t* btree, bt_node_t* node,
 
 static bt_node_t* allocate_btree_node ( btree_t* btree );
 
+static void free_btree_slabs ( btree_t* btree );
+
+static void carve_btree_slab ( btree_t* btree, char* slab );
+
 static void btree_insert_nonfull ( btree_t* btree, bt_node_t* parent_node,
                                    void* data );
 
-static int free_btree_node ( bt_node_t* node );
+static int free_btree_node ( btree_t* btree, bt_node_t* node );
+
+static void free_btree_subtree ( btree_t* btree, bt_node_t* node );
+
+static void visit_btree_subtree ( bt_node_t* node, visitFunc visitor,
+                                  void* context );
 
 static nodePosition get_btree_node ( btree_t* btree, void* key );
 
+static int bplus_delete ( btree_t* btree, void* data );
+
+static unsigned int node_lower_bound ( btree_t* btree, bt_node_t* node,
+                                       void* key, uint64_t fingerprint,
+                                       int* diff );
+
+static unsigned int node_upper_bound ( btree_t* btree, bt_node_t* node,
+                                       void* key, uint64_t fingerprint );
+
 static int delete_key_from_node ( btree_t* btree, nodePosition* nodePosition );
 
 static void move_key ( btree_t* btree, bt_node_t* node, unsigned int index,
@@ -61,6 +80,82 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
 static void btree_traverse_node ( bt_node_t* subtree,
                                   traverseFunc traverseFunction );
 
+/**
+*   The default allocator callbacks used when the caller does not supply an
+*   allocator to btree_create.
+*/
+static void* default_alloc ( void* context, size_t size )
+{
+    return MEM_ALLOC ( size );
+}
+
+static void default_free ( void* context, void* block )
+{
+    MEM_FREE ( block );
+}
+
+/**
+*   Round the given size up to the next multiple of BTREE_NODE_ALIGN.
+*/
+static size_t node_align ( size_t size )
+{
+    return ( size + BTREE_NODE_ALIGN - 1 ) & ~( (size_t)BTREE_NODE_ALIGN - 1 );
+}
+
+//
+//  The header at the start of each slab.  It chains all of the slabs of the
+//  btree together so that they can be released when the btree is destroyed,
+//  and records the size of the slab so that its memory can be carved up
+//  again when the layout of the nodes changes.
+//
+typedef struct bt_slab_t
+{
+    void*  next;                    // The next slab of the btree or NULL
+    size_t size;                    // The size of the slab in bytes
+
+}   bt_slab_t;
+
+#define SLAB_HEADER_SIZE ( node_align ( sizeof(bt_slab_t) ) )
+
+/**
+*   Set the order of the btree and compute the sizes of the nodes and slabs
+*   that follow from it.  The fingerprint array (if any), the record array
+*   and the child pointer array are stored inline after the node header so
+*   that each node is one contiguous block of memory.
+*
+*   @param btree The btree
+*   @param order The order of the B-tree
+*/
+static void set_node_layout ( btree_t* btree, unsigned int order )
+{
+    btree->order              = order;
+    btree->nodeFullSize       = 2 * order - 1;
+    btree->sizeofKeys         = ( 2 * order - 1 ) * sizeof(void*);
+    btree->sizeofPointers     = 2 * order * sizeof(void*);
+    btree->sizeofFingerprints = 0;
+
+    if ( btree->fingerprintCB != NULL )
+    {
+        btree->sizeofFingerprints = ( 2 * order - 1 ) * sizeof(uint64_t);
+    }
+    //
+    //  Compute the size of a single node.
+    //
+    btree->nodeSize = node_align ( node_align ( sizeof(struct bt_node_t) ) +
+                                   btree->sizeofFingerprints +
+                                   btree->sizeofKeys + btree->sizeofPointers );
+
+    //
+    //  Figure out how many nodes will fit into each slab that we allocate.
+    //
+    btree->nodesPerSlab = ( BTREE_SLAB_SIZE - SLAB_HEADER_SIZE ) /
+                          btree->nodeSize;
+    if ( btree->nodesPerSlab < BTREE_SLAB_MIN )
+    {
+        btree->nodesPerSlab = BTREE_SLAB_MIN;
+    }
+}
+
 /**
 *   Used to create a btree with just an empty root node.  Note that the
 *   "order" parameter below is the minumum number of keys that exist in each
@@ -70,35 +165,59 @@ static void btree_traverse_node ( bt_node_t* subtree,
 *   share a pointer (the right pointer of one is the left pointer of the
 *   other).
 *
+*   All of the nodes of the btree (and the btree structure itself) are
+*   obtained from the supplied allocator.  If the allocator is NULL, the
+*   system MEM_ALLOC and MEM_FREE functions are used.
+*
 *   @param order The order of the B-tree
+*   @param compareFunction The function used to compare two records
+*   @param allocator The allocator for the btree memory or NULL
 *   @return The pointer to an empty B-tree
 */
-btree_t* btree_create ( unsigned int order, compareFunc compareFunction )
+btree_t* btree_create ( unsigned int order, compareFunc compareFunction,
+                        btree_allocator_t* allocator )
 {
-    btree_t* btree;
+    btree_t*          btree;
+    btree_allocator_t defaultAllocator = { default_alloc, default_free, NULL };
 
     TRACE ( "In btree_create\n" );
 
+    if ( allocator == NULL )
+    {
+        allocator = &defaultAllocator;
+    }
     //
     //  Go allocate a memory block for a new btree data structure.
     //
-    btree = MEM_ALLOC ( sizeof(struct btree_t) );
-
+    btree = allocator->alloc ( allocator->context, sizeof(struct btree_t) );
+    if ( btree == NULL )
+    {
+        return NULL;
+    }
     //
     //  Initialize all the fields in the new btree structure.
     //
-    btree->order           = order;
-    btree->nodeFullSize    = 2 * order - 1;
-    btree->sizeofKeys      = ( 2 * order - 1 ) * sizeof(void*);
-    btree->sizeofPointers  = 2 * order * sizeof(void*);
     btree->count           = 0;
+    btree->generation      = 0;
     btree->compareCB       = compareFunction;
+    btree->fingerprintCB   = NULL;
+    btree->nodeMode        = BTREE_NODE_FIXED;
+    btree->bplus           = false;
+    btree->allocator       = *allocator;
+    btree->freeList        = NULL;
+    btree->slabs           = NULL;
+
+    set_node_layout ( btree, order );
 
     //
     //  Go allocate the root node of the tree.
     //
     btree->root = allocate_btree_node ( btree );
-
+    if ( btree->root == NULL )
+    {
+        btree_destroy ( btree );
+        return NULL;
+    }
     //
     //  Return the pointer to the btree to the caller.
     //
@@ -106,191 +225,642 @@ btree_t* btree_create ( unsigned int order, compareFunc compareFunction )
 }
 
 /**
-*       Function used to allocate memory for the btree node
-*       @param order Order of the B-Tree
-*   @param leaf boolean set true for a leaf node
-*       @return The allocated B-tree node
+*   Compute the number of bytes that a node should occupy in the given node
+*   sizing mode.  The values are obtained from the system so that the nodes
+*   match the cache and page geometry of the machine we are running on.
+*
+*   @param mode The node sizing mode
+*   @return The target size of a node in bytes
 */
-static bt_node_t* allocate_btree_node ( btree_t* btree )
+static size_t node_bytes_for_mode ( btree_node_mode_t mode )
 {
-    bt_node_t* node;
+    long size = -1;
 
-    //
-    //  Go create a new node data structure.
-    //
-    node = (bt_node_t*)MEM_ALLOC ( sizeof(struct bt_node_t) );
+    if ( mode == BTREE_NODE_PAGE )
+    {
+        size = sysconf ( _SC_PAGE_SIZE );
+        if ( size <= 0 )
+        {
+            size = 4096;
+        }
+    }
+    else
+    {
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+        size = sysconf ( _SC_LEVEL1_DCACHE_LINESIZE );
+#endif
+        if ( size <= 0 )
+        {
+            size = 64;
+        }
+        size *= BTREE_CACHE_LINES_PER_NODE;
+    }
+    return (size_t)size;
+}
 
-    TRACE ( "In allocate_btree_node - Allocated %p\n", node );
+/**
+*   Compute the largest btree order for which a node fits into the given
+*   number of bytes.  A node of order "t" holds ( 2t - 1 ) record pointers
+*   (each with a fingerprint if those are in use) and 2t child pointers after
+*   the node header, so the formula is:
+*
+*       nodeBytes >= header + ( 2t - 1 ) * keySize + 2t * childSize
+*
+*   Solving this for t gives:
+*
+*       t = ( nodeBytes - header + keySize ) / ( 2 * ( keySize + childSize ) )
+*
+*   The order is never allowed to drop below 2.
+*
+*   @param nodeBytes The target size of a node
+*   @param fingerprints True if each record also carries a fingerprint
+*   @return The order of the btree
+*/
+static unsigned int node_order_for_size ( size_t nodeBytes, bool fingerprints )
+{
+    size_t header    = node_align ( sizeof(struct bt_node_t) );
+    size_t keySize   = sizeof(void*);
+    size_t childSize = sizeof(void*);
+    size_t order     = 0;
 
-    //
-    //  Set the number of records in this node to zero.
-    //
-    node->keysInUse = 0;
+    if ( fingerprints )
+    {
+        keySize += sizeof(uint64_t);
+    }
+    if ( nodeBytes > header )
+    {
+        order = ( nodeBytes - header + keySize ) /
+                ( 2 * ( keySize + childSize ) );
+    }
+    return order < 2 ? 2 : (unsigned int)order;
+}
 
-    //
-    //  Allocate the memory for the array of record pointers and put the
-    //  address of that array into the node.
-    //
-    node->dataRecords = MEM_ALLOC ( btree->sizeofKeys );
+/**
+*   Used to create a btree whose order is derived from the system cache line
+*   size or memory page size rather than specified by the caller.  See the
+*   description of btree_node_mode_t in btree.h for the available modes.
+*
+*   @param mode The node sizing mode
+*   @param compareFunction The function used to compare two records
+*   @param allocator The allocator for the btree memory or NULL
+*   @return The pointer to an empty B-tree
+*/
+btree_t* btree_create_sized ( btree_node_mode_t mode,
+                              compareFunc compareFunction,
+                              btree_allocator_t* allocator )
+{
+    btree_t*     btree;
+    unsigned int order = 2;
 
-    //
-    //  Allocate the memory for the array of child node pointers and put the
-    //  address of that array into the node.
-    //
-    node->children = MEM_ALLOC ( btree->sizeofPointers );
+    TRACE ( "In btree_create_sized\n" );
 
-    //
-    //  Mark this new node as a leaf node.
-    //
-    node->leaf = true;
+    if ( mode != BTREE_NODE_FIXED )
+    {
+        order = node_order_for_size ( node_bytes_for_mode ( mode ), false );
+    }
+    btree = btree_create ( order, compareFunction, allocator );
+    if ( btree != NULL )
+    {
+        btree->nodeMode = mode;
+    }
+    return btree;
+}
 
-    //
-    //  Set the tree level to zero.
-    //
-    node->level = 0;
+/**
+*   Used to set the function that computes the fingerprint of a record.  See
+*   the description of btree_set_fingerprint in btree.h for the requirements
+*   on the fingerprint function.
+*
+*   Since the fingerprints are stored inline in the nodes, this changes the
+*   layout of the nodes so it is only allowed while the btree is empty.  The
+*   slabs already owned by the btree are carved up again with the new layout
+*   rather than released, since an allocator such as an arena may not take
+*   memory back before it is destroyed, and a new root node is taken from
+*   them.  If the btree was created with btree_create_sized, the order is
+*   recomputed so that the nodes still fit into the same amount of memory.
+*
+*   @param btree The btree
+*   @param fingerprintFunction The fingerprint function or NULL
+*   @return 0 on success, -EBUSY if the btree is not empty, -ENOMEM if the new
+*           root node could not be allocated
+*/
+int btree_set_fingerprint ( btree_t* btree,
+                            fingerprintFunc fingerprintFunction )
+{
+    unsigned int order = btree->order;
+    char*        slab;
 
-    //
-    //  Set the linked list pointer to NULL.
-    //
-    node->next = NULL;
+    TRACE ( "In btree_set_fingerprint\n" );
 
+    if ( btree->count != 0 )
+    {
+        return -EBUSY;
+    }
     //
-    //  Set the parent node link to NULL.
+    //  Every node allocated with the old layout is invalid from here on.
     //
-    node->parent = NULL;
+    btree->freeList = NULL;
+    btree->root     = NULL;
+
+    btree->fingerprintCB = fingerprintFunction;
+    btree->generation++;
+
+    if ( btree->nodeMode != BTREE_NODE_FIXED )
+    {
+        order = node_order_for_size ( node_bytes_for_mode ( btree->nodeMode ),
+                                      fingerprintFunction != NULL );
+    }
+    set_node_layout ( btree, order );
 
     //
-    //  Return the address of the new node to the caller.
+    //  Put the memory of the existing slabs back onto the free list as nodes
+    //  with the new layout, then go allocate a new root node from it.
     //
-    return node;
+    for ( slab = btree->slabs; slab != NULL;
+          slab = ( (bt_slab_t*)slab )->next )
+    {
+        carve_btree_slab ( btree, slab );
+    }
+    btree->root = allocate_btree_node ( btree );
+    if ( btree->root == NULL )
+    {
+        return -ENOMEM;
+    }
+    return 0;
 }
 
 /**
-*       Function used to free the memory allocated to the b-tree
-*       @param node The node to be freed
-*       @param order Order of the B-Tree
-*       @return The allocated B-tree node
+*   Used to switch a btree into or out of B+ mode.  See the description of
+*   btree_set_bplus in btree.h.  An empty btree is just an empty leaf in
+*   either mode so nothing but the flag has to change.
+*
+*   @param btree The btree
+*   @param bplus True to keep all of the records in linked leaves
+*   @return 0 on success, -EBUSY if the btree is not empty
 */
-static int free_btree_node ( bt_node_t* node )
+int btree_set_bplus ( btree_t* btree, bool bplus )
 {
-    TRACE ( "In free_btree_node - Freeing %p\n", node );
+    TRACE ( "In btree_set_bplus\n" );
 
-    MEM_FREE ( node->children );
-    MEM_FREE ( node->dataRecords );
-    MEM_FREE ( node );
+    if ( btree->count != 0 )
+    {
+        return -EBUSY;
+    }
+    btree->bplus = bplus;
+    btree->generation++;
 
     return 0;
 }
 
 /**
-*   Used to split the child node and adjust the parent so that
-*   it has two children
-*   @param parent Parent Node
-*   @param index Index of the parent node where the new record will be put
-*   @param child  Full child node
+*   Release all of the slabs owned by the btree back to the allocator.  Every
+*   node of the btree is invalid once this has been done.
 *
+*   @param btree The btree
 */
-static void btree_split_child ( btree_t*     btree,
-                                bt_node_t*   parent,
-                                unsigned int index,
-                                bt_node_t*   child )
+static void free_btree_slabs ( btree_t* btree )
 {
-    int          i = 0;
-    unsigned int order = btree->order;
+    void* slab;
+    void* next;
 
-    TRACE ( "In btree_split_child\n" );
+    slab = btree->slabs;
+    while ( slab != NULL )
+    {
+        next = ( (bt_slab_t*)slab )->next;
+        btree->allocator.free ( btree->allocator.context, slab );
+        slab = next;
+    }
+    btree->slabs    = NULL;
+    btree->freeList = NULL;
+    btree->root     = NULL;
+}
 
-    //
-    //  Go create a new tree node as our "new child".  The new node will be
-    //  created at the same level as the old node (at least initially - It may
-    //  get moved when we balance the tree later) and to the right of the node
-    //  that is being split.
-    //
-    bt_node_t* newChild = allocate_btree_node ( btree );
+/**
+*   Carve a slab up into nodes with the current layout of the btree and put
+*   all of those nodes onto the free list of the btree.  As many nodes as fit
+*   into the slab are made, which is nodesPerSlab for a slab allocated with
+*   the current layout.
+*
+*   @param btree The btree
+*   @param slab The slab
+*/
+static void carve_btree_slab ( btree_t* btree, char* slab )
+{
+    char*        block;
+    bt_node_t*   node;
+    unsigned int i;
 
-    //
-    //  Initialize the fields of the new node appropriately.
-    //
-    newChild->leaf = child->leaf;
-    newChild->level = child->level;
-    newChild->keysInUse = btree->order - 1;
-    newChild->parent = parent;
+    i = ( ( (bt_slab_t*)slab )->size - SLAB_HEADER_SIZE ) / btree->nodeSize;
 
     //
-    //  Move the keys from beyond the split point from the old child to the
-    //  beginning of the new child.
+    //  Chain all of the nodes in this slab onto the free list.  We do this
+    //  backwards so that the nodes are handed out in address order.
     //
-    for ( i = 0; i < order - 1; i++ )
+    for ( ; i > 0; i-- )
     {
-        newChild->dataRecords[i] = child->dataRecords[i + order];
+        block = slab + SLAB_HEADER_SIZE + ( i - 1 ) * btree->nodeSize;
+        node  = (bt_node_t*)block;
 
-        //
-        //  If this is not a leaf node, also copy the "children" pointers from
-        //  the old child to the new one.
-        //
-        if ( ! child->leaf )
+        node->fingerprints = NULL;
+        if ( btree->sizeofFingerprints != 0 )
         {
-            newChild->children[i] = child->children[i + order];
-
-            //
-            //  Make the parent pointer in the child that we just moved now
-            //  point to the new child rather than the old child from which it
-            //  was moved.
-            //
-            newChild->children[i]->parent = newChild;
+            node->fingerprints = (uint64_t*)( block +
+                                   node_align ( sizeof(struct bt_node_t) ) );
         }
+        node->dataRecords = (void**)( block +
+                                      node_align ( sizeof(struct bt_node_t) ) +
+                                      btree->sizeofFingerprints );
+        node->children    = (bt_node_t**)( (char*)node->dataRecords +
+                                           btree->sizeofKeys );
+        node->next        = btree->freeList;
+        btree->freeList   = node;
     }
-    //
-    //  If this is not a leaf node, copy the last node pointer (remember that
-    //  there is one extra node pointer for a given number of keys).
-    //
-    if ( ! child->leaf )
-    {
-        newChild->children[i] = child->children[i + order];
+}
 
-        //
-        //  Make the parent pointer in the child that we just moved now point
-        //  to the new child rather than the old child from which it was
-        //  moved.
-        //
-        newChild->children[i]->parent = newChild;
+/**
+*   Allocate a new slab of memory from the btree allocator, carve it up into
+*   nodes, and put all of those nodes onto the free list of the btree.
+*
+*   The header at the start of each slab chains all of the slabs of the
+*   btree together so that they can be released when the btree is destroyed.
+*
+*   @param btree The btree
+*   @return 0 on success, -ENOMEM if the allocation failed
+*/
+static int allocate_btree_slab ( btree_t* btree )
+{
+    char*  slab;
+    size_t size = SLAB_HEADER_SIZE + btree->nodesPerSlab * btree->nodeSize;
+
+    slab = btree->allocator.alloc ( btree->allocator.context, size );
+    if ( slab == NULL )
+    {
+        return -ENOMEM;
     }
+    TRACE ( "In allocate_btree_slab - Allocated %p\n", slab );
+
     //
-    //  Adjust the record count of the old child to be correct now that we've
-    //  copied out about half of the data in this node.
+    //  Link the new slab into the list of slabs owned by this btree.
     //
-    child->keysInUse = order - 1;
+    ( (bt_slab_t*)slab )->next = btree->slabs;
+    ( (bt_slab_t*)slab )->size = size;
+    btree->slabs = slab;
+
+    carve_btree_slab ( btree, slab );
+
+    return 0;
+}
+
+/**
+*       Function used to allocate memory for the btree node.  Nodes are taken
+*       from the free list of the btree if one is available, otherwise a new
+*       slab of nodes is allocated first.
+*       @param btree The btree
+*       @return The allocated B-tree node or NULL if out of memory
+*/
+static bt_node_t* allocate_btree_node ( btree_t* btree )
+{
+    bt_node_t* node;
 
     //
-    //  Move all the child pointers of the parent up (towards the end) of the
-    //  parent node to make room for the new node we just created.
+    //  If there are no free nodes left, go allocate another slab of them.
     //
-    for ( i = parent->keysInUse + 1; i > index + 1; i-- )
+    if ( btree->freeList == NULL )
     {
-        parent->children[i] = parent->children[i - 1];
+        if ( allocate_btree_slab ( btree ) != 0 )
+        {
+            return NULL;
+        }
     }
     //
-    //  Store the new child we just created into the node list of the parent.
+    //  Take the first node off of the free list.  Note that the record and
+    //  child arrays were already set up when the slab was carved.
     //
-    parent->children[index + 1] = newChild;
+    node = btree->freeList;
+    btree->freeList = node->next;
+
+    TRACE ( "In allocate_btree_node - Allocated %p\n", node );
 
     //
-    //  Move all the data records in the parent one place to the right as well
-    //  to make room for the new child.
+    //  Set the number of records in this node to zero.
     //
-    for ( i = parent->keysInUse; i > index; i-- )
-    {
-        parent->dataRecords[i] = parent->dataRecords[i - 1];
-    }
+    node->keysInUse = 0;
+
     //
-    //  Move the key that was used to split the node from the child to the
-    //  parent.  Note that it was split at the "index" value specified by the
-    //  caller.
+    //  Mark this new node as a leaf node.
     //
-    parent->dataRecords[index] = child->dataRecords[order - 1];
+    node->leaf = true;
 
     //
-    //  Increment the number of records now in the parent.
+    //  Set the tree level to zero.
+    //
+    node->level = 0;
+
+    //
+    //  Set the linked list pointers to NULL.
+    //
+    node->next = NULL;
+    node->prev = NULL;
+
+    //
+    //  Set the parent node link to NULL.
+    //
+    node->parent = NULL;
+
+    //
+    //  Return the address of the new node to the caller.
+    //
+    return node;
+}
+
+/**
+*       Function used to return a node to the free list of the btree.  The
+*       memory itself is not released until the btree is destroyed.
+*       @param btree The btree
+*       @param node The node to be freed
+*       @return 0
+*/
+static int free_btree_node ( btree_t* btree, bt_node_t* node )
+{
+    TRACE ( "In free_btree_node - Freeing %p\n", node );
+
+    node->next = btree->freeList;
+    btree->freeList = node;
+
+    return 0;
+}
+
+/**
+*   Compute the fingerprint of a key, or 0 if the btree does not use
+*   fingerprints.
+*/
+static inline uint64_t key_fingerprint ( btree_t* btree, void* key )
+{
+    return btree->fingerprintCB != NULL ? btree->fingerprintCB ( key ) : 0;
+}
+
+/**
+*   Compare a key with the record at the given index of a node.  If the btree
+*   uses fingerprints, those are compared first and the record itself is only
+*   looked at when the fingerprints are equal.
+*
+*   @param btree The btree
+*   @param key The key to be compared
+*   @param fingerprint The fingerprint of the key
+*   @param node The node containing the record
+*   @param index The index of the record in the node
+*   @return < 0, 0 or > 0 as for the btree compare function
+*/
+static inline int compare_record ( btree_t* btree, void* key,
+                                   uint64_t fingerprint, bt_node_t* node,
+                                   unsigned int index )
+{
+    if ( node->fingerprints != NULL )
+    {
+        if ( fingerprint < node->fingerprints[index] )
+        {
+            return -1;
+        }
+        if ( fingerprint > node->fingerprints[index] )
+        {
+            return 1;
+        }
+    }
+    return btree->compareCB ( key, node->dataRecords[index] );
+}
+
+/**
+*   Copy the record (and its fingerprint) at the given index of one node to
+*   the given index of another node.
+*/
+static inline void copy_record ( bt_node_t* dest, unsigned int destIndex,
+                                 bt_node_t* src, unsigned int srcIndex )
+{
+    dest->dataRecords[destIndex] = src->dataRecords[srcIndex];
+    if ( dest->fingerprints != NULL )
+    {
+        dest->fingerprints[destIndex] = src->fingerprints[srcIndex];
+    }
+}
+
+/**
+*   Store a record (and its fingerprint) at the given index of a node.
+*/
+static inline void set_record ( btree_t* btree, bt_node_t* node,
+                                unsigned int index, void* record )
+{
+    node->dataRecords[index] = record;
+    if ( node->fingerprints != NULL )
+    {
+        node->fingerprints[index] = btree->fingerprintCB ( record );
+    }
+}
+
+/**
+*   Binary search the records of a node for the first record that is greater
+*   than or equal to the given key.
+*
+*   @param btree The btree
+*   @param node The node to be searched
+*   @param key The key to be searched for
+*   @param fingerprint The fingerprint of the key
+*   @param diff Returns the result of comparing the key with the record at
+*               the returned index (> 0 if the index is past the last record)
+*   @return The index of the first record >= key, or keysInUse if none
+*/
+static unsigned int node_lower_bound ( btree_t* btree, bt_node_t* node,
+                                       void* key, uint64_t fingerprint,
+                                       int* diff )
+{
+    unsigned int low  = 0;
+    unsigned int high = node->keysInUse;
+    unsigned int mid;
+    int          result;
+
+    *diff = 1;
+
+    while ( low < high )
+    {
+        mid = low + ( high - low ) / 2;
+        result = compare_record ( btree, key, fingerprint, node, mid );
+
+        if ( result > 0 )
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high  = mid;
+            *diff = result;
+        }
+    }
+    return low;
+}
+
+/**
+*   Binary search the records of a node for the first record that is strictly
+*   greater than the given key.  This is the position at which the key would
+*   be inserted into the node.
+*
+*   @param btree The btree
+*   @param node The node to be searched
+*   @param key The key to be searched for
+*   @param fingerprint The fingerprint of the key
+*   @return The index of the first record > key, or keysInUse if none
+*/
+static unsigned int node_upper_bound ( btree_t* btree, bt_node_t* node,
+                                       void* key, uint64_t fingerprint )
+{
+    unsigned int low  = 0;
+    unsigned int high = node->keysInUse;
+    unsigned int mid;
+
+    while ( low < high )
+    {
+        mid = low + ( high - low ) / 2;
+
+        if ( compare_record ( btree, key, fingerprint, node, mid ) < 0 )
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+    return low;
+}
+
+/**
+*   Used to split the child node and adjust the parent so that
+*   it has two children
+*   @param parent Parent Node
+*   @param index Index of the parent node where the new record will be put
+*   @param child  Full child node
+*
+*/
+static void btree_split_child ( btree_t*     btree,
+                                bt_node_t*   parent,
+                                unsigned int index,
+                                bt_node_t*   child )
+{
+    int          i = 0;
+    unsigned int order = btree->order;
+    unsigned int first = order;
+
+    TRACE ( "In btree_split_child\n" );
+
+    //
+    //  Go create a new tree node as our "new child".  The new node will be
+    //  created at the same level as the old node (at least initially - It may
+    //  get moved when we balance the tree later) and to the right of the node
+    //  that is being split.
+    //
+    bt_node_t* newChild = allocate_btree_node ( btree );
+
+    //
+    //  Initialize the fields of the new node appropriately.
+    //
+    newChild->leaf = child->leaf;
+    newChild->level = child->level;
+    newChild->keysInUse = btree->order - 1;
+    newChild->parent = parent;
+
+    //
+    //  In B+ mode a leaf has to keep all of its records, so the record at
+    //  the split point becomes the first record of the new leaf and the
+    //  parent only gets a copy of it.  The new leaf is linked into the leaf
+    //  chain right after the old one.
+    //
+    if ( btree->bplus && child->leaf )
+    {
+        first = order - 1;
+        newChild->keysInUse = order;
+
+        newChild->prev = child;
+        newChild->next = child->next;
+        if ( child->next != NULL )
+        {
+            child->next->prev = newChild;
+        }
+        child->next = newChild;
+    }
+    //
+    //  Move the keys from beyond the split point from the old child to the
+    //  beginning of the new child.
+    //
+    for ( i = 0; i < newChild->keysInUse; i++ )
+    {
+        copy_record ( newChild, i, child, i + first );
+
+        //
+        //  If this is not a leaf node, also copy the "children" pointers from
+        //  the old child to the new one.
+        //
+        if ( ! child->leaf )
+        {
+            newChild->children[i] = child->children[i + order];
+
+            //
+            //  Make the parent pointer in the child that we just moved now
+            //  point to the new child rather than the old child from which it
+            //  was moved.
+            //
+            newChild->children[i]->parent = newChild;
+        }
+    }
+    //
+    //  If this is not a leaf node, copy the last node pointer (remember that
+    //  there is one extra node pointer for a given number of keys).
+    //
+    if ( ! child->leaf )
+    {
+        newChild->children[i] = child->children[i + order];
+
+        //
+        //  Make the parent pointer in the child that we just moved now point
+        //  to the new child rather than the old child from which it was
+        //  moved.
+        //
+        newChild->children[i]->parent = newChild;
+    }
+    //
+    //  Adjust the record count of the old child to be correct now that we've
+    //  copied out about half of the data in this node.
+    //
+    child->keysInUse = order - 1;
+
+    //
+    //  Move all the child pointers of the parent up (towards the end) of the
+    //  parent node to make room for the new node we just created.
+    //
+    for ( i = parent->keysInUse + 1; i > index + 1; i-- )
+    {
+        parent->children[i] = parent->children[i - 1];
+    }
+    //
+    //  Store the new child we just created into the node list of the parent.
+    //
+    parent->children[index + 1] = newChild;
+
+    //
+    //  Move all the data records in the parent one place to the right as well
+    //  to make room for the new child.
+    //
+    for ( i = parent->keysInUse; i > index; i-- )
+    {
+        copy_record ( parent, i, parent, i - 1 );
+    }
+    //
+    //  Move the key that was used to split the node from the child to the
+    //  parent.  Note that it was split at the "index" value specified by the
+    //  caller.  (In B+ mode this is a copy of the first record of the new
+    //  leaf.)
+    //
+    copy_record ( parent, index, child, order - 1 );
+
+    //
+    //  Increment the number of records now in the parent.
     //
     parent->keysInUse++;
 }
@@ -305,18 +875,17 @@ static void btree_split_child ( btree_t*     btree,
 *   TODO: I can't believe that this function can't fail!  It has no return
 *   code!
 *
-*   TODO: We could make the node search more efficient by implementing a
-*   binary search instead of the linear one.  For small tree orders, the
-*   linear search is more efficient but as the tree orders get larger, the
-*   binary search will win.
+*   The position of the new data in each node is found with a binary search.
 */
 static void btree_insert_nonfull ( btree_t*   btree,
                                    bt_node_t* parentNode,
                                    void*      data )
 {
-    int        i;
-    bt_node_t* child;
-    bt_node_t* node = parentNode;
+    unsigned int i;
+    int          diff;
+    bt_node_t*   child;
+    bt_node_t*   node = parentNode;
+    uint64_t     fingerprint = key_fingerprint ( btree, data );
 
     TRACE ( "In btree_insert_nonfull\n" );
 
@@ -327,9 +896,10 @@ static void btree_insert_nonfull ( btree_t*   btree,
 insert:
 
     //
-    //  Position us at the end of the records in this node.
+    //  Find the position of the first record in this node that is larger than
+    //  the new data.
     //
-    i = node->keysInUse - 1;
+    i = node_upper_bound ( btree, node, data, fingerprint );
 
     //
     //  If this is a leaf node...
@@ -337,21 +907,23 @@ insert:
     if ( node->leaf )
     {
         //
-        //  Move all the records in the node one position to the right
-        //  (working backwards from the end) until we get to the point where
-        //  the new data will go.
+        //  Move all the records from the insertion point to the end of the
+        //  node one position to the right to make room for the new data.
         //
-        while ( i >= 0 &&
-                ( btree->compareCB ( data, node->dataRecords[i] ) < 0 ) )
-        {
-            node->dataRecords[i + 1] = node->dataRecords[i];
-            i--;
-        }
+        COPY ( &node->dataRecords[i + 1], &node->dataRecords[i],
+               ( node->keysInUse - i ) * sizeof(void*) );
         //
         //  Put the new data into this node and increment the number of
         //  records in the node.
         //
-        node->dataRecords[i + 1] = data;
+        node->dataRecords[i] = data;
+
+        if ( node->fingerprints != NULL )
+        {
+            COPY ( &node->fingerprints[i + 1], &node->fingerprints[i],
+                   ( node->keysInUse - i ) * sizeof(uint64_t) );
+            node->fingerprints[i] = fingerprint;
+        }
         node->keysInUse++;
     }
     //
@@ -360,20 +932,10 @@ insert:
     else
     {
         //
-        //  Search the node records backwards from the end until we find the
-        //  point at which the new data should go.
-        //
-        while ( i >= 0 &&
-                ( btree->compareCB ( data, node->dataRecords[i] ) < 0 ) )
-        {
-            i--;
-        }
-        //
-        //  Grab the right hand child of this position so we can check to see
-        //  if the new data goes into the current node or the right child
-        //  node.
+        //  Grab the child to the left of the insertion point so we can check
+        //  to see if the new data goes into the current node or the right
+        //  child node.
         //
-        i++;
         child = node->children[i];
 
         //
@@ -388,9 +950,11 @@ insert:
 
             //
             //  If the new data is greater than the current record then
-            //  increment to the next record.
+            //  increment to the next record.  In B+ mode data equal to the
+            //  separator belongs in the right child as well.
             //
-            if ( btree->compareCB ( data, node->dataRecords[i] ) > 0 )
+            diff = compare_record ( btree, data, fingerprint, node, i );
+            if ( diff > 0 || ( diff == 0 && btree->bplus ) )
             {
                 i++;
             }
@@ -420,6 +984,11 @@ int btree_insert ( btree_t* btree, void* data )
 
     TRACE ( "In btree_insert\n" );
 
+    //
+    //  Any change to the btree invalidates the paths saved in iterators.
+    //
+    btree->generation++;
+
     //
     //  Start the search at the root node.
     //
@@ -494,42 +1063,491 @@ int btree_insert ( btree_t* btree, void* data )
 }
 
 /**
-*   Used to get the position of the MAX key within the subtree
+*   Return all of the nodes of a subtree to the free list of the btree.  The
+*   records in the subtree are not touched.
 *   @param btree The btree
-*   @param subtree The subtree to be searched
-*   @return The node containing the key and position of the key
+*   @param node The root of the subtree to be released
+*   @return none
 */
-static nodePosition get_max_key_pos ( btree_t* btree, bt_node_t* subtree )
+static void free_btree_subtree ( btree_t* btree, bt_node_t* node )
 {
-    nodePosition nodePosition;
-    bt_node_t* node = subtree;
-
-    TRACE ( "In get_max_key_pos\n" );
+    unsigned int i;
 
-    //
-    //  This loop basically runs down the right hand node pointers in each
-    //  node until it gets to the leaf node at which point the value we want
-    //  is the last one (right most) in that node.
-    //
-    while ( true )
+    if ( ! node->leaf )
     {
-        //
-        //  If we hit a NULL node pointer, it's time to quit.
-        //
-        if ( node == NULL )
+        for ( i = 0; i <= node->keysInUse; i++ )
         {
-            break;
+            free_btree_subtree ( btree, node->children[i] );
         }
-        //
-        //  Save the current node pointer and the index of the last record in
-        //  this node.
-        //
-        nodePosition.node = node;
-        nodePosition.index = node->keysInUse - 1;
+    }
+    free_btree_node ( btree, node );
+}
 
-        //
-        //  If this is a leaf node...
-        //
+/**
+*   Used to build a subtree of the given height bottom-up from a sorted array
+*   of records.
+*
+*   A subtree of height h (a leaf has height 0) holds at most (2t)^(h+1) - 1
+*   records.  The records are split evenly between c children of height h-1
+*   where c is the smallest number of children that will hold them, with the
+*   record following each child except the last one becoming a separator in
+*   this node.  A non-root node is given at least t children so that every
+*   node ends up at least half full.  The caller picks the height so that the
+*   records fit, which keeps every child within the limits of a btree node.
+*
+*   In B+ mode all of the records go to the leaves, so a subtree of height h
+*   holds at most (2t - 1) * (2t)^h records, and the separators are copies of
+*   the first record of each child but the first.  The leaves are built from
+*   left to right and each one is linked in after the previous one.
+*
+*   @param btree The btree
+*   @param records The sorted array of records for this subtree
+*   @param count The number of records in the array
+*   @param height The height of the subtree to be built
+*   @param parent The parent of the new subtree or NULL for the root
+*   @param lastLeaf The last leaf built so far (B+ mode only)
+*   @return The root of the new subtree, NULL if out of memory
+*/
+static bt_node_t* bulk_build_subtree ( btree_t* btree, void** records,
+                                       unsigned int count, unsigned int height,
+                                       bt_node_t* parent, bt_node_t** lastLeaf )
+{
+    bt_node_t*   node;
+    bt_node_t*   child;
+    uint64_t     span = 1;
+    unsigned int children;
+    unsigned int units;
+    unsigned int size;
+    unsigned int i;
+    unsigned int j;
+
+    node = allocate_btree_node ( btree );
+    if ( node == NULL )
+    {
+        return NULL;
+    }
+    node->parent = parent;
+    node->level  = height;
+
+    //
+    //  A leaf just gets all of the records.
+    //
+    if ( height == 0 )
+    {
+        for ( i = 0; i < count; i++ )
+        {
+            set_record ( btree, node, i, records[i] );
+        }
+        node->keysInUse = count;
+
+        if ( btree->bplus )
+        {
+            node->prev = *lastLeaf;
+            if ( *lastLeaf != NULL )
+            {
+                ( *lastLeaf )->next = node;
+            }
+            *lastLeaf = node;
+        }
+        return node;
+    }
+    node->leaf = false;
+
+    //
+    //  Compute the number of records (plus one) that one child can hold and
+    //  from that the number of children that we need.  In B+ mode there is
+    //  no separator to account for.
+    //
+    for ( i = 0; i < height; i++ )
+    {
+        span *= 2 * btree->order;
+    }
+    units = count + 1;
+
+    if ( btree->bplus )
+    {
+        span  = span / ( 2 * btree->order ) * ( 2 * btree->order - 1 );
+        units = count;
+    }
+    children = ( units + span - 1 ) / span;
+
+    if ( parent != NULL && children < btree->order )
+    {
+        children = btree->order;
+    }
+    if ( children < 2 )
+    {
+        children = 2;
+    }
+    //
+    //  Hand out the records (plus one for each separator) as evenly as
+    //  possible to the children, building each child subtree as we go.
+    //
+    for ( j = 0; j < children; j++ )
+    {
+        size = units / children + ( j < units % children ? 1 : 0 );
+
+        if ( ! btree->bplus )
+        {
+            size--;
+        }
+        else if ( j > 0 )
+        {
+            set_record ( btree, node, j - 1, records[0] );
+        }
+        child = bulk_build_subtree ( btree, records, size, height - 1, node,
+                                     lastLeaf );
+
+        if ( child == NULL )
+        {
+            node->keysInUse = j > 0 ? j - 1 : 0;
+            if ( j > 0 )
+            {
+                free_btree_subtree ( btree, node );
+            }
+            else
+            {
+                free_btree_node ( btree, node );
+            }
+            return NULL;
+        }
+        node->children[j] = child;
+        records += size;
+
+        if ( ! btree->bplus && j < children - 1 )
+        {
+            set_record ( btree, node, j, *records++ );
+        }
+    }
+    node->keysInUse = children - 1;
+
+    return node;
+}
+
+/**
+*   Used to build a new tree from a sorted array of records and swap it in for
+*   the current contents of the btree.  The nodes of the old tree are put on
+*   the free list once the new tree has been built.
+*   @param btree The btree
+*   @param records The sorted array of records
+*   @param count The number of records in the array
+*   @return 0 on success, -ENOMEM if out of memory (the btree is unchanged)
+*/
+static int bulk_load_records ( btree_t* btree, void** records,
+                               unsigned int count )
+{
+    bt_node_t*   root;
+    bt_node_t*   lastLeaf = NULL;
+    uint64_t     capacity = btree->nodeFullSize;
+    unsigned int height   = 0;
+
+    //
+    //  Find the smallest height of tree that will hold all of the records.
+    //
+    while ( count > capacity )
+    {
+        capacity = btree->bplus ? capacity * 2 * btree->order :
+                                  ( capacity + 1 ) * 2 * btree->order - 1;
+        height++;
+    }
+    root = bulk_build_subtree ( btree, records, count, height, NULL,
+                                &lastLeaf );
+    if ( root == NULL )
+    {
+        return -ENOMEM;
+    }
+    free_btree_subtree ( btree, btree->root );
+
+    btree->root  = root;
+    btree->count = count;
+    btree->generation++;
+
+    return 0;
+}
+
+/**
+*   Used to load an empty btree from an array of records.  This is much
+*   faster than inserting the records one at a time since the nodes are
+*   built bottom-up, each one being filled in a single pass, and no records
+*   are compared.
+*
+*   The records must already be sorted in ascending order according to the
+*   compare function of the btree.
+*
+*   @param btree The btree
+*   @param records The sorted array of records
+*   @param count The number of records in the array
+*   @return 0 on success, -EBUSY if the btree is not empty, -ENOMEM if out of
+*           memory
+*/
+int btree_bulk_load ( btree_t* btree, void** records, unsigned int count )
+{
+    TRACE ( "In btree_bulk_load\n" );
+
+    if ( btree->count != 0 )
+    {
+        return -EBUSY;
+    }
+    if ( count == 0 )
+    {
+        return 0;
+    }
+    return bulk_load_records ( btree, records, count );
+}
+
+/**
+*   Used to add a sorted array of records to a btree.
+*
+*   If the array is small compared to the btree (less than 1 /
+*   BTREE_MERGE_RATIO of its size), the records are just inserted one at a
+*   time.  Otherwise the records already in the btree are merged with the new
+*   ones into a single sorted array and the btree is rebuilt from that with
+*   btree_bulk_load.  As with btree_insert, records that compare equal to a
+*   record already in the btree are added as well.
+*
+*   The records must already be sorted in ascending order according to the
+*   compare function of the btree.
+*
+*   @param btree The btree
+*   @param records The sorted array of records
+*   @param count The number of records in the array
+*   @return 0 on success, -ENOMEM if out of memory (the btree is unchanged)
+*/
+int btree_merge_sorted ( btree_t* btree, void** records, unsigned int count )
+{
+    btree_iterator_t iter;
+    void**           merged;
+    void*            current;
+    unsigned int     total = btree->count + count;
+    unsigned int     i     = 0;
+    unsigned int     j     = 0;
+    int              rc;
+
+    TRACE ( "In btree_merge_sorted\n" );
+
+    if ( count == 0 )
+    {
+        return 0;
+    }
+    if ( btree->count == 0 )
+    {
+        return bulk_load_records ( btree, records, count );
+    }
+    //
+    //  If there are only a few new records, insert them individually.
+    //
+    if ( (uint64_t)count * BTREE_MERGE_RATIO < btree->count )
+    {
+        for ( i = 0; i < count; i++ )
+        {
+            btree_insert ( btree, records[i] );
+        }
+        return 0;
+    }
+    //
+    //  Merge the current contents of the btree with the new records.
+    //
+    merged = MEM_ALLOC ( total * sizeof(void*) );
+    if ( merged == NULL )
+    {
+        return -ENOMEM;
+    }
+    btree_iter_begin_init ( &iter, btree );
+
+    while ( ! btree_iter_at_end ( &iter ) )
+    {
+        current = btree_iter_data ( &iter );
+
+        while ( i < count && btree->compareCB ( records[i], current ) < 0 )
+        {
+            merged[j++] = records[i++];
+        }
+        merged[j++] = current;
+        btree_iter_next ( &iter );
+    }
+    while ( i < count )
+    {
+        merged[j++] = records[i++];
+    }
+    //
+    //  Go rebuild the btree from the merged records.
+    //
+    rc = bulk_load_records ( btree, merged, total );
+
+    MEM_FREE ( merged );
+
+    return rc;
+}
+
+/**
+*   Used to remove all of the records in a range of keys from a btree and
+*   hand each of the removed records to a visitor function.
+*
+*   The records between "lo" and "hi" (both inclusive) are first located
+*   with a range iterator.  If they make up at least 1 / BTREE_MERGE_RATIO of
+*   the btree, the remaining records are collected (by position, without
+*   comparing any keys) and the btree is rebuilt from them in a single pass,
+*   which is much cheaper than deleting and rebalancing record by record.
+*   Smaller ranges are deleted one record at a time.
+*
+*   The visitor is only called once the btree is consistent again, so it is
+*   free to destroy the records or to operate on the btree itself.
+*
+*   @param btree The btree
+*   @param lo The lower bound (inclusive) of the range
+*   @param hi The upper bound (inclusive) of the range
+*   @param visitor The function to call with each removed record or NULL
+*   @param context A user pointer that is passed to the visitor
+*   @return The number of records removed, -ENOMEM if out of memory (the
+*           btree is unchanged)
+*/
+int btree_delete_range ( btree_t* btree, void* lo, void* hi,
+                         visitFunc visitor, void* context )
+{
+    btree_iterator_t iter;
+    void**           removed;
+    void**           kept    = NULL;
+    unsigned int     count   = 0;
+    unsigned int     i;
+    unsigned int     j;
+    int              rc      = 0;
+
+    TRACE ( "In btree_delete_range\n" );
+
+    //
+    //  Count the records in the range.
+    //
+    btree_find_range_init ( &iter, btree, lo, hi );
+    while ( ! btree_iter_at_end ( &iter ) )
+    {
+        count++;
+        btree_iter_next ( &iter );
+    }
+    if ( count == 0 )
+    {
+        return 0;
+    }
+    //
+    //  Save the records in the range so that they can be handed to the
+    //  visitor once they have been removed from the btree.
+    //
+    removed = MEM_ALLOC ( count * sizeof(void*) );
+    if ( removed == NULL )
+    {
+        return -ENOMEM;
+    }
+    i = 0;
+    btree_find_range_init ( &iter, btree, lo, hi );
+    while ( ! btree_iter_at_end ( &iter ) )
+    {
+        removed[i++] = btree_iter_data ( &iter );
+        btree_iter_next ( &iter );
+    }
+    //
+    //  If there are only a few records in the range, delete them one at a
+    //  time.
+    //
+    if ( (uint64_t)count * BTREE_MERGE_RATIO < btree->count )
+    {
+        for ( i = 0; i < count; i++ )
+        {
+            btree_delete ( btree, btree->root, removed[i] );
+        }
+    }
+    //
+    //  Otherwise collect all of the records outside of the range in order and
+    //  rebuild the btree from them.  The range is a contiguous run so we just
+    //  skip over it when we reach its first record.
+    //
+    else
+    {
+        if ( btree->count > count )
+        {
+            kept = MEM_ALLOC ( ( btree->count - count ) * sizeof(void*) );
+            if ( kept == NULL )
+            {
+                MEM_FREE ( removed );
+                return -ENOMEM;
+            }
+        }
+        j = 0;
+        btree_iter_begin_init ( &iter, btree );
+        while ( ! btree_iter_at_end ( &iter ) )
+        {
+            if ( btree_iter_data ( &iter ) == removed[0] )
+            {
+                for ( i = 0; i < count; i++ )
+                {
+                    btree_iter_next ( &iter );
+                }
+                continue;
+            }
+            kept[j++] = btree_iter_data ( &iter );
+            btree_iter_next ( &iter );
+        }
+        rc = bulk_load_records ( btree, kept, j );
+
+        MEM_FREE ( kept );
+
+        if ( rc != 0 )
+        {
+            MEM_FREE ( removed );
+            return rc;
+        }
+    }
+    //
+    //  Now that the btree is consistent, hand the removed records to the
+    //  visitor.
+    //
+    if ( visitor != NULL )
+    {
+        for ( i = 0; i < count; i++ )
+        {
+            visitor ( removed[i], context );
+        }
+    }
+    MEM_FREE ( removed );
+
+    return count;
+}
+
+/**
+*   Used to get the position of the MAX key within the subtree
+*   @param btree The btree
+*   @param subtree The subtree to be searched
+*   @return The node containing the key and position of the key
+*/
+static nodePosition get_max_key_pos ( btree_t* btree, bt_node_t* subtree )
+{
+    nodePosition nodePosition;
+    bt_node_t* node = subtree;
+
+    TRACE ( "In get_max_key_pos\n" );
+
+    //
+    //  This loop basically runs down the right hand node pointers in each
+    //  node until it gets to the leaf node at which point the value we want
+    //  is the last one (right most) in that node.
+    //
+    while ( true )
+    {
+        //
+        //  If we hit a NULL node pointer, it's time to quit.
+        //
+        if ( node == NULL )
+        {
+            break;
+        }
+        //
+        //  Save the current node pointer and the index of the last record in
+        //  this node.
+        //
+        nodePosition.node = node;
+        nodePosition.index = node->keysInUse - 1;
+
+        //
+        //  If this is a leaf node...
+        //
         if ( node->leaf )
         {
             //
@@ -670,11 +1688,30 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
     leftChild  = parent->children[index];
     rightChild = parent->children[index + 1];
 
+    //
+    //  In B+ mode two leaves are merged by just appending the records of the
+    //  right leaf to the left one.  The separator in the parent is only a
+    //  copy of the first record of the right leaf so it is simply dropped.
+    //
+    if ( btree->bplus && leftChild->leaf )
+    {
+        for ( j = 0; j < rightChild->keysInUse; j++ )
+        {
+            copy_record ( leftChild, leftChild->keysInUse + j, rightChild, j );
+        }
+        leftChild->keysInUse += rightChild->keysInUse;
+
+        if ( rightChild->next != NULL )
+        {
+            rightChild->next->prev = leftChild;
+        }
+        goto merged;
+    }
     //
     //  Move the data record from the parent to the left child at the split
     //  point.
     //
-    leftChild->dataRecords[btree->order - 1] = parent->dataRecords[index];
+    copy_record ( leftChild, btree->order - 1, parent, index );
 
     //
     //  Move all of the rest of the data records from the right child into the
@@ -683,7 +1720,7 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
     //
     for ( j = 0; j < btree->order - 1; j++ )
     {
-        leftChild->dataRecords[j + btree->order] = rightChild->dataRecords[j];
+        copy_record ( leftChild, j + btree->order, rightChild, j );
 
         //
         //  If this is not a leaf node, move the child pointers from the right
@@ -724,6 +1761,8 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
     //
     leftChild->keysInUse += rightChild->keysInUse + 1;
 
+merged:
+
     //
     //  If the parent node is not empty now that we moved the specified data
     //  record from it to the new merged node...
@@ -742,7 +1781,7 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
         //
         for ( j = index; j < parent->keysInUse; j++ )
         {
-            parent->dataRecords[j] = parent->dataRecords[j + 1];
+            copy_record ( parent, j, parent, j + 1 );
             parent->children[j + 1] = parent->children[j + 2];
         }
         //
@@ -765,7 +1804,7 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
     //
     else
     {
-        free_btree_node ( parent );
+        free_btree_node ( btree, parent );
 
         leftChild->parent = NULL;
 
@@ -780,7 +1819,7 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
     //
     //  Go free up the right child node.
     //
-    free_btree_node ( rightChild );
+    free_btree_node ( btree, rightChild );
 
     //
     //  Return the merged left child node to the caller.
@@ -812,20 +1851,57 @@ static void move_key ( btree_t* btree, bt_node_t* node, unsigned int index,
     lchild = node->children[index];
     rchild = node->children[index + 1];
 
+    //
+    //  In B+ mode the separator in the parent is a copy of the first record
+    //  of the right leaf, so a record is moved straight from one leaf to the
+    //  other and the separator is then updated to the new first record of
+    //  the right leaf.
+    //
+    if ( btree->bplus && lchild->leaf )
+    {
+        if ( pos == left )
+        {
+            copy_record ( lchild, lchild->keysInUse, rchild, 0 );
+            lchild->keysInUse++;
+
+            for ( i = 0; i < rchild->keysInUse - 1; i++ )
+            {
+                copy_record ( rchild, i, rchild, i + 1 );
+            }
+            rchild->keysInUse--;
+        }
+        else
+        {
+            for ( i = rchild->keysInUse; i > 0; i-- )
+            {
+                copy_record ( rchild, i, rchild, i - 1 );
+            }
+            copy_record ( rchild, 0, lchild, lchild->keysInUse - 1 );
+            rchild->keysInUse++;
+            lchild->keysInUse--;
+        }
+        copy_record ( node, index, rchild, 0 );
+        return;
+    }
+
     // Move the key from the parent to the left child
     if ( pos == left )
     {
-        lchild->dataRecords[lchild->keysInUse] = node->dataRecords[index];
+        copy_record ( lchild, lchild->keysInUse, node, index );
         lchild->children[lchild->keysInUse + 1] = rchild->children[0];
         rchild->children[0] = NULL;
+        if ( ! lchild->leaf )
+        {
+            lchild->children[lchild->keysInUse + 1]->parent = lchild;
+        }
         lchild->keysInUse++;
 
-        node->dataRecords[index] = rchild->dataRecords[0];
+        copy_record ( node, index, rchild, 0 );
         rchild->dataRecords[0] = NULL;
 
         for ( i = 0; i < rchild->keysInUse - 1; i++ )
         {
-            rchild->dataRecords[i] = rchild->dataRecords[i + 1];
+            copy_record ( rchild, i, rchild, i + 1 );
             rchild->children[i] = rchild->children[i + 1];
         }
         rchild->children[rchild->keysInUse - 1] =
@@ -837,18 +1913,22 @@ static void move_key ( btree_t* btree, bt_node_t* node, unsigned int index,
         // Move the key from the parent to the right child
         for ( i = rchild->keysInUse; i > 0; i-- )
         {
-            rchild->dataRecords[i] = rchild->dataRecords[i - 1];
+            copy_record ( rchild, i, rchild, i - 1 );
             rchild->children[i + 1] = rchild->children[i];
         }
         rchild->children[1] = rchild->children[0];
         rchild->children[0] = NULL;
 
-        rchild->dataRecords[0] = node->dataRecords[index];
+        copy_record ( rchild, 0, node, index );
 
         rchild->children[0] = lchild->children[lchild->keysInUse];
         lchild->children[lchild->keysInUse] = NULL;
+        if ( ! rchild->leaf )
+        {
+            rchild->children[0]->parent = rchild;
+        }
 
-        node->dataRecords[index] = lchild->dataRecords[lchild->keysInUse - 1];
+        copy_record ( node, index, lchild, lchild->keysInUse - 1 );
         lchild->dataRecords[lchild->keysInUse - 1] = NULL;
 
         lchild->keysInUse--;
@@ -866,7 +1946,6 @@ static void move_key ( btree_t* btree, bt_node_t* node, unsigned int index,
 
 int delete_key_from_node ( btree_t* btree, nodePosition* nodePosition )
 {
-    unsigned int maxNumberOfKeys = 2 * btree->order - 1;
     unsigned int i;
     bt_node_t*   node = nodePosition->node;
 
@@ -885,9 +1964,9 @@ int delete_key_from_node ( btree_t* btree, nodePosition* nodePosition )
     //  want to delete to the end of the node to collapse the data list after
     //  the removal of the target record.
     //
-    for ( i = nodePosition->index; i < maxNumberOfKeys - 1; i++ )
+    for ( i = nodePosition->index; i < node->keysInUse - 1; i++ )
     {
-        node->dataRecords[i] = node->dataRecords[i + 1];
+        copy_record ( node, i, node, i + 1 );
     }
     //
     //  Decrement the number of keys in use in this node.
@@ -901,7 +1980,7 @@ int delete_key_from_node ( btree_t* btree, nodePosition* nodePosition )
     //
     if ( ( node->keysInUse == 0 ) && ( node != btree->root ) )
     {
-        free_btree_node ( node );
+        free_btree_node ( btree, node );
     }
     //
     //  Return a good completion code to the caller.
@@ -910,7 +1989,114 @@ int delete_key_from_node ( btree_t* btree, nodePosition* nodePosition )
 }
 
 /**
-*       Function used to delete a node from a  B-Tree
+*   Used to delete a record from a btree in B+ mode.
+*
+*   This makes the same single pass down the btree as btree_delete does
+*   (case 3 from Cormen): before descending into a child that only has the
+*   minimum number of records, a record is moved over to it from a sibling
+*   or it is merged with a sibling, so that the record can then be removed
+*   from its leaf without going back up the btree.  Since all of the records
+*   are in the leaves, the cases for deleting from an interior node never
+*   come up.  If the record is also used as a separator, it is the first
+*   record of its leaf and the separator is replaced by the record that
+*   follows it in that leaf.
+*
+*   @param btree The btree
+*   @param data The record to be deleted
+*   @return 0 on success, -ENODATA if the record is not in the btree
+*/
+static int bplus_delete ( btree_t* btree, void* data )
+{
+    unsigned int i;
+    int          diff;
+    unsigned int splitPoint  = btree->order - 1;
+    unsigned int sepIndex    = 0;
+    bt_node_t*   node        = btree->root;
+    bt_node_t*   sepNode     = NULL;
+    nodePosition nodePosition;
+    uint64_t     fingerprint = key_fingerprint ( btree, data );
+
+    TRACE ( "In bplus_delete\n" );
+
+    while ( ! node->leaf )
+    {
+        //
+        //  Find the child that the record would be in.  A record equal to a
+        //  separator is in the subtree to the right of it.
+        //
+        i = node_upper_bound ( btree, node, data, fingerprint );
+
+        //
+        //  If the child only has t - 1 records, give it another one from a
+        //  sibling that can spare one or merge it with a sibling, and then
+        //  look for the child again since the separators may have changed.
+        //
+        if ( node->children[i]->keysInUse <= splitPoint )
+        {
+            if ( i < node->keysInUse &&
+                 node->children[i + 1]->keysInUse > splitPoint )
+            {
+                move_key ( btree, node, i, left );
+            }
+            else if ( i > 0 && node->children[i - 1]->keysInUse > splitPoint )
+            {
+                move_key ( btree, node, i, right );
+            }
+            else
+            {
+                //
+                //  If the merge took the last separator out of the root, the
+                //  merged node is the new root so just start over from it.
+                //
+                if ( merge_siblings ( btree, node, i ) == btree->root )
+                {
+                    node = btree->root;
+                    continue;
+                }
+            }
+            i = node_upper_bound ( btree, node, data, fingerprint );
+        }
+        //
+        //  Remember where the separator for the record is, if it is one.
+        //
+        if ( i > 0 && compare_record ( btree, data, fingerprint, node,
+                                       i - 1 ) == 0 )
+        {
+            sepNode  = node;
+            sepIndex = i - 1;
+        }
+        node = node->children[i];
+    }
+    //
+    //  Find the record in the leaf.
+    //
+    i = node_lower_bound ( btree, node, data, fingerprint, &diff );
+    if ( diff != 0 )
+    {
+        return -ENODATA;
+    }
+    nodePosition.node  = node;
+    nodePosition.index = i;
+    delete_key_from_node ( btree, &nodePosition );
+
+    //
+    //  The leaf had at least t records so it is not empty now and the new
+    //  first record takes over as the separator.
+    //
+    if ( sepNode != NULL && i == 0 )
+    {
+        copy_record ( sepNode, sepIndex, node, 0 );
+    }
+    //
+    //  Decrement the number of records in the btree.
+    //
+    --btree->count;
+
+    return 0;
+}
+
+/**
+*       Function used to delete a node from a  B-Tree
 *       @param btree The B-Tree
 *       @param key Key of the node to be deleted
 *       @param value function to map the key to an unique integer value
@@ -930,9 +2116,19 @@ int btree_delete ( btree_t* btree, bt_node_t* subtree, void* data )
     bt_node_t*      parent;
     nodePosition    sub_nodePosition;
     nodePosition    nodePosition;
+    uint64_t        fingerprint = key_fingerprint ( btree, data );
 
     TRACE ( "In btree_delete\n" );
 
+    //
+    //  Any change to the btree invalidates the paths saved in iterators.
+    //
+    btree->generation++;
+
+    if ( btree->bplus )
+    {
+        return bplus_delete ( btree, data );
+    }
     node = subtree;
     parent = NULL;
 
@@ -962,21 +2158,7 @@ del_loop:
         //  in use in this node, i == node->keysInUse and we descend into the
         //  right child of the largest key in the node
         //
-        i = 0;
-        while ( i < node->keysInUse )
-        {
-            diff = btree->compareCB ( data, node->dataRecords[i] );
-
-            //
-            //  If we found the exact key we are looking for, just break out of
-            //  the loop.
-            //
-            if ( diff <= 0 )
-            {
-                break;
-            }
-            i++;
-        }
+        i = node_lower_bound ( btree, node, data, fingerprint, &diff );
         //
         //  Save the index value of this location.
         //
@@ -1187,16 +2369,20 @@ del_loop:
                 get_max_key_pos ( btree, node->children[index] );
 
             // Replace k by k' in x
-            node->dataRecords[index] =
-                sub_nodePosition.node->dataRecords[sub_nodePosition.index];
+            copy_record ( node, index, sub_nodePosition.node,
+                          sub_nodePosition.index );
 
-            // Recursively delete k' from the subtree rooted at y
-            btree_delete ( btree, node->children[index],
-                    node->dataRecords[index] );
+            //
+            //  Check the leaf flag before the recursive delete below since
+            //  that delete may release the node back to the free list.
+            //
             if ( sub_nodePosition.node->leaf == false )
             {
                 printf ( "Not leaf\n" );
             }
+            // Recursively delete k' from the subtree rooted at y
+            btree_delete ( btree, node->children[index],
+                    node->dataRecords[index] );
         }
         //
         // Case 2b: The child z that follows k has at least t keys
@@ -1210,16 +2396,20 @@ del_loop:
                 get_min_key_pos ( btree, node->children[index + 1] );
 
             // Replace k by k' in x
-            node->dataRecords[index] =
-                sub_nodePosition.node->dataRecords[sub_nodePosition.index];
+            copy_record ( node, index, sub_nodePosition.node,
+                          sub_nodePosition.index );
 
-            // Recursively delete k' from the subtree rooted at z
-            btree_delete ( btree, node->children[index + 1],
-                    node->dataRecords[index] );
+            //
+            //  Check the leaf flag before the recursive delete below since
+            //  that delete may release the node back to the free list.
+            //
             if ( sub_nodePosition.node->leaf == false )
             {
                 printf ( "Not leaf\n" );
             }
+            // Recursively delete k' from the subtree rooted at z
+            btree_delete ( btree, node->children[index + 1],
+                    node->dataRecords[index] );
         }
         //
         // Case 2c: both y and z have (t - 1) keys, so merge k and z into y, so
@@ -1278,6 +2468,7 @@ nodePosition get_btree_node ( btree_t* btree, void* key )
     bt_node_t*   node;
     unsigned int i;
     int          diff;
+    uint64_t     fingerprint = key_fingerprint ( btree, key );
 
     TRACE ( "In get_btree_node\n" );
 
@@ -1292,41 +2483,20 @@ nodePosition get_btree_node ( btree_t* btree, void* key )
     while ( true )
     {
         //
-        //  Initialize our position in this node to the first record of the
-        //  node.
+        //  Binary search the records in this node for the first record that
+        //  is equal to or larger than the target...
         //
-        i = 0;
+        i = node_lower_bound ( btree, node, key, fingerprint, &diff );
 
         //
-        //  Search the records in this node beginning from the start until
-        //  we find a record that is equal to or larger than the target...
+        //  If the record that we stopped on matches our target then return it
+        //  to the caller.
         //
-        while ( i < node->keysInUse )
+        if ( diff == 0 )
         {
-            //
-            //  Go compare the target with the current data record.
-            //
-            diff = btree->compareCB ( key, node->dataRecords[i] );
-
-            //
-            //  If the comparison results in a value < 0 then we are done so
-            //  just break out of this loop.
-            //
-            if ( diff < 0 )
-            {
-                break;
-            }
-            //
-            //  If the record that we stopped on matches our target then return it
-            //  to the caller.
-            //
-            if ( diff == 0 )
-            {
-                nodePosition.node  = node;
-                nodePosition.index = i;
-                return nodePosition;
-            }
-            i++;
+            nodePosition.node  = node;
+            nodePosition.index = i;
+            return nodePosition;
         }
         //
         //  If the node is a leaf and if we did not find the target in it then
@@ -1348,65 +2518,84 @@ nodePosition get_btree_node ( btree_t* btree, void* key )
 }
 
 /**
-*       Used to destory btree
+*   Call the visitor on every record of a subtree.  The nodes are left alone
+*   so the visitor is free to release the records as it goes.
+*   @param node The root of the subtree
+*   @param visitor The function to call with each record
+*   @param context Passed through to the visitor
+*   @return none
+*/
+static void visit_btree_subtree ( bt_node_t* node, visitFunc visitor,
+                                  void* context )
+{
+    unsigned int i;
+
+    for ( i = 0; i < node->keysInUse; ++i )
+    {
+        visitor ( node->dataRecords[i], context );
+    }
+    if ( ! node->leaf )
+    {
+        for ( i = 0; i <= node->keysInUse; ++i )
+        {
+            visit_btree_subtree ( node->children[i], visitor, context );
+        }
+    }
+}
+
+/**
+*       Used to destory btree.  Since every node of the btree was carved out
+*       of one of its slabs, this just returns all of the slabs (and the btree
+*       structure itself) to the allocator.
 *       @param btree The B-tree
 *       @return none
 */
 void btree_destroy ( btree_t* btree )
 {
-    int i = 0;
-
     TRACE ( "In btree_destroy\n" );
 
-    bt_node_t* head;
-    bt_node_t* tail;
-    bt_node_t* child;
-    bt_node_t* del_node;
+    btree_destroy_with ( btree, NULL, NULL );
+}
 
-    //
-    //  Start at the root node...
-    //
-    head = tail = btree->root;
+/**
+*       Used to destroy a btree along with the records in it.  The visitor is
+*       called exactly once for every record in a single walk of the tree
+*       (not in key order), after which the nodes are released just like
+*       btree_destroy does.  Nothing is rebalanced along the way, so tearing
+*       down a tree of n records is O(n).
+*       @param btree The B-tree
+*       @param visitor The function to call with each record, may be NULL
+*       @param context Passed through to the visitor
+*       @return none
+*/
+void btree_destroy_with ( btree_t* btree, visitFunc visitor, void* context )
+{
+    bt_node_t*   leaf;
+    unsigned int i;
+
+    TRACE ( "In btree_destroy_with\n" );
 
     //
-    //  Repeat until the head pointer becomes NULL...
+    //  In B+ mode the records in the interior nodes are only copies, so just
+    //  walk along the leaves instead.
     //
-    while ( head != NULL )
+    if ( visitor != NULL && btree->count != 0 && btree->bplus )
     {
-        //
-        //  If this is not a leaf node...
-        //
-        if ( ! head->leaf )
+        leaf = get_min_key_pos ( btree, btree->root ).node;
+        for ( ; leaf != NULL; leaf = leaf->next )
         {
-            //
-            //  For each record in this node...
-            //
-            //  ??? I think this is chaining all of the nodes into a list
-            //  using the "next" pointer in each node before actually deleting
-            //  any nodes.  I'm not sure if this is needed - Can't we just
-            //  traverse the tree depth first and delete the nodes as we go?
-            //
-            for ( i = 0; i < head->keysInUse + 1; i++ )
+            for ( i = 0; i < leaf->keysInUse; ++i )
             {
-                child = head->children[i];
-                tail->next = child;
-                tail = child;
-                child->next = NULL;
+                visitor ( leaf->dataRecords[i], context );
             }
         }
-        //
-        //  Grab the current list head for the delete that follows and then
-        //  update the head to the next node in the list.
-        //
-        del_node = head;
-        head = head->next;
-
-        //
-        //  Go delete the node that we saved above.
-        //
-        free_btree_node ( del_node );
     }
-    MEM_FREE ( btree );
+    else if ( visitor != NULL && btree->count != 0 )
+    {
+        visit_btree_subtree ( btree->root, visitor, context );
+    }
+    free_btree_slabs ( btree );
+    btree->allocator.free ( btree->allocator.context, btree );
 }
 
 /**
@@ -1555,8 +2744,27 @@ static void btree_traverse_node ( bt_node_t* subtree, traverseFunc traverseCB )
 //
 extern void btree_traverse ( btree_t* tree, traverseFunc traverseCB )
 {
+    bt_node_t* leaf;
+    int        i;
+
     TRACE ( "In btree_traverse\n" );
 
+    //
+    //  In B+ mode the records are all in the leaves, which are linked in
+    //  order, so there is no need to recurse.
+    //
+    if ( tree->bplus )
+    {
+        leaf = get_min_key_pos ( tree, tree->root ).node;
+        for ( ; leaf != NULL; leaf = leaf->next )
+        {
+            for ( i = 0; i < leaf->keysInUse; ++i )
+            {
+                traverseCB ( leaf->dataRecords[i] );
+            }
+        }
+        return;
+    }
     btree_traverse_node ( tree->root, traverseCB );
 }
 
@@ -1587,6 +2795,257 @@ extern void btree_traverse ( btree_t* tree, traverseFunc traverseCB )
 -----------------------------------------------------------------------------*/
 
 
+/*!----------------------------------------------------------------------------
+
+    b t r e e _ i t e r a t o r _ i n i t
+
+	@brief Initialize the fields of an iterator object.
+
+	This function will initialize the fields of the given iterator object to
+    an "end" position in the specified btree.
+
+	@param[out] iter - The iterator to be initialized.
+	@param[in] btree - The address of the btree object to be operated on.
+	@param[in] key - The address of the user's data object to be found in the
+                     tree.
+	@param[in] allocated - True if the iterator was allocated by the btree
+                           code and must be freed by btree_iter_cleanup.
+
+	@return None
+
+-----------------------------------------------------------------------------*/
+static void btree_iterator_init ( btree_iter iter, btree_t* btree, void* key,
+                                  bool allocated )
+{
+    iter->btree      = btree;
+    iter->key        = key;
+    iter->node       = 0;
+    iter->index      = -1;
+    iter->allocated  = allocated;
+    iter->depth      = 0;
+    iter->generation = btree->generation;
+    iter->hi         = NULL;
+}
+
+
+/*!----------------------------------------------------------------------------
+
+    b t r e e _ i t e r _ s e t
+
+	@brief Set the current position of an iterator.
+
+	This function will set the iterator to the given record of the given node
+    and make the path to that node, which is the first "depth" entries of the
+    path stack, current.  If the node is NULL, or if the iterator has an
+    upper bound and the record is beyond it, the iterator is set to the "end"
+    position.
+
+	@param[in,out] iter - The iterator to be updated.
+	@param[in] node - The node containing the current record or NULL.
+	@param[in] index - The index of the current record in the node.
+	@param[in] depth - The number of valid entries in the path stack.
+
+	@return None
+
+-----------------------------------------------------------------------------*/
+static inline void btree_iter_set ( btree_iter iter, bt_node_t* node,
+                                    unsigned int index, unsigned int depth )
+{
+    if ( node == NULL )
+    {
+        iter->node  = NULL;
+        iter->index = -1;
+        iter->key   = NULL;
+        iter->depth = 0;
+    }
+    else if ( iter->hi != NULL &&
+              compare_record ( iter->btree, iter->hi, iter->hiFingerprint,
+                               node, index ) < 0 )
+    {
+        iter->node  = NULL;
+        iter->index = -1;
+        iter->key   = NULL;
+        iter->depth = 0;
+    }
+    else
+    {
+        iter->node  = node;
+        iter->index = index;
+        iter->key   = node->dataRecords[index];
+        iter->depth = depth;
+    }
+    iter->generation = iter->btree->generation;
+}
+
+
+/*!----------------------------------------------------------------------------
+
+    b t r e e _ i t e r _ p u s h
+
+	@brief Push a node onto the path stack of an iterator.
+
+	This function records that the iterator has descended from the given node
+    into the child at the given index.
+
+	@param[in,out] iter - The iterator to be updated.
+	@param[in] depth - The current depth of the path stack.
+	@param[in] node - The node being descended from.
+	@param[in] index - The index of the child being descended into.
+
+	@return The new depth of the path stack
+
+-----------------------------------------------------------------------------*/
+static inline unsigned int btree_iter_push ( btree_iter iter,
+                                             unsigned int depth,
+                                             bt_node_t* node,
+                                             unsigned int index )
+{
+    iter->path[depth].node  = node;
+    iter->path[depth].index = index;
+
+    return depth + 1;
+}
+
+
+/*!----------------------------------------------------------------------------
+
+    b t r e e _ i t e r _ s e e k
+
+	@brief Descend the btree to position an iterator relative to a key.
+
+	This function will descend from the root of the btree to find either the
+    smallest record that is greater than (or equal to) the key or the largest
+    record that is less than (or equal to) the key, building the path stack
+    of the iterator as it goes.  If there is no such record, the iterator is
+    set to the "end" position.
+
+    In B+ mode the descent just goes to the leaf that the key belongs in and
+    no path is kept.  If that leaf holds no suitable record, the answer is
+    the first record of the next leaf (or the last record of the previous
+    one).
+
+	@param[in,out] iter - The iterator to be positioned.
+	@param[in] key - The key to be positioned relative to.
+	@param[in] forward - True to find the smallest record after the key, false
+                         to find the largest record at or before the key.
+	@param[in] inclusive - True if a record equal to the key satisfies the
+                           search.
+
+	@return None
+
+-----------------------------------------------------------------------------*/
+static void btree_iter_seek ( btree_iter iter, void* key, bool forward,
+                              bool inclusive )
+{
+    btree_t*     btree       = iter->btree;
+    bt_node_t*   node        = btree->root;
+    bt_node_t*   found       = NULL;
+    unsigned int foundIndex  = 0;
+    unsigned int foundDepth  = 0;
+    unsigned int depth       = 0;
+    uint64_t     fingerprint = key_fingerprint ( btree, key );
+    unsigned int i;
+    int          diff        = 1;
+
+    PRINT_DATA ( "  Looking up key:  ", key );
+
+    if ( btree->bplus && node->keysInUse > 0 )
+    {
+        while ( true )
+        {
+            if ( forward == inclusive )
+            {
+                i = node_lower_bound ( btree, node, key, fingerprint, &diff );
+            }
+            else
+            {
+                i = node_upper_bound ( btree, node, key, fingerprint );
+            }
+            if ( node->leaf )
+            {
+                break;
+            }
+            node = node->children[i];
+        }
+        if ( forward && i == node->keysInUse )
+        {
+            node = node->next;
+            i    = 0;
+        }
+        else if ( ! forward && i == 0 )
+        {
+            node = node->prev;
+            i    = node != NULL ? node->keysInUse - 1 : 0;
+        }
+        else if ( ! forward )
+        {
+            i--;
+        }
+        btree_iter_set ( iter, node, i, 0 );
+        return;
+    }
+    while ( node->keysInUse > 0 )
+    {
+        //
+        //  Binary search this node for the position of the key.  Note that
+        //  the diff value cannot be used as a numeric "goodness" indicator
+        //  because it is dependent on how the user has defined the
+        //  comparison operator for this btree.  The only thing that can be
+        //  tested is the sign of this value.
+        //
+        if ( forward == inclusive )
+        {
+            i = node_lower_bound ( btree, node, key, fingerprint, &diff );
+        }
+        else
+        {
+            i = node_upper_bound ( btree, node, key, fingerprint );
+        }
+        LOG ( "  Searching node at %d\n", i );
+
+        //
+        //  If there is a record in this node that satisfies the search, it is
+        //  the best candidate found so far so remember its position and the
+        //  depth of the path leading to it.  Anything closer to the key must
+        //  be in the child between this record and the key.
+        //
+        if ( forward && i < node->keysInUse )
+        {
+            found      = node;
+            foundIndex = i;
+            foundDepth = depth;
+        }
+        else if ( ! forward && i > 0 )
+        {
+            found      = node;
+            foundIndex = i - 1;
+            foundDepth = depth;
+        }
+        //
+        //  If we found an exact match to our key or we have reached a leaf
+        //  node then the search is finished.
+        //
+        if ( ( forward && inclusive && diff == 0 ) || node->leaf )
+        {
+            break;
+        }
+        depth = btree_iter_push ( iter, depth, node, i );
+        node  = node->children[i];
+    }
+    btree_iter_set ( iter, found, foundIndex, foundDepth );
+
+    if ( iter->node == 0 )
+    {
+        LOG ( "  Found iterator end()\n" );
+    }
+    else
+    {
+        LOG ( "  Found index %d:\n", iter->index );
+        PRINT_NODE ( btree, iter->node, printFunction );
+    }
+}
+
+
 /*!----------------------------------------------------------------------------
 
     b t r e e _ i t e r a t o r _ n e w
@@ -1613,17 +3072,17 @@ static btree_iter btree_iterator_new ( btree_t* btree, void* key )
     btree_iter iter = malloc ( sizeof(btree_iterator_t) );
 
     //
-    //  If the memory allocation succeeded...
+    //  If the memory allocation succeeded, initialize the fields of the
+    //  iterator.  If it failed, report the error.
     //
     if ( iter != NULL )
     {
-        //
-        //  Initialize the fields of the iterator.
-        //
-        iter->btree = btree;
-        iter->key   = key;
-        iter->node  = 0;
-        iter->index = 0;
+        btree_iterator_init ( iter, btree, key, true );
+    }
+    else
+    {
+        printf ( "ERROR: Unable to allocate new iterator: %d[%s]\n", errno,
+                 strerror ( errno ) );
     }
     //
     //  Return the iterator to the caller.
@@ -1632,6 +3091,43 @@ static btree_iter btree_iterator_new ( btree_t* btree, void* key )
 }
 
 
+/*!----------------------------------------------------------------------------
+
+	b t r e e _ f i n d _ i n i t
+
+	@brief Position a caller supplied iterator at the specified key location.
+
+    This function performs the same search as btree_find but uses the
+    iterator storage supplied by the caller (typically a local variable)
+    rather than allocating a new iterator.
+
+    If there is no key in the btree that is greater than or equal to the
+    specified value, the iterator will be positioned at the "end" of the
+    btree.
+
+    An iterator initialized by this function does not need to be passed to
+    btree_iter_cleanup, although it is harmless to do so.
+
+	@param[out] iter - The caller's iterator storage.
+	@param[in] btree - The address of the btree object to be operated on.
+	@param[in] key - The address of the user's data object to be found in the
+                     tree.
+
+	@return The iterator supplied by the caller
+
+-----------------------------------------------------------------------------*/
+btree_iter btree_find_init ( btree_iterator_t* iter, btree_t* btree,
+                             void* key )
+{
+    TRACE ( "In btree_find_init: btree[%p], key[%p]\n", btree, key );
+
+    btree_iterator_init ( iter, btree, key, false );
+    btree_iter_seek ( iter, key, true, true );
+
+    return iter;
+}
+
+
 /*!----------------------------------------------------------------------------
 
 	b t r e e _ f i n d
@@ -1665,197 +3161,192 @@ btree_iter btree_find ( btree_t* btree, void* key )
 {
     TRACE ( "In btree_find: btree[%p], key[%p]\n", btree, key );
 
-    bt_node_t* node  = 0;
-    int        diff  = 0;
-    int        i     = 0;
-    int        index = 0;
-
-    PRINT_DATA ( "  Looking up key:  ", key );
-
     //
     //  Go allocate and initialize a new iterator object.
     //
     btree_iter iter = btree_iterator_new ( btree, key );
 
-    //
-    //  If we were not able to allocate a new iterator, report the error and
-    //  return a NULL iterator to the caller.
-    //
     if ( iter == NULL )
     {
-        printf ( "ERROR: Unable to allocate new iterator: %d[%s]\n", errno,
-                 strerror ( errno ) );
         return iter;
     }
-    //
-    //  Start at the root of the tree...
-    //
-    node = btree->root;
+    btree_iter_seek ( iter, key, true, true );
 
     //
-    //  Repeat forever...
+    //  If nothing in the tree is greater than or equal to our target value
+    //  then we need to return an "end" condition to the caller by returning
+    //  a NULL iterator.
     //
-    while ( true )
+    if ( iter->node == 0 )
     {
-        //
-        //  Initialize our position in this node to the first record of the
-        //  node.  We will be searching the node from beginning to end.
-        //
-        i = 0;
+        free ( iter );
+        iter = NULL;
+    }
+    return iter;
+}
 
-        PRINT_DATA ( "  Current node is: ", node->dataRecords[i] );
 
-        //
-        //  Search the records in this node beginning from the beginning until
-        //  we find a record that is less than the target...
-        //
-        while ( i < node->keysInUse )
-        {
-            //
-            //  Save this node index for later processing.  Note that we do
-            //  this because the value of "i" may or may not have been
-            //  incremented past the end of the records array at the end of
-            //  this loop depending on whether the loop terminates or we take
-            //  an early out via the break condition.
-            //
-            index = i;
+/*!----------------------------------------------------------------------------
 
-            //
-            //  Go compare the target with the current data record and get the
-            //  difference.  Note that this diff value cannot be used as a
-            //  numeric "goodness" indicator because it is dependent on how
-            //  the user has defined the comparison operator for this btree.
-            //  The only thing that can be tested is the sign of this value.
-            //
-            diff = btree->compareCB ( key, node->dataRecords[i] );
+	b t r e e _ r f i n d _ i n i t
 
-            LOG ( "  Searching node at %d, diff: %d\n", i, diff );
+	@brief Position a caller supplied iterator at the specified key location.
 
-            //
-            //  If the record that we are looking at is less than or equal to
-            //  our target then quit looking in this node.
-            //
-            if ( diff <= 0 )
-            {
-                break;
-            }
-            //
-            //  Increment our index position and continue.
-            //
-            ++i;
-        }
-        //
-        //  If we found an exact match to our key, just stop and return the
-        //  iterator to the caller.
-        //
-        if ( diff == 0 )
-        {
-            LOG ( "  Diff == 0 - Returning node at i = %d\n", index );
+    This function performs the same search as btree_rfind but uses the
+    iterator storage supplied by the caller rather than allocating a new
+    iterator.
 
-            //
-            //  Save the node and index where the match occurred in the
-            //  iterator and terminate any further searching.
-            //
-            iter->node  = node;
-            iter->index = index;
+    If there is no key in the btree that is less than or equal to the
+    specified value, the iterator will be positioned at the "end" of the
+    btree.
 
-            break;
-        }
-        //
-        //  If the difference is positive, we are going to have to go down the
-        //  right subtree but we need to save the current position first.
-        //
-        else if ( diff > 0 )
-        {
-            //
-            //  If this is a leaf node then we are at the end of the tree so
-            //  just return the current iterator to the caller.
-            //
-            if ( node->leaf )
-            {
-                LOG ( "  Diff > 0 - Leaf - Returning node at i = %d\n", index );
+	@param[out] iter - The caller's iterator storage.
+	@param[in] btree - The address of the btree object to be operated on.
+	@param[in] key - The address of the user's data object to be found in the
+                     tree.
 
-                break;
-            }
-            //
-            //  If this is not a leaf node, we will need to continue our
-            //  search with the right child node of the current position.
-            //
-            //  If the comparison results in a diff value > 0 then the value
-            //  we want might be in the right child so get the right child and
-            //  continue our search.
-            //
-            else
-            {
-                LOG ( "  Diff > 0 - Not leaf - Moving to right child.\n" );
-                PRINT_NODE ( btree, node, printFunction );
+	@return The iterator supplied by the caller
 
-                node = getRightChild ( node, index );
-            }
-        }
-        //
-        //  Otherwise, if all the keys in this node are larger than our target
-        //  then the node that we want must be in the left subtree.
-        //
-        else   // if ( diff < 0 )
-        {
-            //
-            //  If this is a leaf node, then we are at the end of the tree so
-            //  save the current node position in the iterator and stop our
-            //  search.
-            //
-            if ( node->leaf )
-            {
-                LOG ( "  Diff < 0 - Leaf - Returning node at i = %d\n", index );
+-----------------------------------------------------------------------------*/
+btree_iter btree_rfind_init ( btree_iterator_t* iter, btree_t* btree,
+                              void* key )
+{
+    TRACE ( "In btree_rfind_init: btree[%p], key[%p]\n", btree, key );
 
-                iter->node  = node;
-                iter->index = index;
+    btree_iterator_init ( iter, btree, key, false );
+    btree_iter_seek ( iter, key, false, true );
 
-                break;
-            }
-            //
-            //  If this is not a leaf node, we will need to continue our
-            //  search with the left child node of the current position.
-            //
-            //  If the comparison results in a diff value < 0 then the value
-            //  we want might be in the left child so save the current
-            //  position (in case nothing in the left child is less than what
-            //  we found so far) get the left child and continue our search.
-            //
-            else
-            {
-                LOG ( "  Diff < 0 - Not leaf - Moving to left child.\n" );
+    return iter;
+}
 
-                iter->node  = node;
-                iter->index = index;
 
-                node = getLeftChild ( node, index );
-            }
-        }
+/*!----------------------------------------------------------------------------
+
+	b t r e e _ r f i n d
+
+	@brief Position an iterator at the specified key location.
+
+    The btree_rfind function is similar to the btree_search function except
+    that it will find the largest key that is less than or equal to the
+    specified value (rather than just the key that is equal to the specified
+    value).
+
+    This function is designed to be used for reverse iterations using the
+    iter->previous function to initialize the user's iterator to the beginning
+    of the reverse range of values the user wishes to find.
+
+    If there is no such key in the btree, a null iterator will be returned.
+
+	@param[in] btree - The address of the btree object to be operated on.
+	@param[in] key - The address of the user's data object to be found in the
+                     tree.
+
+	@return A btree_iter object
+
+-----------------------------------------------------------------------------*/
+btree_iter btree_rfind ( btree_t* btree, void* key )
+{
+    TRACE ( "In btree_rfind: btree[%p], key[%p]\n", btree, key );
+
+    btree_iter iter = btree_iterator_new ( btree, key );
+
+    if ( iter == NULL )
+    {
+        return iter;
     }
-    //
-    //  We have finished our search.  If nothing in the tree is less than or
-    //  equal to our target value then we need to return an "end" condition to
-    //  the caller by returning a NULL iterator.
-    //
+    btree_iter_seek ( iter, key, false, true );
+
     if ( iter->node == 0 )
     {
-        LOG ( "  Found iterator end()\n" );
-
-        //
-        //  Go free up the memory allocated to our iterator since we won't be
-        //  returning that value to the caller.
-        //
         free ( iter );
         iter = NULL;
     }
-    //
-    //  If we have a valid iterator...
-    //
-    else
+    return iter;
+}
+
+
+/*!----------------------------------------------------------------------------
+
+	b t r e e _ f i n d _ r a n g e _ i n i t
+
+	@brief Position a caller supplied iterator at the start of a key range.
+
+    This function positions the caller's iterator at the smallest record
+    that is greater than or equal to "lo", exactly like btree_find_init, and
+    also gives the iterator an upper bound.  Once the iterator moves past the
+    last record that is less than or equal to "hi", it is at the "end".  If
+    there are no records in the range, the iterator is positioned at the
+    "end" straight away.
+
+    Note that "lo" and "hi" do not need to be records in the btree, they only
+    need to be acceptable to the comparison function.
+
+	@param[out] iter - The caller's iterator storage.
+	@param[in] btree - The address of the btree object to be operated on.
+	@param[in] lo - The lower bound (inclusive) of the range.
+	@param[in] hi - The upper bound (inclusive) of the range.
+
+	@return The iterator supplied by the caller
+
+-----------------------------------------------------------------------------*/
+btree_iter btree_find_range_init ( btree_iterator_t* iter, btree_t* btree,
+                                   void* lo, void* hi )
+{
+    TRACE ( "In btree_find_range_init: btree[%p], lo[%p], hi[%p]\n", btree,
+            lo, hi );
+
+    btree_iterator_init ( iter, btree, lo, false );
+
+    iter->hi            = hi;
+    iter->hiFingerprint = key_fingerprint ( btree, hi );
+
+    btree_iter_seek ( iter, lo, true, true );
+
+    return iter;
+}
+
+
+/*!----------------------------------------------------------------------------
+
+	b t r e e _ f i n d _ r a n g e
+
+	@brief Position an iterator at the start of a key range.
+
+    The btree_find_range function is similar to the btree_find function
+    except that the iterator returned will reach the "end" once it moves past
+    the last record that is less than or equal to "hi".  See the description
+    of btree_find_range_init for the details.
+
+    If there are no records in the range, a null iterator will be returned.
+
+    The iterator returned must be disposed of when the user has finished
+    with it by calling the btree_iter_cleanup function.
+
+	@param[in] btree - The address of the btree object to be operated on.
+	@param[in] lo - The lower bound (inclusive) of the range.
+	@param[in] hi - The upper bound (inclusive) of the range.
+
+	@return A btree_iter object
+
+-----------------------------------------------------------------------------*/
+btree_iter btree_find_range ( btree_t* btree, void* lo, void* hi )
+{
+    TRACE ( "In btree_find_range: btree[%p], lo[%p], hi[%p]\n", btree, lo,
+            hi );
+
+    btree_iter iter = btree_iterator_new ( btree, lo );
+
+    if ( iter == NULL )
     {
-        LOG ( "  Found index %d:\n", iter->index );
-        PRINT_NODE ( btree, iter->node, printFunction );
+        return iter;
+    }
+    btree_find_range_init ( iter, btree, lo, hi );
+    iter->allocated = true;
+
+    if ( iter->node == 0 )
+    {
+        free ( iter );
+        iter = NULL;
     }
     return iter;
 }
@@ -1863,30 +3354,56 @@ btree_iter btree_find ( btree_t* btree, void* key )
 
 /*!----------------------------------------------------------------------------
 
-	b t r e e _ r f i n d
+    b t r e e _ i t e r _ b e g i n _ i n i t
 
-	@brief Position an iterator at the specified key location.
+	@brief Position a caller supplied iterator at the beginning of the btree.
 
-    The btree_rfind function is similar to the btree_search function except
-    that it will find the largest key that is less than or equal to the
-    specified value (rather than just the key that is equal to the specified
-    value).
+	This function will find the smallest record currently defined in the
+    specified btree and position the caller's iterator at that record.  If
+    the btree is empty, the iterator will be positioned at the "end" of the
+    btree.
 
-    This function is designed to be used for reverse iterations using the
-    iter->previous function to initialize the user's iterator to the beginning
-    of the reverse range of values the user wishes to find.
+    An iterator initialized by this function does not need to be passed to
+    btree_iter_cleanup, although it is harmless to do so.
 
+	@param[out] iter - The caller's iterator storage.
 	@param[in] btree - The address of the btree object to be operated on.
-	@param[in] key - The address of the user's data object to be found in the
-                     tree.
 
-	@return A btree_iter object
+	@return The iterator supplied by the caller
 
 -----------------------------------------------------------------------------*/
-btree_iter btree_rfind ( btree_t* btree, void* key )
+btree_iter btree_iter_begin_init ( btree_iterator_t* iter, btree_t* btree )
 {
-    printf ( "Warning: btree_rfind was called but is not yet implemented!\n" );
-    return NULL;
+    bt_node_t*   node  = btree->root;
+    unsigned int depth = 0;
+
+    TRACE ( "In btree_iter_begin_init\n" );
+
+    btree_iterator_init ( iter, btree, 0, false );
+
+    //
+    //  If the btree is empty, leave the iterator at the "end" position.
+    //
+    if ( node->keysInUse == 0 )
+    {
+        return iter;
+    }
+    //
+    //  Follow the leftmost children down to the leaf that holds the minimum
+    //  key currently defined in the btree, recording the path as we go.
+    //
+    while ( ! node->leaf )
+    {
+        depth = btree_iter_push ( iter, depth, node, 0 );
+        node  = node->children[0];
+    }
+    btree_iter_set ( iter, node, 0, depth );
+
+    LOG ( "  Found minimum record at index %d in node %p\n", 0, node );
+
+    PRINT_NODE ( btree, node, printFunction );
+
+    return iter;
 }
 
 
@@ -1911,8 +3428,7 @@ btree_iter btree_rfind ( btree_t* btree, void* key )
 -----------------------------------------------------------------------------*/
 btree_iter btree_iter_begin ( btree_t* btree )
 {
-    btree_iter   iter;
-    nodePosition nodePosition;
+    btree_iter iter;
 
     TRACE ( "In btree_iter_begin\n" );
 
@@ -1921,36 +3437,36 @@ btree_iter btree_iter_begin ( btree_t* btree )
     //
     iter = btree_iterator_new ( btree, 0 );
 
-    //
-    //  If we were not able to allocate a new iterator, report the error and
-    //  return a NULL iterator to the caller.
-    //
-    if ( iter == NULL )
+    if ( iter != NULL )
     {
-        printf ( "ERROR: Unable to allocate new iterator: %d[%s]\n", errno,
-                 strerror ( errno ) );
-        return iter;
+        btree_iter_begin_init ( iter, btree );
+        iter->allocated = true;
     }
-    //
-    //  Go get the minimum key currently defined in the btree.
-    //
-    nodePosition = get_min_key_pos ( btree, btree->root );
+    return iter;
+}
 
-    //
-    //  Save the tree position in the new iterator.
-    //
-    iter->index = nodePosition.index;
-    iter->node  = nodePosition.node;
-    iter->key   = nodePosition.node->dataRecords[nodePosition.index];
 
-    LOG ( "  Found minimum record at index %d in node %p\n",
-          nodePosition.index, nodePosition.node );
+/*!----------------------------------------------------------------------------
+
+    b t r e e _ i t e r _ e n d _ i n i t
 
-    PRINT_NODE ( btree, nodePosition.node, printFunction );
+	@brief Position a caller supplied iterator past the last record.
+
+	This function will set the caller's iterator to indicate that it is an
+    "end" iterator.
+
+	@param[out] iter - The caller's iterator storage.
+	@param[in] btree - The address of the btree object to be operated on.
+
+	@return The iterator supplied by the caller
+
+-----------------------------------------------------------------------------*/
+btree_iter btree_iter_end_init ( btree_iterator_t* iter, btree_t* btree )
+{
+    TRACE ( "In btree_iter_end_init\n" );
+
+    btree_iterator_init ( iter, btree, 0, false );
 
-    //
-    //  Return the iterator to the caller.
-    //
     return iter;
 }
 
@@ -1974,35 +3490,13 @@ btree_iter btree_iter_begin ( btree_t* btree )
 -----------------------------------------------------------------------------*/
 btree_iter btree_iter_end ( btree_t* btree )
 {
-    btree_iter   iter;
-
     TRACE ( "In btree_iter_end\n" );
 
     //
-    //  Go allocate and initialize a new iterator object.
-    //
-    iter = btree_iterator_new ( btree, 0 );
-
-    //
-    //  If we were not able to allocate a new iterator, report the error and
-    //  return a NULL iterator to the caller.
-    //
-    if ( iter == NULL )
-    {
-        printf ( "ERROR: Unable to allocate new iterator: %d[%s]\n", errno,
-                 strerror ( errno ) );
-        return iter;
-    }
-    //
-    //  Initialize the iterator to indicate the "end" position.
-    //
-    iter->index = -1;
-    iter->node  = NULL;
-
-    //
-    //  Return the iterator to the caller.
+    //  Go allocate a new iterator object.  It is initialized to indicate the
+    //  "end" position.
     //
-    return iter;
+    return btree_iterator_new ( btree, 0 );
 }
 
 
@@ -2015,13 +3509,21 @@ btree_iter btree_iter_end ( btree_t* btree )
     This function will position the specified iterator to the next higher key
     value in the btree from the current position.
 
-    This function will use the position defined in the supplied iterator as
-    the starting point in the btree and proceed to move to the "next" higher
-    record in the btree.  Note that "next" is defined by the user's supplied
-    comparison operator for this btree.
+    The iterator keeps the path of (node, child index) pairs from the root of
+    the btree down to its current node, so moving to the "next" record is
+    just a matter of following child pointers down from an interior record
+    or popping back up the path from the end of a leaf.  No records are
+    compared.  This costs O(1) amortized per call over a full scan.
+
+    In B+ mode the path is not needed at all since the leaves are linked:
+    the "next" record is either the next one in the same leaf or the first
+    one in the next leaf.
 
-    TODO: This function needs to be cleaned up.  It was patched several times
-    to make it work and left in a bit of a mess.
+    If the btree has been modified since the iterator was positioned, the
+    saved path may no longer be valid.  In that case the "next" record is
+    found by descending from the root of the btree looking for the smallest
+    record that is larger than the current one, so this still works if the
+    record that the iterator was positioned on has since been deleted.
 
 	@param[in,out] iter - The iterator to be updated
 
@@ -2032,255 +3534,80 @@ void btree_iter_next ( btree_iter iter )
 {
     TRACE ( "In btree_iter_next: node[%p], index[%d]\n", iter->node, iter->index );
 
-    //
-    //  Set the internal variables so that we will start searching where the
-    //  current iterator points.
-    //
-    btree_t*     btree = iter->btree;
     bt_node_t*   node  = iter->node;
-    void*        key   = iter->key;
-    void*        dataValue;
-    int          diff  = 0;
-    int          i     = iter->index;
-    int          index = 0;
-    nodePosition nodePos;
+    unsigned int index = iter->index;
+    unsigned int depth = iter->depth;
 
     //
-    //  Print out the target key that we are starting at.
+    //  If the iterator is already at the end, there is nowhere to go.
     //
-    PRINT_DATA ( "  Looking up key:  ", key );
-
+    if ( node == NULL )
+    {
+        return;
+    }
     //
-    //  Repeat forever...
+    //  If the btree has changed under us, search for the next record.
     //
-    while ( true )
+    if ( iter->generation != iter->btree->generation )
     {
-        //
-        //  If this is a leaf node...
-        //
-        if ( node->leaf )
-        {
-            //
-            //  Loop through the records in this node until reach the end of
-            //  the node...
-            //
-            i = 0;
-            PRINT_DATA ( "  Current leaf node is: ", node->dataRecords[i] );
-            while ( i < node->keysInUse )
-            {
-                //
-                //  Compare the current record with our target.
-                //
-                index = i;
-                diff = btree->compareCB ( key, node->dataRecords[i] );
-                LOG ( "  Searching node at %d, diff: %d\n", i, diff );
-
-                //
-                //  If the current record is larger than the target we have
-                //  found the "next" record in the btree so return it to the
-                //  caller.
-                //
-                if ( diff < 0 )
-                {
-                    LOG ( "  Target record found.\n" );
-                    iter->index = i;
-                    iter->node  = node;
-                    iter->key   = node->dataRecords[i];
-                    return;
-                }
-                ++i;
-            }
-            //
-            //  If none of the records in this node are larger than the
-            //  target, go up one level in the btree to the parent node and
-            //  try again.
-            //
-            //  If we are not at the root node...
-            //
-            if ( node->parent != NULL )
-            {
-                LOG ( "  Moving up to parent.\n" );
-                i    = 0;
-                node = node->parent;
-            }
-            //
-            //  If we are at the root node then the target is larger than the
-            //  largest record in the btree so return an "end" condition to
-            //  the caller.
-            //
-            else
-            {
-                LOG ( "  End of tree found.\n" );
-                iter->index = -1;
-                iter->node  = NULL;
-                iter->key   = NULL;
-                return;
-            }
-            //
-            //  Go back up and start looking at the records in the node...
-            //
-            continue;
-        }
-        //
-        //  If the current node is an interior node (i.e. not a leaf node)...
-        //
-        i = 0;
-        PRINT_DATA ( "  Current interior node is: ", node->dataRecords[i] );
-
-        //
-        //  Examine all of the records until we reach the end of the records
-        //  in this node.
-        //
-        while ( i < node->keysInUse )
-        {
-            //
-            //  Compare the current record with the target record.
-            //
-            index = i;
-            diff = btree->compareCB ( key, node->dataRecords[i] );
-            LOG ( "  Searching node at %d, diff: %d\n", i, diff );
-
-            //
-            //  If the current record is larger than the target...
-            //
-            if ( diff < 0 )
-            {
-                //
-                //  Go find the smallest record in the left subtree of this
-                //  record.
-                //
-                LOG ( "  Searching for minimum subtree key in left child.\n" );
-                nodePos = get_min_key_pos ( btree, node->children[i] );
+        btree_iter_seek ( iter, iter->key, true, false );
+        return;
+    }
+    //
+    //  If this is an interior node, the "next" record is the smallest record
+    //  in the subtree to the right of the current record.
+    //
+    if ( ! node->leaf )
+    {
+        depth = btree_iter_push ( iter, depth, node, index + 1 );
+        node  = node->children[index + 1];
 
-                //
-                //  If this minimum value is larger than the target then that's
-                //  the "next" record.
-                //
-                dataValue = getDataRecord ( nodePos.node, nodePos.index );
-                diff = btree->compareCB ( key, dataValue );
-                if ( diff < 0 )
-                {
-                    //
-                    //  Return this record to the caller.
-                    //
-                    PRINT_DATA ( "    Found: ", nodePos.node );
-                    iter->index = nodePos.index;
-                    iter->node  = nodePos.node;
-                    iter->key   = dataValue;
-                    return;
-                }
-                //
-                //  If the left subtree doesn't have the record we want then
-                //  it must be the current record so return that to the
-                //  caller.
-                //
-                else
-                {
-                    LOG ( "  Target record found.\n" );
-                    iter->index = i;
-                    iter->node  = node;
-                    iter->key   = node->dataRecords[i];
-                    return;
-                }
-            }
-            ++i;
-        }
-        //
-        //  If we have just exhausted the list of records in the current
-        //  node...
-        //
-        if ( i == node->keysInUse )
+        while ( ! node->leaf )
         {
-            //
-            //  We need to decide if we need to go up or down the btree from
-            //  here so find the largest record in the right subtree.
-            //
-            nodePos = get_max_key_pos ( btree, node->children[i] );
-            dataValue = getDataRecord ( nodePos.node, nodePos.index );
-            diff = btree->compareCB ( key, dataValue );
-
-            //
-            //  If there are no records in the right subtree that are larger
-            //  than the target then we need to move up in the btree to the
-            //  parent to continue our search.
-            //
-            if ( diff >= 0 )
-            {
-                //
-                //  If this is not the root node then move up in the btree.
-                //
-                if ( node->parent != NULL )
-                {
-                    LOG ( "  Moving up to parent.\n" );
-                    i    = 0;
-                    node = node->parent;
-                }
-                //
-                //  If this is the root node then the target record is larger
-                //  than everything in the btree so return an "end" condition
-                //  to the caller.
-                //
-                else
-                {
-                    LOG ( "  End of tree found.\n" );
-                    iter->index = -1;
-                    iter->node  = NULL;
-                    iter->key   = NULL;
-                    return;
-                }
-            }
-            //
-            //  There are some records in the right subtree greater than the
-            //  target so go find the smallest of those records.
-            //
-            else
-            {
-                LOG ( "  Searching for minimum subtree key.\n" );
-                nodePos = get_min_key_pos ( btree, node->children[i] );
-
-                //
-                //  If the smallest record in this subtree is larger than our
-                //  target key then we have found the "next" record and we
-                //  will return that to the caller.
-                //
-                dataValue = getDataRecord ( nodePos.node, nodePos.index );
-                diff = btree->compareCB ( key, dataValue );
-                if ( diff < 0 )
-                {
-                    PRINT_DATA ( "    Found: ", nodePos.node );
-                    iter->index = nodePos.index;
-                    iter->node  = nodePos.node;
-                    iter->key   = dataValue;
-                    return;
-                }
-                //
-                //  If everything in the right subtree is smaller than our
-                //  target, decend into the right tree and continue our search
-                //  from there.
-                //
-                else
-                {
-                    LOG ( "  Moving down to the right child.\n" );
-                    node = getRightChild ( node, index );
-                    i    = 0;
-                }
-            }
+            depth = btree_iter_push ( iter, depth, node, 0 );
+            node  = node->children[0];
         }
-        continue;
+        btree_iter_set ( iter, node, 0, depth );
+        return;
     }
     //
-    //  If we have found the "next" record, print that out in debug mode.
+    //  If there are more records in this leaf, just move over one.
     //
-    if ( iter->node != 0 )
+    if ( index + 1 < node->keysInUse )
     {
-        LOG ( "  Found index %d:\n", iter->index );
-        PRINT_NODE ( btree, iter->node, printFunction );
+        btree_iter_set ( iter, node, index + 1, depth );
+        return;
     }
     //
-    //  Return to the caller now that we have updated the iterator to point
-    //  to the "next" record in the btree.
+    //  In B+ mode the next record is the first one in the next leaf.
     //
-    return;
+    if ( iter->btree->bplus )
+    {
+        btree_iter_set ( iter, node->next, 0, 0 );
+        return;
+    }
+    //
+    //  Otherwise go back up the path until we come up out of a child that
+    //  has a record to its right.  That record is the "next" one.
+    //
+    while ( depth > 0 )
+    {
+        depth--;
+        node  = iter->path[depth].node;
+        index = iter->path[depth].index;
+
+        if ( index < node->keysInUse )
+        {
+            btree_iter_set ( iter, node, index, depth );
+            return;
+        }
+    }
+    //
+    //  We came out of the rightmost child of the root so we have reached the
+    //  end of the btree.
+    //
+    LOG ( "  End of tree found.\n" );
+    btree_iter_set ( iter, NULL, 0, 0 );
 }
 
 
@@ -2291,7 +3618,11 @@ void btree_iter_next ( btree_iter iter )
 	@brief Position the iterator at the previous key in the btree.
 
     This function will position the specified iterator to the next lower key
-    value in the btree from the current position.
+    value in the btree from the current position.  It is the mirror image of
+    btree_iter_next.  Moving to the previous record from the "end" position
+    positions the iterator at the last record of the btree, and moving to
+    the previous record from the first record of the btree positions the
+    iterator at the "end".
 
 	@param[in,out] iter - The iterator to be updated
 
@@ -2300,9 +3631,94 @@ void btree_iter_next ( btree_iter iter )
 -----------------------------------------------------------------------------*/
 void btree_iter_previous ( btree_iter iter )
 {
-    printf ( "Warning: btree_iter_previous was called but is not yet "
-             "implemented!\n" );
-    return;
+    TRACE ( "In btree_iter_previous: node[%p], index[%d]\n", iter->node,
+            iter->index );
+
+    bt_node_t*   node  = iter->node;
+    unsigned int index = iter->index;
+    unsigned int depth = iter->depth;
+
+    //
+    //  If the iterator is at the end, move to the last record of the btree.
+    //
+    if ( node == NULL )
+    {
+        node  = iter->btree->root;
+        depth = 0;
+
+        if ( node->keysInUse == 0 )
+        {
+            return;
+        }
+        while ( ! node->leaf )
+        {
+            depth = btree_iter_push ( iter, depth, node, node->keysInUse );
+            node  = node->children[node->keysInUse];
+        }
+        btree_iter_set ( iter, node, node->keysInUse - 1, depth );
+        return;
+    }
+    //
+    //  If the btree has changed under us, search for the previous record.
+    //
+    if ( iter->generation != iter->btree->generation )
+    {
+        btree_iter_seek ( iter, iter->key, false, false );
+        return;
+    }
+    //
+    //  If this is an interior node, the "previous" record is the largest
+    //  record in the subtree to the left of the current record.
+    //
+    if ( ! node->leaf )
+    {
+        depth = btree_iter_push ( iter, depth, node, index );
+        node  = node->children[index];
+
+        while ( ! node->leaf )
+        {
+            depth = btree_iter_push ( iter, depth, node, node->keysInUse );
+            node  = node->children[node->keysInUse];
+        }
+        btree_iter_set ( iter, node, node->keysInUse - 1, depth );
+        return;
+    }
+    //
+    //  If there are more records in this leaf, just move back one.
+    //
+    if ( index > 0 )
+    {
+        btree_iter_set ( iter, node, index - 1, depth );
+        return;
+    }
+    //
+    //  In B+ mode the previous record is the last one in the previous leaf.
+    //
+    if ( iter->btree->bplus )
+    {
+        node = node->prev;
+        btree_iter_set ( iter, node, node != NULL ? node->keysInUse - 1 : 0,
+                         0 );
+        return;
+    }
+    //
+    //  Otherwise go back up the path until we come up out of a child that
+    //  has a record to its left.  That record is the "previous" one.
+    //
+    while ( depth > 0 )
+    {
+        depth--;
+        node  = iter->path[depth].node;
+        index = iter->path[depth].index;
+
+        if ( index > 0 )
+        {
+            btree_iter_set ( iter, node, index - 1, depth );
+            return;
+        }
+    }
+    LOG ( "  Beginning of tree found.\n" );
+    btree_iter_set ( iter, NULL, 0, 0 );
 }
 
 
@@ -2325,8 +3741,7 @@ void btree_iter_previous ( btree_iter iter )
 -----------------------------------------------------------------------------*/
 int btree_iter_cmp ( btree_iter iter1, btree_iter iter2 )
 {
-    return iter1->btree->compareCB ( iter1->node->dataRecords[iter1->index],
-                                     iter2->node->dataRecords[iter2->index] );
+    return iter1->btree->compareCB ( iter1->key, iter2->key );
 }
 
 
@@ -2382,9 +3797,11 @@ void* btree_iter_data ( btree_iter iter )
         return NULL;
     }
     //
-    //  Return the user data pointer to the caller.
+    //  Return the user data pointer to the caller.  Note that the pointer is
+    //  saved in the iterator when it is positioned so that it is still
+    //  correct if the btree has since been modified.
     //
-    return iter->node->dataRecords[iter->index];
+    return iter->key;
 }
 
 
@@ -2396,11 +3813,14 @@ void* btree_iter_data ( btree_iter iter )
 
     This function will clean up the specified iterator and release any
     resources being used by this iterator.  This function MUST be called when
-    the user is finished using an iterator or resources (such as memory
-    blocks) will be leaked to the system.  Once this function has been called
-    with an iterator, that iterator may not be used again for any of the btree
-    functions unless it has subsequently been reinitialized using one of the
-    iterator initialization functions defined here.
+    the user is finished using an iterator returned by one of the allocating
+    functions or resources (such as memory blocks) will be leaked to the
+    system.  Iterators initialized in caller supplied storage by one of the
+    "_init" functions hold no resources and are only reset by this call.  Once
+    this function has been called with an iterator, that iterator may not be
+    used again for any of the btree functions unless it has subsequently been
+    reinitialized using one of the iterator initialization functions defined
+    here.
 
 	@param[in] iter - The current btree iterator.
 
@@ -2424,9 +3844,14 @@ void btree_iter_cleanup ( btree_iter iter )
         iter->index = 0;
 
         //
-        //  Go return this iterator data structure to the system memory pool.
+        //  If the iterator was allocated by one of the btree functions, go
+        //  return this iterator data structure to the system memory pool.
+        //  Iterators supplied by the caller are left alone.
         //
-        free ( iter );
+        if ( iter->allocated )
+        {
+            free ( iter );
+        }
     }
     //
     //  Return to the caller.
@@ -2479,6 +3904,7 @@ static void print_single_node ( btree_t* btree, bt_node_t* node,
 
     printf ( "\n  Node[%p:%ld]\n",        NODE ( node ) );
     printf ( "    next.......: %p:%ld\n", NODE ( node->next ) );
+    printf ( "    prev.......: %p:%ld\n", NODE ( node->prev ) );
     printf ( "    parent.....: %p:%ld\n", NODE ( node->parent ) );
     printf ( "    leaf.......: %d\n",     node->leaf );
     printf ( "    keysInUse..: %d\n",     node->keysInUse );
@@ -2500,6 +3926,27 @@ static void print_single_node ( btree_t* btree, bt_node_t* node,
     }
     fflush ( stdout );
 }
+
+//
+//  Print a node followed by all of the nodes below it.  The nodes are
+//  printed depth first since their "next" pointers link the leaves of a
+//  btree in B+ mode and cannot be borrowed to queue up the nodes.
+//
+static void print_subtree_nodes ( btree_t* btree, bt_node_t* node,
+                                  printFunc printCB )
+{
+    int i;
+
+    print_single_node ( btree, node, printCB );
+
+    if ( ! node->leaf )
+    {
+        for ( i = 0; i < node->keysInUse + 1; i++ )
+        {
+            print_subtree_nodes ( btree, node->children[i], printCB );
+        }
+    }
+}
 #endif      // ifdef BTREE_DEBUG
 
 /**
@@ -2512,17 +3959,6 @@ static void print_single_node ( btree_t* btree, bt_node_t* node,
 void print_subtree ( btree_t* btree, bt_node_t* node, printFunc printCB )
 {
 #ifdef BTREE_DEBUG
-    int i = 0;
-    unsigned int current_level;
-
-    bt_node_t* head;
-    bt_node_t* tail;
-    bt_node_t* child;
-
-    current_level = node->level;
-    head = node;
-    tail = node;
-
     printf ( "Btree [%p]\n", btree );
     printf ( "  order.........: %u\n", btree->order );
     printf ( "  fullSize......: %u\n", btree->nodeFullSize );
@@ -2535,26 +3971,8 @@ void print_subtree ( btree_t* btree, bt_node_t* node, printFunc printCB )
     //
     //  Traverse the nodes of the btree displaying them as we go.
     //
-    while ( head != NULL )
-    {
-        if ( head->level < current_level )
-        {
-            current_level = head->level;
-        }
-        print_single_node ( btree, head, printCB );
+    print_subtree_nodes ( btree, node, printCB );
 
-        if ( ! head->leaf )
-        {
-            for ( i = 0; i < head->keysInUse + 1; i++ )
-            {
-                child = head->children[i];
-                tail->next = child;
-                tail = child;
-                child->next = NULL;
-            }
-        }
-        head = head->next;
-    }
     printf ( "\n" );
 #endif      // ifdef BTREE_DEBUG
 }
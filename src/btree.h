@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <strings.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 
@@ -56,6 +57,37 @@
 #define COPY      memmove
 #define PRINT     printf
 
+//
+//  The following define the layout of the node pool.  Nodes are carved out of
+//  slabs of approximately BTREE_SLAB_SIZE bytes and each node is aligned to a
+//  BTREE_NODE_ALIGN byte boundary within its slab.
+//
+#define BTREE_SLAB_SIZE  ( 16384 )
+#define BTREE_SLAB_MIN   ( 4 )
+#define BTREE_NODE_ALIGN ( 16 )
+
+//
+//  The number of cache lines occupied by a node of a btree that was created
+//  with the BTREE_NODE_CACHE_LINE sizing mode.  The cache line size itself is
+//  obtained from the system when the btree is created.
+//
+#define BTREE_CACHE_LINES_PER_NODE ( 4 )
+
+//
+//  The maximum depth of a btree.  Every node other than the root has at least
+//  2 children, so this is enough for any btree whose record count fits into
+//  an unsigned int.  Iterators keep a path stack of this many entries.
+//
+#define BTREE_MAX_DEPTH ( 32 )
+
+//
+//  btree_merge_sorted and btree_delete_range rebuild the btree from scratch
+//  when the number of records added or removed is at least 1 /
+//  BTREE_MERGE_RATIO of the number of records in the btree.  Smaller batches
+//  are inserted or deleted one record at a time.
+//
+#define BTREE_MERGE_RATIO ( 8 )
+
 //
 //  Define the callback function types used by the btree code.
 //
@@ -63,19 +95,65 @@ typedef int  (*compareFunc) ( void*, void* );
 
 typedef void (*traverseFunc)( void* );
 
+typedef void (*visitFunc)   ( void*, void* );
+
 typedef void (*printFunc)   ( char*, void* );
 
+typedef void* (*allocFunc)  ( void*, size_t );
+
+typedef void (*freeFunc)    ( void*, void* );
+
+typedef uint64_t (*fingerprintFunc) ( void* );
+
+
+//
+//  Define the memory allocator used by a btree to obtain the storage for its
+//  nodes.  The "context" pointer is passed unchanged as the first argument of
+//  both callbacks so that the user can allocate from his own arena.  If no
+//  allocator is supplied to btree_create, MEM_ALLOC and MEM_FREE are used.
+//
+typedef struct btree_allocator_t
+{
+    allocFunc alloc;              // Allocate a block of the given size
+    freeFunc  free;               // Release a block obtained from "alloc"
+    void*     context;            // User data passed to both callbacks
+
+}   btree_allocator_t;
+
 
 //
-//  Define the structure of a single btree node.
+//  Define the ways in which the capacity of the nodes of a btree can be
+//  chosen.  A btree created with btree_create uses the order supplied by the
+//  caller (BTREE_NODE_FIXED).  A btree created with btree_create_sized will
+//  derive its order from the system cache line size or memory page size so
+//  that each node fills the given amount of memory.
+//
+typedef enum
+{
+    BTREE_NODE_FIXED = 0,         // Use the order supplied by the caller
+    BTREE_NODE_CACHE_LINE,        // Size nodes to BTREE_CACHE_LINES_PER_NODE lines
+    BTREE_NODE_PAGE               // Size nodes to one memory page
+
+}   btree_node_mode_t;
+
+
+//
+//  Define the structure of a single btree node.  Each node is allocated as a
+//  single contiguous block with the record and child pointer arrays stored
+//  inline immediately following this header.  The "dataRecords" and
+//  "children" fields point into that same block.  If the btree has a
+//  fingerprint function, an array holding the fingerprint of each record is
+//  stored inline ahead of the record pointers as well.
 //
 typedef struct bt_node_t
 {
-    struct bt_node_t*  next;        // Pointer used for linked list traversal
+    struct bt_node_t*  next;        // Next leaf in B+ mode, else free list link
+    struct bt_node_t*  prev;        // Previous leaf in B+ mode
     struct bt_node_t*  parent;      // Pointer to the parent of this node
     bool               leaf;        // Used to indicate whether leaf or not
     unsigned int       keysInUse;   // Number of keys currently defined
     unsigned int       level;       // Level of this node in the btree
+    uint64_t*          fingerprints;// Array of record fingerprints or NULL
     void**             dataRecords; // Array of data record pointers
     struct bt_node_t** children;    // Array of link pointers to children nodes
 
@@ -96,8 +174,19 @@ typedef struct btree_t
     unsigned int sizeofKeys;      // The total size of the keys in one node
     unsigned int sizeofPointers;  // The total size of the pointers in one node
     unsigned int count;           // The total number of records in the btree
+    unsigned int generation;      // Incremented on every insert and delete
     bt_node_t*   root;            // Root of the btree
     compareFunc  compareCB;       // Key compare function
+    fingerprintFunc fingerprintCB;// Key fingerprint function or NULL
+    unsigned int sizeofFingerprints; // The total size of the fingerprints in one node
+    btree_node_mode_t nodeMode;   // How the order of this btree was chosen
+    bool         bplus;           // All records are kept in linked leaves
+
+    size_t       nodeSize;        // Size of one node including inline arrays
+    unsigned int nodesPerSlab;    // The number of nodes carved from each slab
+    bt_node_t*   freeList;        // Nodes available for reuse
+    void*        slabs;           // List of slabs allocated to this btree
+    btree_allocator_t allocator;  // Source of the memory for the slabs
 
 }   btree_t;
 
@@ -107,12 +196,35 @@ typedef struct btree_t
 //  keep track of positions within the btree and is used by the iterator set
 //  of functions to enable the "get_next" and "get_previous" functions.
 //
+//  An iterator may either be allocated by the btree code (btree_find,
+//  btree_iter_begin, etc.) or live in storage owned by the caller and be
+//  initialized with one of the "_init" functions.  The "allocated" flag
+//  tells btree_iter_cleanup which of these it is dealing with.
+//
+//  The iterator keeps the path from the root of the btree to the current
+//  node as a stack of (node, child index) pairs so that it can move to the
+//  next or previous record without comparing any keys.  The path is only
+//  trusted while the "generation" of the btree is unchanged.
+//
+typedef struct btree_path_t
+{
+    bt_node_t*   node;            // An ancestor of the current node
+    unsigned int index;           // The child of that node that was taken
+
+}   btree_path_t;
+
 typedef struct btree_iterator_t
 {
     btree_t*     btree;
     void*        key;
     bt_node_t*   node;
     unsigned int index;
+    bool         allocated;
+    unsigned int generation;      // The btree generation the path is valid for
+    unsigned int depth;           // The number of entries in the path
+    void*        hi;              // Upper bound of a range iterator or NULL
+    uint64_t     hiFingerprint;   // The fingerprint of the upper bound
+    btree_path_t path[BTREE_MAX_DEPTH];
 
 }   btree_iterator_t;
 
@@ -122,14 +234,82 @@ typedef btree_iterator_t* btree_iter;
 //
 //  Define the public API to the btree library.
 //
-extern btree_t* btree_create   ( unsigned int order, compareFunc compareFunction );
+extern btree_t* btree_create   ( unsigned int order, compareFunc compareFunction,
+                                 btree_allocator_t* allocator );
+
+extern btree_t* btree_create_sized ( btree_node_mode_t mode,
+                                     compareFunc compareFunction,
+                                     btree_allocator_t* allocator );
+
+//
+//  Set the function used to compute the fingerprint of a record.  The
+//  fingerprint is a fixed width summary of the key of a record that is stored
+//  in the btree nodes next to the record pointer.  Records are compared by
+//  their fingerprints first and the compare function is only called when the
+//  fingerprints are equal, so most of the comparisons made while searching a
+//  node never have to touch the records themselves.
+//
+//  The fingerprint must preserve the ordering of the compare function, that
+//  is, if compare ( a, b ) < 0 then fingerprint ( a ) <= fingerprint ( b ),
+//  and if compare ( a, b ) == 0 then fingerprint ( a ) == fingerprint ( b ).
+//  A fixed width prefix of the key, interpreted as a big-endian unsigned
+//  number, satisfies this.
+//
+//  The fingerprint function can only be set while the btree is empty.
+//  Passing NULL turns fingerprints off again.
+//
+extern int      btree_set_fingerprint ( btree_t* btree,
+                                        fingerprintFunc fingerprintFunction );
+
+//
+//  Put a btree into (or take it out of) B+ mode.  In B+ mode every record is
+//  stored in a leaf and the interior nodes only hold copies of the record
+//  pointers to separate their children.  The leaves are linked to each other
+//  in both directions so that the iterators move through the btree by just
+//  walking along the leaf arrays.  Point lookups work exactly as before.
+//
+//  The keys of the records in a btree in B+ mode must be unique.  The
+//  "subtree" argument of btree_delete is ignored in B+ mode since a record
+//  is always deleted starting from the root.
+//
+//  The mode can only be changed while the btree is empty.
+//
+extern int      btree_set_bplus ( btree_t* btree, bool bplus );
 
 extern void     btree_destroy  ( btree_t* btree );
 
+//
+//  Destroy a btree and call the visitor once for every record that was in it,
+//  typically to free the records.  The records are visited in a single pass
+//  over the nodes and not in key order.
+//
+extern void     btree_destroy_with ( btree_t* btree, visitFunc visitor,
+                                     void* context );
+
 extern int      btree_insert   ( btree_t* btree, void* data );
 
 extern int      btree_delete   ( btree_t* btree, bt_node_t* subtree, void* key );
 
+//
+//  Load an empty btree, or merge into an existing one, an array of records
+//  that is already sorted according to the compare function of the btree.
+//  The nodes are built bottom-up and densely packed.
+//
+extern int      btree_bulk_load ( btree_t* btree, void** records,
+                                  unsigned int count );
+
+extern int      btree_merge_sorted ( btree_t* btree, void** records,
+                                     unsigned int count );
+
+//
+//  Remove all of the records from "lo" to "hi" (inclusive) from the btree.
+//  Each removed record is passed to the visitor function, along with the
+//  user supplied context pointer, once the btree is consistent again.  The
+//  number of records removed is returned.
+//
+extern int      btree_delete_range ( btree_t* btree, void* lo, void* hi,
+                                     visitFunc visitor, void* context );
+
 extern void*    btree_get_min  ( btree_t* btree );
 
 extern void*    btree_get_max  ( btree_t* btree );
@@ -168,6 +348,22 @@ extern void     btree_traverse ( btree_t* btree, traverseFunc traverseCB );
 //     The above example will find all of the records in the btree beginning with
 //     { 12, "" } to the end of the btree.
 //
+//  The iterators returned by the functions above are allocated on the heap.
+//  To avoid that, an iterator can be declared by the caller (typically as a
+//  local variable) and positioned with one of the "_init" functions, which
+//  never allocate memory:
+//
+//         btree_iterator_t iter;
+//
+//         btree_find_init ( &iter, btree, &record );
+//
+//         while ( ! btree_iter_at_end ( &iter ) )
+//         {
+//             userData* returnedData = btree_iter_data ( &iter );
+//             ...
+//             btree_iter_next ( &iter );
+//         }
+//
 //  Note that this iterator definition is designed to operate similarly to the
 //  C++ Standard Template Library's container iterators.  There are obviously
 //  some differences due to the language differences but it's pretty close.
@@ -183,6 +379,9 @@ extern void     btree_traverse ( btree_t* btree, traverseFunc traverseCB );
 //
 extern btree_iter btree_find ( btree_t* btree, void* key );
 
+extern btree_iter btree_find_init ( btree_iterator_t* iter, btree_t* btree,
+                                    void* key );
+
 //
 //  The btree_rfind function is similar to the btree_search function except
 //  that it will find the last key that is less than or equal to the specified
@@ -193,17 +392,36 @@ extern btree_iter btree_find ( btree_t* btree, void* key );
 //
 extern btree_iter btree_rfind ( btree_t* btree, void* key );
 
+extern btree_iter btree_rfind_init ( btree_iterator_t* iter, btree_t* btree,
+                                     void* key );
+
+//
+//  The btree_find_range function is similar to the btree_find function
+//  except that the iterator it returns reaches the "end" once it moves past
+//  the last key that is less than or equal to "hi".
+//
+extern btree_iter btree_find_range ( btree_t* btree, void* lo, void* hi );
+
+extern btree_iter btree_find_range_init ( btree_iterator_t* iter,
+                                          btree_t* btree, void* lo, void* hi );
+
 //
 //  Position the specified iterator to the first record in the btree.
 //
 extern btree_iter btree_iter_begin ( btree_t* btree );
 
+extern btree_iter btree_iter_begin_init ( btree_iterator_t* iter,
+                                          btree_t* btree );
+
 //
 //  Position the specified itrator to the "end" position in the btree (which
 //  is past the last record of the btree.
 //
 extern btree_iter btree_iter_end ( btree_t* btree );
 
+extern btree_iter btree_iter_end_init ( btree_iterator_t* iter,
+                                        btree_t* btree );
+
 //
 //  Position the specified iterator to the next higher key value in the btree
 //  from the current position.
@@ -236,11 +454,13 @@ extern void* btree_iter_data ( btree_iter iter );
 //
 //  Cleanup the specified iterator and release any resources being used by
 //  this iterator.  This function MUST be called when the user is finished
-//  using an iterator or resources (such as memory blocks) will be leaked to
-//  the system.  Once this function has been called with an iterator, that
-//  iterator may not be used again for any of the btree functions unless it
-//  has subsequently been reinitialized using one of the iterator
-//  initialization functions defined here.
+//  using an iterator returned by one of the allocating functions above or
+//  resources (such as memory blocks) will be leaked to the system.  It is
+//  optional for iterators initialized by the "_init" functions.  Once this
+//  function has been called with an iterator, that iterator may not be used
+//  again for any of the btree functions unless it has subsequently been
+//  reinitialized using one of the iterator initialization functions defined
+//  here.
 //
 extern void btree_iter_cleanup ( btree_iter iter );
 
@@ -284,48 +504,4 @@ extern void print_subtree ( btree_t* btree, bt_node_t* node, printFunc printCB )
 
 #endif
 
-
-#if 0
-[ from /home/dmies/git/btree/btree.h ]
-
-//
-//  The following is the fixed size of each node of the btree.  This size
-//  should be chosen to be a multiple of the system memory page size.  The
-//  system memory page size can be gotten with sysconf(_SC_PAGE_SIZE).
-//
-//  TODO: Change the node size to be dynamically derived from the above system
-//  call and build the MIN and MAX values below from that.  This will make the
-//  code more portable to different platforms.
-//
-#define NODE_SIZE ( 4096 )
-
-//
-//  The formula for the maximum number of keys in each tree node is derived
-//  from the following formula:
-//
-//      NODE_SIZE = sizeof(count) + sizeof(data)*MAX + sizeof(link)*(MAX+1)
-//
-//  Substituting all the numbers what we know...
-//
-//      4096      = 8             + 16 * MAX          + 8 * (MAX + 1)
-//      4096      = 8             + 16 * MAX          + 8 * MAX + 8
-//      4096      = 8             + 24 * MAX + 8
-//      4096      = 24 * MAX + 16
-//
-//  Solving this equation for MAX gives:
-//
-//      MAX = ( 4096 - 16 ) / 24
-//      MAX = 170
-//
-//  This is basically a calculation of the (fixed) size of a node divided by
-//  the size of all of the fields in the node.  Note that this calculation
-//  needs to take into account any alignment that might take place inside the
-//  structure.  The beginning of the structure will always be on a memory page
-//  boundary so no alignment takes place there.
-//
-#define MAX ( ( NODE_SIZE - 2 * sizeof(unsigned long) ) / ( 3 * sizeof(unsigned long) ) )
-#define MIN ( MAX / 2 )
-
-#endif
-
 #endif
@@ -0,0 +1,149 @@
+#ifndef _BTREE_DEFINE_H_
+#define _BTREE_DEFINE_H_
+
+#include "btree.h"
+
+
+//
+//  The following macro generates a set of functions for a btree that holds
+//  records of one specific type.  Unlike the generic btree functions, which
+//  call the compare function of the btree through a pointer for every
+//  record they look at, the generated search has the comparison compiled
+//  inline and looks at the record arrays of the nodes as arrays of the
+//  record type.
+//
+//      name - The prefix of the generated functions
+//      type - The type of the records, the btree holds "type*" pointers
+//      key  - A function or function-like macro that returns the key of a
+//             "type*" record
+//      cmp  - A function or function-like macro that compares two keys and
+//             returns < 0, 0 or > 0 just like a btree compare function
+//
+//  For example:
+//
+//      #define REMOTE_FD( remote )   ( ( remote )->fd )
+//      #define INT_COMPARE( a, b )   ( ( a ) - ( b ) )
+//
+//      BTREE_DEFINE ( remote_idx, TRemote, REMOTE_FD, INT_COMPARE )
+//
+//  generates the following functions:
+//
+//      remote_idx_compare    - Compare two records (inline)
+//      remote_idx_compare_cb - The same comparison as a compareFunc
+//      remote_idx_create     - Create a btree that uses remote_idx_compare_cb
+//      remote_idx_insert     - btree_insert taking a typed record
+//      remote_idx_delete     - btree_delete taking a typed record
+//      remote_idx_search     - btree_search with the comparison inlined
+//      remote_idx_iter_data  - btree_iter_data returning a typed record
+//
+//  The btree is still a plain btree_t so all of the other btree functions
+//  (iterators, range deletes, bulk loads, etc.) can be used on it as well.
+//  Those call remote_idx_compare_cb through the compare function pointer.
+//  If the btree has a fingerprint function, the generated search calls it
+//  once for the key and then compares the fingerprints inline.
+//
+//  tests/bench_btree_define times the generated search against btree_search
+//  on btrees set up like the service indices of rvi.c.  Their lookups spend
+//  the time in strcmp and cache misses rather than in the indirect call, so
+//  those indices still use the generic functions.
+//
+#define BTREE_DEFINE( name, type, key, cmp )                                  \
+                                                                              \
+static inline int name##_compare ( type* a, type* b )                         \
+{                                                                             \
+    return cmp ( key ( a ), key ( b ) );                                      \
+}                                                                             \
+                                                                              \
+static inline int name##_compare_cb ( void* a, void* b )                      \
+{                                                                             \
+    return name##_compare ( (type*)a, (type*)b );                             \
+}                                                                             \
+                                                                              \
+static inline btree_t* name##_create ( btree_node_mode_t mode,                \
+                                       btree_allocator_t* allocator )         \
+{                                                                             \
+    return btree_create_sized ( mode, name##_compare_cb, allocator );         \
+}                                                                             \
+                                                                              \
+static inline int name##_insert ( btree_t* btree, type* record )             \
+{                                                                             \
+    return btree_insert ( btree, record );                                    \
+}                                                                             \
+                                                                              \
+static inline int name##_delete ( btree_t* btree, type* record )             \
+{                                                                             \
+    return btree_delete ( btree, btree->root, record );                       \
+}                                                                             \
+                                                                              \
+static inline unsigned int name##_lower_bound ( bt_node_t* node,             \
+                                                type* record,                 \
+                                                uint64_t fingerprint,         \
+                                                int* diff )                   \
+{                                                                             \
+    type**       records = (type**)node->dataRecords;                         \
+    unsigned int low     = 0;                                                 \
+    unsigned int high    = node->keysInUse;                                   \
+    unsigned int mid;                                                         \
+    int          result;                                                      \
+                                                                              \
+    *diff = 1;                                                                \
+                                                                              \
+    while ( low < high )                                                      \
+    {                                                                         \
+        mid = low + ( high - low ) / 2;                                       \
+                                                                              \
+        if ( node->fingerprints != NULL &&                                    \
+             fingerprint != node->fingerprints[mid] )                         \
+        {                                                                     \
+            result = fingerprint < node->fingerprints[mid] ? -1 : 1;          \
+        }                                                                     \
+        else                                                                  \
+        {                                                                     \
+            result = name##_compare ( record, records[mid] );                 \
+        }                                                                     \
+        if ( result > 0 )                                                     \
+        {                                                                     \
+            low = mid + 1;                                                    \
+        }                                                                     \
+        else                                                                  \
+        {                                                                     \
+            high  = mid;                                                      \
+            *diff = result;                                                   \
+        }                                                                     \
+    }                                                                         \
+    return low;                                                               \
+}                                                                             \
+                                                                              \
+static inline type* name##_search ( btree_t* btree, type* record )           \
+{                                                                             \
+    bt_node_t*   node        = btree->root;                                   \
+    uint64_t     fingerprint = 0;                                             \
+    unsigned int i;                                                           \
+    int          diff;                                                        \
+                                                                              \
+    if ( btree->fingerprintCB != NULL )                                       \
+    {                                                                         \
+        fingerprint = btree->fingerprintCB ( record );                        \
+    }                                                                         \
+    while ( true )                                                            \
+    {                                                                         \
+        i = name##_lower_bound ( node, record, fingerprint, &diff );          \
+                                                                              \
+        if ( diff == 0 )                                                      \
+        {                                                                     \
+            return ( (type**)node->dataRecords )[i];                          \
+        }                                                                     \
+        if ( node->leaf )                                                     \
+        {                                                                     \
+            return NULL;                                                      \
+        }                                                                     \
+        node = node->children[i];                                             \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+static inline type* name##_iter_data ( btree_iter iter )                      \
+{                                                                             \
+    return (type*)btree_iter_data ( iter );                                   \
+}
+
+#endif  // _BTREE_DEFINE_H_
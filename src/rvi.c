@@ -10,48 +10,203 @@
  * @author Tatiana Jamison &lt;tjamison@jaguarlandrover.com&gt;
  */
 
+#include "rvi_arena.h"
+#include "rvi_fdtable.h"
+#include "rvi_hash.h"
+#include "rvi_intern.h"
+#include "rvi_trie.h"
 #include "rvi_list.h"
+#include "rvi_pattern.h"
+#include "rvi_pool.h"
+#include "rvi_rights.h"
+#include "rvi_timer.h"
 #include "btree.h"
 
 #include <jansson.h>
 #include <jwt.h>
 
 #include <openssl/err.h>
+#include <openssl/sha.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
 
 #include "rvi.h"
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 /* *************** */
 /* DATA STRUCTURES */
 /* *************** */
 
+/** Data structure for rights parsed from validated credential */
+typedef struct TRviRights {
+    json_t *receive;    /* json array for right(s) to receive */
+    json_t *invoke;     /* json array for right(s) to invoke */
+    long expiration;     /* unix epoch time for jwt's validity.end */
+} TRviRights;
+
+/** @brief A credential decoded from its JWT and verified against the CA */
+typedef struct TRviCredential {
+    long start;         /* unix epoch time for jwt's validity.start */
+    long stop;          /* unix epoch time for jwt's validity.stop */
+    /* SHA-256 of the DER certificate of the device, if hasDevice is set */
+    unsigned char deviceDigest[SHA256_DIGEST_LENGTH];
+    int hasDevice;      /* The credential names a well-formed device cert */
+    json_t *receive;    /* json array for right(s) to receive */
+    json_t *invoke;     /* json array for right(s) to invoke */
+    unsigned int refs;  /* Number of holders, including the cache */
+} TRviCredential;
+
+/** @brief A verified credential remembered by the digest of its token */
+typedef struct TRviCredentialEntry {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    TRviCredential *credential;
+} TRviCredentialEntry;
+
+/* The most verified credentials that a context remembers */
+#define RVI_CREDENTIAL_CACHE_SIZE ( 1024 )
+
+/* 
+ * The number of worker threads that verify credentials. OpenSSL before 1.1 
+ * is only safe to use from several threads once the application installs 
+ * locking callbacks, so with those versions credentials are verified in 
+ * the calling thread. 
+ */
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define RVI_VERIFY_THREADS ( 0 )
+#else
+#define RVI_VERIFY_THREADS ( RVI_POOL_ONLINE )
+#endif
+
+/* 
+ * A credential bundle holds this node's credentials, verified ahead of time 
+ * by scripts/rvi_create_credential.py, so that they can be loaded without 
+ * reading, verifying or parsing each token. All integers are little-endian. 
+ * 
+ *  header:     "RVIB", version (u32), count (u32), reserved (u32), 
+ *              SHA-256 of the DER SubjectPublicKeyInfo of the CA's key, 
+ *              SHA-256 of the DER certificate of the device 
+ *  entries:    start (i64), stop (i64), token length (u32), number of 
+ *              receive patterns (u32), number of invoke patterns (u32), 
+ *              then the token and each pattern, each followed by a '\0' 
+ *  trailer:    SHA-256 of everything before it 
+ */
+#define RVI_BUNDLE_MAGIC        "RVIB"
+#define RVI_BUNDLE_VERSION      ( 1 )
+#define RVI_BUNDLE_HEADER_SIZE  ( 16 + 2 * SHA256_DIGEST_LENGTH )
+#define RVI_BUNDLE_ENTRY_SIZE   ( 28 )
+
+/** @brief A batch of tokens being decoded by the worker pool */
+typedef struct TRviCredentialBatch {
+    TRviHandle handle;
+    const char **creds;             /* The tokens; NULL ones are skipped */
+    TRviCredential **credentials;   /* Where each decoded token is stored */
+} TRviCredentialBatch;
+
+/** @brief All of the rights granted to one node by its credentials */
+typedef struct TRviRightsSet {
+    /** List of TRviRights structures, one for each validated credential */
+    TRviList list;
+    /** The rights to receive of every credential, compiled for matching */
+    TRviRightsTrie receive;
+    /** The rights to invoke of every credential, compiled for matching */
+    TRviRightsTrie invoke;
+    /** Decisions already made for recently checked service names */
+    TRviRightsCache cache;
+    /** When the next credential in the set expires, or 0 if the set is 
+     * empty. The set is kept in the context's expiration heap until then. */
+    long expiration;
+    /** File descriptor of the remote holding the rights, or 0 for the rights 
+     * of this node */
+    int owner;
+    /** The patterns of every credential in a canonical order, the same for 
+     * any two sets that grant the same rights, or NULL if the set cannot be 
+     * grouped with others */
+    char *key;
+    /** Hash of the key */
+    uint64_t keyHash;
+} TRviRightsSet;
+
+/** @brief A group of identical rights sets in a batch rights check */
+typedef struct TRviRightsGroup {
+    TRviRightsSet *set; /* The first set of the group, the one checked */
+    int allowed;        /* Whether the sets of the group grant the right */
+} TRviRightsGroup;
+
+/* Bitmaps of the entries that a batch rights check allows */
+#define RVI_BITMAP_WORDS( n )       ( ( ( n ) + 63 ) / 64 )
+#define RVI_BITMAP_SET( map, i )    \
+    ( ( map )[( i ) / 64] |= (uint64_t)1 << ( ( i ) % 64 ) )
+#define RVI_BITMAP_TEST( map, i )   \
+    ( ( ( map )[( i ) / 64] >> ( ( i ) % 64 ) ) & 1 )
+
 /** @brief RVI context */
 typedef struct TRviContext {
 
     /* 
-     * Btrees for indexing remote connections, RVI services by name, and RVI 
-     * services by registrant. 
+     * Table of remote connections indexed by file descriptor, and btrees for 
+     * indexing RVI services by name and by registrant. The hash table holds 
+     * the same services as the name index; it serves exact name lookups, 
+     * while the btree keeps the names in order for listing. 
      */
-    btree_t *remoteIdx;        /* Remote connections by fd */
+    TRviFdTable remoteIdx;     /* Remote connections by fd */
     btree_t *serviceNameIdx;  /* Services by fully qualified service name */
     btree_t *serviceRegIdx;   /* Services by fd of registering node ---*/
                             /*  note: local services designated 0 (stdin)  */
+    TRviHashTable serviceHash; /* Services by hash of the service name */
+#ifdef RVI_SERVICE_TRIE
+    /* Services by the '/' separated segments of the service name. Names 
+     * sharing a prefix share its nodes, and the services matching a pattern 
+     * are found without looking at the rest. */
+    TRviTrie serviceTrie;
+#endif
+
+    /* Canonical copies of the service names. Every service shares the copy 
+     * of its name, so names can be compared by address. */
+    TRviInternTable names;
+
+    /* Arena supplying the node slabs for all of the btrees above. The memory
+     * is released in one step when the context is cleaned up. */
+    TRviArena arena;
+
+    /* The rights set of this node and of every remote, by the time their 
+     * next credential expires. Expired rights are withdrawn when they come 
+     * due rather than looked for on every check. */
+    TRviTimerHeap expirations;
+
+    /* Credentials already decoded and verified, by the SHA-256 digest of 
+     * their tokens, and the same entries by the time the credentials 
+     * expire. Peers present the same tokens each time they reconnect, and 
+     * their signatures only need to be checked the first time. */
+    TRviHashTable credentialCache;
+    TRviTimerHeap credentialExpirations;
+
+    /* Worker threads for verifying batches of credentials on all cores */
+    TRviPool pool;
 
     /* Properties set in configuration file */
     char *cadir;    /* Directory containing the trusted certificate store */
     char *creddir;  /* Directory containing base64-encoded JWT credentials */
+    char *credbundle; /* Bundle of verified credentials, used if valid */
     char *certfile; /* File containing X.509 public key certificate (PKC) */
     char *keyfile;  /* File containing corresponding private key */
     char *cafile;   /* File containing CA public key certificate(s) */
     char *id;       /* Unique device ID. Format is "domain/type/uuid", e.g.: */
                     /* genivi.org/node/839fc839-5fab-472f-87b3-a8fbbd7e3935 */
 
+    /* Public key of the CA as a PEM string, ready to verify credentials. 
+     * It is read from cafile once and only reloaded by rviRefreshCaKey. */
+    char *cakey;
+    size_t cakeyLength;
+
     /* List of RVI credentials loaded into memory for quick access when
      * negotiating connections */
     TRviList *creds;
@@ -60,26 +215,36 @@ typedef struct TRviContext {
     /* Contains X509 certs, config settings, etc */
     SSL_CTX *sslCtx;
 
-    TRviList *rights;
+    TRviRightsSet *rights;
+
+    /* Hits and misses of the rights caches of remotes already disconnected, 
+     * so the totals reported by rviGetRightsCacheStats do not go down */
+    unsigned long rightsCacheHits;
+    unsigned long rightsCacheMisses;
 } TRviContext;
 
 /** @brief Data for connection to remote node */
 typedef struct TRviRemote {
     /** File descriptor for the connection */
     int fd;
-    /** List of TRviRights structures, containing receive & invoke rights and
-     * expiration */
-    TRviList *rights;
+    /** Receive & invoke rights and expiration from the remote's credentials */
+    TRviRightsSet *rights;
     /** Pointer to data buffer for partial I/O operations */
     void *buf;
     /** Pointer to BIO chain from OpenSSL library */
     BIO *sbio;
+    /** SHA-256 of the peer's DER certificate, computed once per connection */
+    unsigned char certDigest[SHA256_DIGEST_LENGTH];
+    /** Nonzero once certDigest holds the peer's fingerprint */
+    int certDigested;
 } TRviRemote;
 
 /** @brief Data for service */
 typedef struct TRviService {
-    /** The fully-qualified service name */
-    char *name;
+    /** The fully-qualified service name, interned in the context's names */
+    const char *name;
+    /** Hash of the service name, computed once when the name is interned */
+    uint64_t hash;
     /** File descriptor of remote node that registered service */
     int registrant;
     /** Callback function to execute upon service invocation */
@@ -88,47 +253,88 @@ typedef struct TRviService {
     void *data;
 } TRviService;
 
-/** Data structure for rights parsed from validated credential */
-typedef struct TRviRights {
-    json_t *receive;    /* json array for right(s) to receive */
-    json_t *invoke;     /* json array for right(s) to invoke */
-    long expiration;     /* unix epoch time for jwt's validity.end */
-} TRviRights;
+/** @brief Buffer of service names filled in by rviFindServices */
+typedef struct TRviFindResult {
+    char **result;  /* Where to store the next name */
+    int len;        /* The number of names that fit */
+    int count;      /* The number of names stored so far */
+} TRviFindResult;
 
 /* 
  * Declarations for internal functions not exposed in the API 
  */
 
-TRviService *rviServiceCreate ( const char *name, const int registrant, 
+TRviService *rviServiceCreate ( TRviInternTable *names, const char *name, 
+                                    const int registrant, 
                                     const TRviCallback callback, 
                                     const void *serviceData, size_t dataSize );
 
-void rviServiceDestroy ( TRviService *service );
+void rviServiceDestroy ( TRviInternTable *names, TRviService *service );
+
+void rviServiceDiscard ( void *record, void *context );
+
+void rviServiceRelease ( void *record, void *context );
+
+int rviServiceMatch ( void *record, const void *key );
+
+TRviService *rviServiceLookup ( TRviContext *ctx, const char *name );
+
+int rviServiceAddName ( TRviContext *ctx, TRviService *service );
+
+void rviServiceRemoveName ( TRviContext *ctx, TRviService *service );
+
+int rviFindVisit ( void *record, void *context );
+
+int rviServiceGetRange ( TRviContext *ctx, int first, int last, 
+                         TRviService ***batch, size_t *count );
 
 TRviRemote *rviRemoteCreate ( BIO *sbio, const int fd );
 
 void rviRemoteDestroy ( TRviRemote *remote );
 
-TRviRights *rviRightsCreate (   const char *rightToReceive, 
-                                    const char *rightToInvoke, 
+TRviRights *rviRightsCreate (   json_t *rightToReceive, 
+                                    json_t *rightToInvoke, 
                                     long validity );
 
 void rviRightsDestroy ( TRviRights *rights );
 
-void rviRightsListDestroy ( TRviList *list );
+TRviRightsSet *rviRightsSetCreate ( void );
+
+int rviRightsSetAdd ( TRviRightsSet *set, TRviRights *rights );
+
+void rviRightsSetDestroy ( TRviRightsSet *set );
+
+void rviRightsSetFlush ( TRviRightsSet *set );
+
+void rviRightsSetPrune ( TRviRightsSet *set, long now );
+
+int rviRightsSetSchedule ( TRviContext *ctx, TRviRightsSet *set );
+
+int rviRightsSetExpire ( TRviContext *ctx, TRviRightsSet *set, long now );
+
+int rviRightsSetCheck ( TRviRightsSet *set, int kind, const char *name );
+
+int rviRightsSetKey ( TRviRightsSet *set );
+
+int rviRightsGroupMatch ( void *record, const void *key );
+
+int rviSortPatterns ( const void *a, const void *b );
 
 void rviCredentialListDestroy ( TRviList *list );
 
 char *rviFqsnGet( TRviHandle handle, const char *serviceName );
 
 /* Comparison functions for constructing btrees and retrieving values */
-int rviCompareFd ( void *a, void *b );
-
 int rviCompareRegistrant ( void *a, void *b );
 
 int rviCompareName ( void *a, void *b );
 
-int rviComparePattern ( const char *pattern, const char *fqsn );
+int rviSortByName ( const void *a, const void *b );
+
+/* Fingerprint functions stored alongside the records in the btrees */
+uint64_t rviFingerprintRegistrant ( void *a );
+
+uint64_t rviFingerprintName ( void *a );
 
 /* Utility functions related to OpenSSL library */
 int sslVerifyCallback ( int ok, X509_STORE_CTX *store );
@@ -139,18 +345,74 @@ SSL_CTX *rviSetupClientCtx ( TRviHandle handle );
 
 int rviReadJsonConfig ( TRviHandle handle, const char * filename );
 
-json_t *rviGetJsonGrant ( jwt_t *jwt, const char *grant );
+uint32_t rviBundleGet32( const unsigned char *p );
+
+int64_t rviBundleGet64( const unsigned char *p );
+
+int rviBundleWalk( TRviContext *ctx, const unsigned char *p, 
+                   const unsigned char *end, uint32_t count, long now, 
+                   size_t *valid );
+
+int rviPubkeyDigest( const char *pem, unsigned char *digest );
+
+int rviReadCredentialBundle( TRviContext *ctx, 
+                             const unsigned char *certDigest );
+
+json_t *rviGetJsonBody ( jwt_t *jwt );
 
 char *rviGetPubkeyFile( char *filename );
 
-int rviValidateCredential( TRviHandle handle, const char *cred, X509 *cert );
+TRviCredential *rviCredentialDecode( TRviHandle handle, const char *cred );
+
+void rviCredentialRelease( TRviCredential *credential );
+
+TRviCredential *rviCredentialGet( TRviHandle handle, const char *cred );
+
+void rviCredentialDecodeTask( void *context, size_t index );
+
+int rviCredentialDecodeBatch( TRviHandle handle, const char **creds, 
+                              size_t count, TRviCredential **credentials );
+
+int rviCredentialGetBatch( TRviHandle handle, const char **creds, 
+                           size_t count, TRviCredential **credentials );
+
+void rviCredentialCacheExpire( TRviContext *ctx, long now );
+
+TRviCredential *rviCredentialLookup( TRviContext *ctx, const char *cred, 
+                                     unsigned char *digest );
+
+TRviCredential *rviCredentialRemember( TRviContext *ctx, 
+                                       const unsigned char *digest, 
+                                       TRviCredential *credential );
+
+int rviCredentialMatch ( void *record, const void *key );
+
+void rviCredentialForget( TRviContext *ctx, TRviCredentialEntry *entry );
+
+void rviCredentialCacheFlush( TRviContext *ctx );
+
+int rviBase64Value( int c );
+
+int rviBase64Decode( const char *in, unsigned char *out, size_t *length );
+
+int rviCertDigest( X509 *cert, unsigned char *digest );
+
+int rviValidateCredential( TRviCredential *credential, 
+                           const unsigned char *certDigest );
+
+int rviGetRightsFromCredential( TRviCredential *credential, 
+                                TRviRightsSet *rights );
 
-int rviGetRightsFromCredential( TRviHandle handle, const char *cred, 
-                           TRviList *rights );
+int rviRightToReceiveError( TRviRightsSet *rights, const char *serviceName );
 
-int rviRightToReceiveError( TRviList *rlist, const char *serviceName );
+int rviRightToInvokeError( TRviRightsSet *rights, const char *serviceName );
 
-int rviRightToInvokeError( TRviList *rlist, const char *serviceName );
+int rviRightToInvokeRemotes( TRviRemote **remotes, size_t count, 
+                             const char *serviceName, uint64_t *allowed );
+
+int rviRightsSetCheckServices( TRviRightsSet *set, int kind, 
+                               TRviService **services, size_t count, 
+                               uint64_t *allowed );
 
 int rviRemoveService(TRviHandle handle, const char *serviceName);
 
@@ -168,19 +430,6 @@ int rviReadRcv( TRviHandle handle, json_t *msg, TRviRemote *remote );
 
 /****************************************************************************/
 
-/* 
- * This function compares 2 pointers to TRviRemote structures on the basis of
- * the remote's file descriptor. It is used for building the index for remote
- * connections. 
- */
-int rviCompareFd ( void *a, void *b )
-{
-    TRviRemote *remoteA = a;
-    TRviRemote *remoteB = b;
-
-    return ( remoteA->fd - remoteB->fd );
-}
-
 /* 
  * This function compares 2 pointers to TRviService structures on the basis
  * of the registrant (i.e., file descriptor). For services registered by the
@@ -203,53 +452,85 @@ int rviCompareRegistrant ( void *a, void *b )
 
 /* 
  * This function will compare 2 pointers to TRviService structures on the
- * basis of the unique fully-qualified service name. 
+ * basis of the unique fully-qualified service name. Interned names that are 
+ * equal are the same pointer, so strcmp is only needed to order different 
+ * names. 
  */
 int rviCompareName ( void *a, void *b )
 {
     TRviService *serviceA = a;
     TRviService *serviceB = b;
 
+    if( serviceA->name == serviceB->name ) { return 0; }
+
     return strcmp ( serviceA->name, serviceB->name );
 }
 
-/*
- * This function compares an RVI pattern to a fully-qualified service name. If
- * the service name matches the pattern, it returns RVI_OK or an error
- * otherwise.
- */
-int rviComparePattern ( const char *pattern, const char *fqsn )
-{
-    /* Check input */
-    if( !pattern || !fqsn ) { return EINVAL; }
-    /* While there are bytes to compare */
-    while( *pattern != '\0' && *fqsn != '\0' ) {
-        /* If there's a topic wildcard... */
-        if( *pattern == '+' ) {
-            /* Advance topic in pattern */
-            while( *pattern++ != '/' && *pattern != '\0' );
-            /* Advance topic in fqsn */
-            while( *fqsn++ != '/' && *fqsn != '\0' );
+/* 
+ * The following functions compute the fingerprints that the btrees keep next 
+ * to each record pointer so that most comparisons can be made without 
+ * touching the record. A fingerprint must order records the same way as the 
+ * matching comparison function; records with equal fingerprints are then 
+ * compared with that function. 
+ */
+
+/* 
+ * The fingerprint of a service in the registrant index is the registrant 
+ * alone. The name cannot be included, since a search key without a name 
+ * compares equal to every service of its registrant. 
+ */
+uint64_t rviFingerprintRegistrant ( void *a )
+{
+    TRviService *service = a;
+
+    return (uint32_t)service->registrant ^ 0x80000000u;
+}
+
+/* 
+ * The fingerprint of a service in the name index is the first 8 bytes of the 
+ * fully-qualified service name read as a big-endian number, which orders the 
+ * same way as strcmp. Names sharing those 8 bytes fall back to strcmp. 
+ */
+uint64_t rviFingerprintName ( void *a )
+{
+    TRviService *service = a;
+    const unsigned char *name = (const unsigned char *)service->name;
+    uint64_t result = 0;
+    int i;
+
+    for( i = 0; i < 8; i++ ) {
+        result <<= 8;
+        if( name && *name ) {
+            result |= *name++;
         }
-        /* If the bytes don't match, return error */
-        if( *pattern++ != *fqsn++ ) { return -1; }
     }
-    /* If the pattern still has characters, the fqsn doesn't match */
-    if( *pattern != '\0' ) { return -1; }
 
-    /* Otherwise, the fqsn matches the pattern */
-    return RVI_OK;
+    return result;
+}
+
+/* 
+ * This function compares 2 entries of an array of pointers to TRviService 
+ * structures by service name, for sorting the array with qsort. 
+ */
+int rviSortByName ( const void *a, const void *b )
+{
+    TRviService * const *serviceA = a;
+    TRviService * const *serviceB = b;
+
+    return strcmp ( (*serviceA)->name, (*serviceB)->name );
 }
 
 /* 
  * This function initializes a new service struct and sets the name,
- * registrant, and callback to the specified values. 
+ * registrant, and callback to the specified values. The name is interned in 
+ * the given table. 
  *
  * If service name is null or registrant is negative, this returns NULL and
  * performs no operations. 
  */
 
-TRviService *rviServiceCreate ( const char *name, const int registrant, 
+TRviService *rviServiceCreate ( TRviInternTable *names, const char *name, 
+                                    const int registrant, 
                                     const TRviCallback callback, 
                                     const void *serviceData, size_t dataSize )
 {
@@ -261,8 +542,13 @@ TRviService *rviServiceCreate ( const char *name, const int registrant,
     if( !service ) { return NULL; }
     memset(service, 0, sizeof ( TRviService ) );
 
-    /* Set the service name */
-    service->name = strdup ( name );
+    /* Set the service name and its hash */
+    service->name = rviInternAcquire ( names, name );
+    if( !service->name ) {
+        free( service );
+        return NULL;
+    }
+    service->hash = rviInternHash ( service->name );
 
     /* Set the service registrant */
     service->registrant = registrant;
@@ -274,7 +560,7 @@ TRviService *rviServiceCreate ( const char *name, const int registrant,
     if( dataSize ) {
         service->data = malloc( dataSize );
         if(! service->data ) {
-            free( service->name );
+            rviInternRelease( names, service->name );
             free( service );
             return NULL;
         }
@@ -286,20 +572,163 @@ TRviService *rviServiceCreate ( const char *name, const int registrant,
 }
 
 /* 
- * This function frees all memory allocated by a service struct. 
+ * This function frees all memory allocated by a service struct and releases 
+ * its name back to the table it was interned in. 
  * 
  * If service is null, no operations are performed. 
  */
-void rviServiceDestroy ( TRviService *service )
+void rviServiceDestroy ( TRviInternTable *names, TRviService *service )
 {
      if ( !service ) { return; }
 
      if( service->data )
          free ( service->data );
-     free ( service->name );
+     rviInternRelease ( names, service->name );
      free ( service );
 }
 
+/* 
+ * This function is the visitor used when a range of services is removed from 
+ * the registrant index. It removes the service from the name index as well 
+ * and then frees it. The context is the RVI context. 
+ */
+void rviServiceDiscard ( void *record, void *context )
+{
+    TRviContext *ctx = context;
+    TRviService *service = record;
+
+    btree_delete( ctx->serviceNameIdx, ctx->serviceNameIdx->root, service );
+    rviServiceRemoveName( ctx, service );
+    rviServiceDestroy( &ctx->names, service );
+}
+
+/* 
+ * This function is the visitor used when a service index is destroyed. It 
+ * only frees the service, since the index it came from is going away. The 
+ * context is the RVI context. 
+ */
+void rviServiceRelease ( void *record, void *context )
+{
+    TRviContext *ctx = context;
+
+    rviServiceDestroy( &ctx->names, (TRviService *)record );
+}
+
+/* 
+ * This function is the match function of the service hash table. The key is 
+ * an interned fully-qualified service name, so the names are compared by 
+ * address. 
+ */
+int rviServiceMatch ( void *record, const void *key )
+{
+    TRviService *service = record;
+
+    return service->name == key;
+}
+
+/* 
+ * This function finds a service by its fully-qualified name in the service 
+ * hash table. A name that was never interned cannot belong to a service, so 
+ * only names that are in the name table are looked up. 
+ * 
+ * If no service has that name, this returns NULL. 
+ */
+TRviService *rviServiceLookup ( TRviContext *ctx, const char *name )
+{
+    const char *interned = rviInternFind( &ctx->names, name );
+
+    if( !interned ) { return NULL; }
+
+    return rviHashLookup( &ctx->serviceHash, rviInternHash( interned ), 
+                          interned );
+}
+
+/* 
+ * This function adds a service to the indices that find services by name 
+ * alone: the service hash table and, if it is configured, the service trie. 
+ */
+int rviServiceAddName ( TRviContext *ctx, TRviService *service )
+{
+    int err;
+
+    if( ( err = rviHashInsert( &ctx->serviceHash, service->hash, service ) ) )
+        return err;
+#ifdef RVI_SERVICE_TRIE
+    if( ( err = rviTrieInsert( &ctx->serviceTrie, service->name, service ) ) ) {
+        rviHashRemove( &ctx->serviceHash, service->hash, service );
+        return err;
+    }
+#endif
+
+    return RVI_OK;
+}
+
+/* 
+ * This function removes a service from the indices it was added to by 
+ * rviServiceAddName. 
+ */
+void rviServiceRemoveName ( TRviContext *ctx, TRviService *service )
+{
+    rviHashRemove( &ctx->serviceHash, service->hash, service );
+#ifdef RVI_SERVICE_TRIE
+    rviTrieRemove( &ctx->serviceTrie, service->name );
+#endif
+}
+
+/* 
+ * This function is the visitor used by rviFindServices. It stores a copy of 
+ * the service's name in the result buffer given as the context, and stops 
+ * the search once the buffer is full. 
+ */
+int rviFindVisit ( void *record, void *context )
+{
+    TRviService *service = record;
+    TRviFindResult *find = context;
+
+    if( find->count == find->len ) { return 1; }
+    find->result[find->count++] = strdup( service->name );
+
+    return 0;
+}
+
+/* 
+ * This function gathers the services registered by the nodes with file 
+ * descriptors first through last into a new array, in the order of the 
+ * registrant index. Local services have a registrant of 0. 
+ * 
+ * The array is stored in batch and the number of services in count; the 
+ * array must be freed by the calling function. If there are no such 
+ * services, batch is set to NULL. 
+ */
+int rviServiceGetRange ( TRviContext *ctx, int first, int last, 
+                         TRviService ***batch, size_t *count )
+{
+    TRviService         lower   = {0};
+    TRviService         upper   = {0};
+    btree_iterator_t    iter;
+
+    *batch = NULL;
+    *count = 0;
+    if( !ctx->serviceRegIdx->count ) { return RVI_OK; }
+
+    *batch = malloc( ctx->serviceRegIdx->count * sizeof( TRviService * ) );
+    if( !*batch ) { return ENOMEM; }
+
+    lower.registrant = first;
+    upper.registrant = last;
+    btree_find_range_init( &iter, ctx->serviceRegIdx, &lower, &upper );
+    while( !btree_iter_at_end( &iter ) ) {
+        (*batch)[(*count)++] = btree_iter_data( &iter );
+        btree_iter_next( &iter );
+    }
+    if( !*count ) {
+        free( *batch );
+        *batch = NULL;
+    }
+
+    return RVI_OK;
+}
+
 /*  
  * This function initializes a new remote struct and sets the file descriptor
  * and BIO chain to the specified values. 
@@ -325,9 +754,9 @@ TRviRemote *rviRemoteCreate ( BIO *sbio, const int fd )
     /* Note that we do NOT need to populate rightToReceive or 
      * rightToInvoke at this time. Those will be populated by parsing the au 
      * message. */
-    remote->rights = malloc( sizeof( TRviList ) );
+    remote->rights = rviRightsSetCreate();
     if( !remote->rights ) { free( remote ); return NULL; }
-    rviListInitialize( remote->rights );
+    remote->rights->owner = fd;
 
     return remote;
 }
@@ -341,7 +770,7 @@ void rviRemoteDestroy ( TRviRemote *remote)
 {
     if ( !remote ) { return; }
 
-    rviRightsListDestroy( remote->rights );
+    rviRightsSetDestroy( remote->rights );
 
     BIO_free_all ( remote->sbio );
 
@@ -351,8 +780,8 @@ void rviRemoteDestroy ( TRviRemote *remote)
 
 /* This function creates a new rights struct for the given rights and
  * expiration */
-TRviRights *rviRightsCreate (   const char *rightToReceive, 
-                                    const char *rightToInvoke, 
+TRviRights *rviRightsCreate (   json_t *rightToReceive, 
+                                    json_t *rightToInvoke, 
                                     long validity )
 {
     if( !rightToReceive || !rightToInvoke || validity < 1 ) {
@@ -362,8 +791,8 @@ TRviRights *rviRightsCreate (   const char *rightToReceive,
     TRviRights *new = NULL;
     new = malloc( sizeof( TRviRights ) );
     if( !new ) { return NULL; }
-    new->receive = json_loads( rightToReceive, 0, NULL);
-    new->invoke = json_loads( rightToInvoke, 0, NULL);
+    new->receive = json_incref( rightToReceive );
+    new->invoke = json_incref( rightToInvoke );
     new->expiration = validity;
 
     return new;
@@ -378,12 +807,82 @@ void rviRightsDestroy ( TRviRights *rights )
     free( rights );
 }
 
-/* This function destroys a list containing rights structures and frees all
- * allocated memory */
-void rviRightsListDestroy ( TRviList *list )
+/* This function creates a new, empty rights set */
+TRviRightsSet *rviRightsSetCreate ( void )
 {
-    if( !list ) { return; }
-    TRviListEntry *ptr = list->listHead;
+    TRviRightsSet *set = malloc( sizeof( TRviRightsSet ) );
+    if( !set ) { return NULL; }
+
+    rviListInitialize( &set->list );
+    rviRightsTrieInitialize( &set->receive );
+    rviRightsTrieInitialize( &set->invoke );
+    rviRightsCacheInitialize( &set->cache );
+    set->expiration = 0;
+    set->owner = 0;
+    set->key = NULL;
+    set->keyHash = 0;
+
+    /* If there is no key, the empty set is just not grouped with others */
+    rviRightsSetKey( set );
+
+    return set;
+}
+
+/* 
+ * This function adds the rights from one credential to a rights set. Their 
+ * patterns are compiled into the set's tries here, once, so that checking a 
+ * service name against the set never has to look at the JSON again. 
+ * 
+ * The set takes ownership of the rights structure, even if this fails. A 
+ * failure while compiling leaves the set granting fewer rights, never more. 
+ */
+int rviRightsSetAdd ( TRviRightsSet *set, TRviRights *rights )
+{
+    if( !set || !rights ) { return EINVAL; }
+
+    int     err;
+    json_t  *value  = NULL;
+    size_t  index;
+
+    if( ( err = rviListInsert( &set->list, rights ) ) ) {
+        rviRightsDestroy( rights );
+        return err;
+    }
+
+    /* The set is about to change, so the cached decisions are stale */
+    rviRightsSetFlush( set );
+
+    /* Until all of the patterns are compiled, the set matches no key */
+    free( set->key );
+    set->key = NULL;
+
+    for( index = 0; 
+         index < json_array_size( rights->receive ) && ( value = json_array_get( rights->receive, index ) ); 
+         index ++) {
+        const char *pattern = json_string_value( value );
+        if( pattern && ( err = rviRightsTrieAdd( &set->receive, pattern ) ) )
+            return err;
+    }
+    for( index = 0; 
+         index < json_array_size( rights->invoke ) && ( value = json_array_get( rights->invoke, index ) ); 
+         index ++) {
+        const char *pattern = json_string_value( value );
+        if( pattern && ( err = rviRightsTrieAdd( &set->invoke, pattern ) ) )
+            return err;
+    }
+
+    /* Without a key the set still works; it is only checked on its own */
+    rviRightsSetKey( set );
+
+    return RVI_OK;
+}
+
+/* This function destroys a rights set, including all of the rights 
+ * structures in it, and frees all allocated memory */
+void rviRightsSetDestroy ( TRviRightsSet *set )
+{
+    if( !set ) { return; }
+    TRviListEntry *ptr = set->list.listHead;
     TRviListEntry *tmp;
     TRviRights *rights = NULL;
     while( ptr ) {
@@ -393,7 +892,317 @@ void rviRightsListDestroy ( TRviList *list )
         ptr = ptr->next;
         free( tmp );
     }
-    free( list );
+    rviRightsTrieDestroy( &set->receive );
+    rviRightsTrieDestroy( &set->invoke );
+    rviRightsCacheFlush( &set->cache );
+    free( set->key );
+    free( set );
+}
+
+/* 
+ * This function forgets all of the decisions cached for a rights set and 
+ * works out when the next credential in the set expires, which is when the 
+ * set has to be pruned. 
+ */
+void rviRightsSetFlush ( TRviRightsSet *set )
+{
+    TRviListEntry *ptr;
+
+    rviRightsCacheFlush( &set->cache );
+
+    set->expiration = 0;
+    for( ptr = set->list.listHead; ptr; ptr = ptr->next ) {
+        TRviRights *rights = (TRviRights *)ptr->pointer;
+        if( !set->expiration || rights->expiration < set->expiration )
+            set->expiration = rights->expiration;
+    }
+}
+
+/* 
+ * This function removes the rights of every credential in a rights set that 
+ * has expired by the given time. The patterns of the rest are compiled 
+ * again from scratch, since patterns cannot be taken out of the tries. 
+ * 
+ * Rights that cannot be compiled again are dropped, which only withdraws 
+ * them early. 
+ */
+void rviRightsSetPrune ( TRviRightsSet *set, long now )
+{
+    TRviListEntry   *ptr    = set->list.listHead;
+    TRviListEntry   *tmp;
+
+    rviListInitialize( &set->list );
+    rviRightsTrieDestroy( &set->receive );
+    rviRightsTrieDestroy( &set->invoke );
+
+    while( ptr ) {
+        TRviRights *rights = (TRviRights *)ptr->pointer;
+        tmp = ptr;
+        ptr = ptr->next;
+        free( tmp );
+        if( rights->expiration <= now )
+            rviRightsDestroy( rights );
+        else
+            rviRightsSetAdd( set, rights );
+    }
+
+    /* Nothing may be left to add, so the set is brought up to date here */
+    rviRightsSetFlush( set );
+    rviRightsSetKey( set );
+}
+
+/* 
+ * This function puts a rights set into the context's expiration heap at the 
+ * time its next credential expires, replacing any earlier entry for it. A 
+ * set without credentials is not scheduled at all. 
+ */
+int rviRightsSetSchedule ( TRviContext *ctx, TRviRightsSet *set )
+{
+    rviTimerRemove( &ctx->expirations, set );
+    if( !set->expiration ) { return RVI_OK; }
+
+    return rviTimerInsert( &ctx->expirations, set->expiration, set );
+}
+
+/* 
+ * This function is called when a credential in a rights set has expired. 
+ * The expired rights are pruned, and then anything that the holder of the 
+ * set may no longer do is undone: 
+ * 
+ *  - For this node's rights, local services that it may no longer receive 
+ *    are announced as unavailable, and remote services that it may no 
+ *    longer invoke are forgotten. 
+ *  - For a remote's rights, local services that the remote may no longer 
+ *    invoke are announced to it as unavailable, and the services that it 
+ *    registered but may no longer receive are forgotten. 
+ * 
+ * The rights are withdrawn even if the services cannot be. 
+ */
+int rviRightsSetExpire ( TRviContext *ctx, TRviRightsSet *set, long now )
+{
+    int             err         = RVI_OK;
+    int             kind;
+    TRviRemote      *remote     = NULL;
+    TRviService     **local     = NULL;
+    TRviService     **registered = NULL;
+    size_t          nlocal      = 0;
+    size_t          nregistered = 0;
+    size_t          i;
+    uint64_t        *before     = NULL;
+    uint64_t        *after      = NULL;
+    json_t          *svcs       = NULL;
+    json_t          *sa         = NULL;
+    char            *saString   = NULL;
+
+    if( set != ctx->rights ) {
+        remote = rviFdTableLookup( &ctx->remoteIdx, set->owner );
+        if( !remote || remote->rights != set ) { return ENXIO; }
+    }
+
+    /* Find out which local services were announced before the rights go */
+    kind = remote ? RVI_RIGHTS_INVOKE : RVI_RIGHTS_RECEIVE;
+    err = rviServiceGetRange( ctx, 0, 0, &local, &nlocal );
+    if( !err && nlocal ) {
+        before = malloc( RVI_BITMAP_WORDS( nlocal ) * sizeof( uint64_t ) );
+        after = malloc( RVI_BITMAP_WORDS( nlocal ) * sizeof( uint64_t ) );
+        if( !before || !after )
+            err = ENOMEM;
+        else
+            rviRightsSetCheckServices( set, kind, local, nlocal, before );
+    }
+
+    rviRightsSetPrune( set, now );
+    if( rviRightsSetSchedule( ctx, set ) ) {
+        /* Rights that cannot be expired on time are not kept at all */
+        rviRightsSetPrune( set, LONG_MAX );
+        err = ENOMEM;
+    }
+    if( err ) { goto exit; }
+
+    if( nlocal ) {
+        rviRightsSetCheckServices( set, kind, local, nlocal, after );
+        if( remote ) { svcs = json_array(); }
+        for( i = 0; i < nlocal; i++ ) {
+            if( !RVI_BITMAP_TEST( before, i ) || RVI_BITMAP_TEST( after, i ) )
+                continue;
+            if( remote )
+                json_array_append_new( svcs, json_string( local[i]->name ) );
+            else
+                rviServiceAnnounce( ctx, local[i], 0 );
+        }
+        if( remote && json_array_size( svcs ) ) {
+            sa = json_pack( "{s:s, s:s, s:o}", 
+                    "cmd", "sa",            /* populate cmd */
+                    "stat", "un",           /* populate status */
+                    "svcs", svcs            /* fill with withdrawn services */
+                    );
+            svcs = NULL;
+            if( sa && ( saString = json_dumps( sa, JSON_COMPACT ) ) )
+                BIO_puts( remote->sbio, saString );
+        }
+    }
+
+    /* Forget the remote services that may no longer be used */
+    if( remote )
+        err = rviServiceGetRange( ctx, remote->fd, remote->fd, 
+                                  &registered, &nregistered );
+    else
+        err = rviServiceGetRange( ctx, 1, INT_MAX, &registered, &nregistered );
+    if( err || !nregistered ) { goto exit; }
+
+    free( after );
+    after = malloc( RVI_BITMAP_WORDS( nregistered ) * sizeof( uint64_t ) );
+    if( !after ) { err = ENOMEM; goto exit; }
+
+    kind = remote ? RVI_RIGHTS_RECEIVE : RVI_RIGHTS_INVOKE;
+    rviRightsSetCheckServices( set, kind, registered, nregistered, after );
+    for( i = 0; i < nregistered; i++ ) {
+        if( !RVI_BITMAP_TEST( after, i ) )
+            rviRemoveService( ctx, registered[i]->name );
+    }
+
+exit:
+    json_decref( svcs );
+    json_decref( sa );
+    free( saString );
+    free( before );
+    free( after );
+    free( local );
+    free( registered );
+
+    return err;
+}
+
+/* 
+ * This function decides whether a rights set grants the right of the given 
+ * kind (RVI_RIGHTS_RECEIVE or RVI_RIGHTS_INVOKE) for a service name. The 
+ * decision is taken from the set's cache if it is there; otherwise the 
+ * compiled patterns are matched and the result is cached. Expired rights 
+ * have already been pruned by rviProcessExpirations, so the time is not 
+ * looked at here. 
+ *
+ * Returns RVI_OK if the right is granted or an error otherwise. 
+ */
+int rviRightsSetCheck ( TRviRightsSet *set, int kind, const char *name )
+{
+    uint64_t hash = rviHashString( name );
+    int allowed;
+
+    allowed = rviRightsCacheGet( &set->cache, hash, name, kind );
+    if( allowed < 0 ) {
+        allowed = rviRightsTrieMatch( kind == RVI_RIGHTS_RECEIVE ? 
+                                      &set->receive : &set->invoke, name );
+        rviRightsCachePut( &set->cache, hash, name, kind, allowed );
+    }
+
+    return allowed ? RVI_OK : -1;
+}
+
+/* 
+ * This function compares 2 entries of an array of pointers to patterns, for 
+ * sorting the array with qsort. 
+ */
+int rviSortPatterns ( const void *a, const void *b )
+{
+    const char * const *patternA = a;
+    const char * const *patternB = b;
+
+    return strcmp ( *patternA, *patternB );
+}
+
+/* 
+ * This function builds the key of a rights set: every distinct pattern of 
+ * the set on a line of its own, prefixed with 'r' for receive or 'i' for 
+ * invoke, in sorted order. Sets with equal keys grant exactly the same 
+ * rights, whatever credentials they came from, so a batch check can check 
+ * one set for all of them. 
+ * 
+ * A pattern containing a newline cannot be written into a key. The set is 
+ * then left without one, as it is if this fails. 
+ */
+int rviRightsSetKey ( TRviRightsSet *set )
+{
+    if( !set ) { return EINVAL; }
+
+    int             err         = RVI_OK;
+    const char      **patterns  = NULL;
+    size_t          ends[RVI_RIGHTS_KINDS];
+    size_t          count       = 0;
+    size_t          length      = 0;
+    size_t          first;
+    size_t          index;
+    size_t          i;
+    int             kind;
+    char            *key;
+    TRviListEntry   *ptr;
+
+    free( set->key );
+    set->key = NULL;
+    set->keyHash = 0;
+
+    for( ptr = set->list.listHead; ptr; ptr = ptr->next ) {
+        TRviRights *rights = (TRviRights *)ptr->pointer;
+        count += json_array_size( rights->receive ) + 
+                 json_array_size( rights->invoke );
+    }
+    patterns = malloc( ( count ? count : 1 ) * sizeof( char * ) );
+    if( !patterns ) { return ENOMEM; }
+
+    /* Gather the distinct patterns of each kind in sorted order */
+    count = 0;
+    for( kind = 0; kind < RVI_RIGHTS_KINDS; kind++ ) {
+        first = count;
+        for( ptr = set->list.listHead; ptr; ptr = ptr->next ) {
+            TRviRights *rights = (TRviRights *)ptr->pointer;
+            json_t *array = ( kind == RVI_RIGHTS_RECEIVE ) ? 
+                            rights->receive : rights->invoke;
+            for( index = 0; index < json_array_size( array ); index++ ) {
+                const char *pattern = 
+                    json_string_value( json_array_get( array, index ) );
+                if( !pattern ) { continue; }
+                if( strchr( pattern, '\n' ) ) { err = EINVAL; goto exit; }
+                patterns[count++] = pattern;
+            }
+        }
+        qsort( patterns + first, count - first, sizeof( char * ), 
+               rviSortPatterns );
+        for( i = index = first; i < count; i++ ) {
+            if( index > first && !strcmp( patterns[i], patterns[index - 1] ) )
+                continue;
+            patterns[index++] = patterns[i];
+            length += strlen( patterns[i] ) + 2;
+        }
+        count = ends[kind] = index;
+    }
+
+    key = malloc( length + 1 );
+    if( !key ) { err = ENOMEM; goto exit; }
+
+    set->key = key;
+    for( kind = 0, i = 0; kind < RVI_RIGHTS_KINDS; kind++ ) {
+        for( ; i < ends[kind]; i++ )
+            key += sprintf( key, "%c%s\n", 
+                            ( kind == RVI_RIGHTS_RECEIVE ) ? 'r' : 'i', 
+                            patterns[i] );
+    }
+    *key = '\0';
+    set->keyHash = rviHashString( set->key );
+
+exit:
+    free( patterns );
+
+    return err;
+}
+
+/* 
+ * This function compares a group in a batch rights check to a rights set 
+ * key, for finding the group in a hash table. 
+ */
+int rviRightsGroupMatch ( void *record, const void *key )
+{
+    TRviRightsGroup *group = record;
+
+    return strcmp( group->set->key, key ) == 0;
 }
 
 void rviCredentialListDestroy ( TRviList *list )
@@ -542,7 +1351,13 @@ int rviReadJsonConfig ( TRviHandle handle, const char * filename )
     TRviContext   *ctx        = (TRviContext *)handle;
     BIO             *certbio    = NULL;
     X509            *cert       = NULL;
+    unsigned char   certDigest[SHA256_DIGEST_LENGTH];
     char            *cred       = NULL;
+    char            **files     = NULL;
+    TRviCredential  **credentials = NULL;
+    size_t          count       = 0;
+    size_t          size        = 0;
+    size_t          i;
 
     conf = json_load_file( filename, 0, &errjson );
     if( !conf ) { err = RVI_ERR_JSON; goto exit; }
@@ -579,21 +1394,45 @@ int rviReadJsonConfig ( TRviHandle handle, const char * filename )
         sprintf( ctx->creddir, "%s/", creddir );
     }
 
-    json_decref(conf);
+    const char *credbundle = json_string_value(
+                json_object_get ( conf, "credbundle" ) );
+    if( credbundle && !( ctx->credbundle = strdup( credbundle ) ) ) {
+        err = ENOMEM;
+        goto exit;
+    }
 
-    if( !(ctx->creddir) ) { err = RVI_ERR_NOCRED; goto exit; }
+    json_decref(conf);
 
-    d = opendir( ctx->creddir );
-    if (!d) { err = RVI_ERR_NOCRED; goto exit; }
+    /* Load the CA's public key once for verifying all credentials */
+    if( ( err = rviRefreshCaKey( ctx ) ) ) { goto exit; }
 
     certbio = BIO_new_file( ctx->certfile, "r" );
     if( !certbio ) { err = RVI_ERR_NOCRED; goto exit; }
     cert = PEM_read_bio_X509( certbio, NULL, 0, NULL);
     if( !cert ) { err = RVI_ERR_NOCRED; goto exit; }
+    if( rviCertDigest( cert, certDigest ) != RVI_OK ) {
+        err = RVI_ERR_NOCRED;
+        goto exit;
+    }
+
+    /* 
+     * A valid bundle stands in for the credential directory. If it is 
+     * missing, damaged or stale, the directory is read instead. 
+     */
+    if( ctx->credbundle ) {
+        err = rviReadCredentialBundle( ctx, certDigest );
+        if( err != RVI_ERR_NOCRED ) { goto exit; }
+        err = RVI_OK;
+    }
+
+    if( !(ctx->creddir) ) { err = RVI_ERR_NOCRED; goto exit; }
+
+    d = opendir( ctx->creddir );
+    if (!d) { err = RVI_ERR_NOCRED; goto exit; }
 
-    int i = 0;
     char *path = NULL;
     size_t pathSize;
+    /* Read every credential file first, so that they are verified together */
     while ( ( dir = readdir( d ) ) ) {
         if ( strstr( dir->d_name, ".jwt" ) ) {
             /* if it's a jwt file, open it */
@@ -616,19 +1455,49 @@ int rviReadJsonConfig ( TRviHandle handle, const char * filename )
             size_t len = fread( cred, sizeof(char), bufsize, fp );
             if( ferror( fp ) != 0) {
                 fputs("Error reading credential file", stderr);
+                cred[0] = '\0'; /* An unreadable file is not a credential */
             } else {
                 cred[len] = '\0'; /* Ensure string is null-terminated */
             }
-            if( rviValidateCredential( handle, cred, cert ) == RVI_OK ) {
-                rviListInsert( ctx->creds, cred );
-            }
             fclose( fp );
             free(path);
-            i++;
+            if( count == size ) {
+                size = size ? size * 2 : 16;
+                char **grown = realloc( files, size * sizeof( char * ) );
+                if( !grown ) { free( cred ); err = ENOMEM; goto exit; }
+                files = grown;
+            }
+            files[count++] = cred;
+        }
+    }
+
+    credentials = calloc( count ? count : 1, sizeof( TRviCredential * ) );
+    if( !credentials ) { err = ENOMEM; goto exit; }
+
+    if( ( err = rviCredentialDecodeBatch( handle, (const char **)files, count, 
+                                          credentials ) ) )
+        goto exit;
+
+    /* 
+     * Keep the credentials that are valid for us, and their rights, in the 
+     * order that the files were read. 
+     */
+    for( i = 0; i < count; i++ ) {
+        if( !err && credentials[i] && 
+            rviValidateCredential( credentials[i], certDigest ) == RVI_OK ) {
+            rviListInsert( ctx->creds, files[i] );
+            files[i] = NULL;
+            err = rviGetRightsFromCredential( credentials[i], ctx->rights );
         }
     }
 
 exit:
+    for( i = 0; i < count; i++ ) {
+        free( files[i] );
+        if( credentials ) rviCredentialRelease( credentials[i] );
+    }
+    free( files );
+    free( credentials );
     BIO_free_all( certbio );
     X509_free( cert );
     if( d ) closedir( d );
@@ -636,140 +1505,360 @@ exit:
     return err;
 }
 
-json_t *rviGetJsonGrant ( jwt_t *jwt, const char *grant )
+/* This function reads an unsigned 32-bit little-endian integer */
+uint32_t rviBundleGet32( const unsigned char *p )
 {
-    if( !jwt || !grant || !strlen(grant) ) { return NULL; }
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | 
+           (uint32_t)p[3] << 24;
+}
 
-    /* get token in plaintext */
-    char *plaintext = jwt_dump_str( jwt, 0 );
+/* This function reads a signed 64-bit little-endian integer */
+int64_t rviBundleGet64( const unsigned char *p )
+{
+    return (int64_t)( (uint64_t)rviBundleGet32( p ) | 
+                      (uint64_t)rviBundleGet32( p + 4 ) << 32 );
+}
 
-    /* store pointer to free memory */
-    char *start = plaintext;
+/* 
+ * This function walks the entries of a credential bundle, from p to the 
+ * trailer at end. With a context, the tokens and rights of the entries that 
+ * are valid now are added to it; without one, the entries are only checked. 
+ * 
+ * Returns RVI_OK and adds the number of entries valid now to valid, 
+ * RVI_ERR_NOCRED if the entries do not fill the bundle exactly, or another 
+ * error if they cannot be loaded. 
+ */
+int rviBundleWalk( TRviContext *ctx, const unsigned char *p, 
+                   const unsigned char *end, uint32_t count, long now, 
+                   size_t *valid )
+{
+    int                 err         = RVI_OK;
+    long                start;
+    long                stop;
+    uint32_t            tokenLength;
+    uint32_t            receiveCount;
+    uint32_t            patterns;
+    uint32_t            i;
+    uint32_t            j;
+    const char          *token;
+    const unsigned char *nul;
+    char                *copy;
+    json_t              *receive    = NULL;
+    json_t              *invoke     = NULL;
+
+    for( i = 0; i < count; i++ ) {
+        if( end - p < RVI_BUNDLE_ENTRY_SIZE ) { return RVI_ERR_NOCRED; }
+        start = rviBundleGet64( p );
+        stop = rviBundleGet64( p + 8 );
+        tokenLength = rviBundleGet32( p + 16 );
+        receiveCount = rviBundleGet32( p + 20 );
+        patterns = receiveCount + rviBundleGet32( p + 24 );
+        if( patterns < receiveCount ) { return RVI_ERR_NOCRED; }
+        p += RVI_BUNDLE_ENTRY_SIZE;
+
+        if( (size_t)( end - p ) <= tokenLength || p[tokenLength] != '\0' )
+            return RVI_ERR_NOCRED;
+        token = (const char *)p;
+        p += tokenLength + 1;
+
+        /* Entries that are not valid now are skipped, like invalid tokens */
+        if( start <= now && stop >= now ) {
+            (*valid)++;
+            if( ctx ) {
+                receive = json_array();
+                invoke = json_array();
+                if( !receive || !invoke ) { err = ENOMEM; goto exit; }
+            }
+        }
 
-    /* advance past header */
-    while( *plaintext++ != '.');
+        /* The patterns were checked when the bundle was made */
+        for( j = 0; j < patterns; j++ ) {
+            nul = memchr( p, '\0', end - p );
+            if( !nul ) { err = RVI_ERR_NOCRED; goto exit; }
+            if( receive && json_array_append_new( 
+                        j < receiveCount ? receive : invoke, 
+                        json_string_nocheck( (const char *)p ) ) ) {
+                err = ENOMEM;
+                goto exit;
+            }
+            p = nul + 1;
+        }
 
-    json_t *body = json_loads( plaintext, JSON_REJECT_DUPLICATES, NULL );
+        if( receive ) {
+            copy = strdup( token );
+            if( !copy ) { err = ENOMEM; goto exit; }
+            if( rviListInsert( ctx->creds, copy ) ) {
+                free( copy );
+                err = ENOMEM;
+                goto exit;
+            }
+            err = rviRightsSetAdd( ctx->rights, 
+                                   rviRightsCreate( receive, invoke, stop ) );
+            if( err ) { goto exit; }
+            json_decref( receive );
+            json_decref( invoke );
+            receive = invoke = NULL;
+        }
+    }
 
-    free( start );
+    if( p != end ) { err = RVI_ERR_NOCRED; }
 
-    json_t *claim = json_object_get( body, grant );
+exit:
+    json_decref( receive );
+    json_decref( invoke );
 
-    json_t *new = json_deep_copy( claim );
+    return err;
+}
 
-    json_decref( body );
+/* 
+ * This function computes the SHA-256 digest of the DER encoding of a PEM 
+ * public key, which is how a credential bundle names the CA it was made 
+ * for. 
+ */
+int rviPubkeyDigest( const char *pem, unsigned char *digest )
+{
+    if( !pem || !digest ) { return EINVAL; }
+
+    int             ret     = RVI_ERR_OPENSSL;
+    BIO             *bio    = NULL;
+    EVP_PKEY        *pkey   = NULL;
+    unsigned char   *der    = NULL;
+    int             length;
+
+    bio = BIO_new_mem_buf( (void *)pem, -1 );
+    if( !bio ) { goto exit; }
+    pkey = PEM_read_bio_PUBKEY( bio, NULL, 0, NULL );
+    if( !pkey ) { goto exit; }
+    length = i2d_PUBKEY( pkey, &der );
+    if( length < 0 ) { goto exit; }
+
+    SHA256( der, length, digest );
+    ret = RVI_OK;
 
-    return new;
+exit:
+    OPENSSL_free( der );
+    EVP_PKEY_free( pkey );
+    BIO_free_all( bio );
+
+    return ret;
 }
 
-/** Get arrays of rightToReceive and rightToInvoke */
-int rviGetRightsFromCredential( TRviHandle handle, const char *cred, 
-                           TRviList *rights )
+/* 
+ * This function loads this node's credentials and rights from the bundle 
+ * named in the configuration, in place of reading the credential directory. 
+ * The bundle is mapped into memory and only used if it is intact, was made 
+ * for the current CA key and this device's certificate, and holds at least 
+ * one credential that is valid now. Its tokens were verified when it was 
+ * made, so none of them are decoded here. 
+ * 
+ * Returns RVI_OK if the bundle was loaded, RVI_ERR_NOCRED if it cannot be 
+ * used and the directory should be read instead, or another error if 
+ * loading it failed part way. 
+ */
+int rviReadCredentialBundle( TRviContext *ctx, 
+                             const unsigned char *certDigest )
 {
-    if( !handle || !cred ||  !rights ) { return EINVAL; }
+    if( !ctx || !ctx->credbundle || !certDigest ) { return EINVAL; }
+
+    int                 err     = RVI_ERR_NOCRED;
+    int                 fd;
+    struct stat         st;
+    unsigned char       *map    = MAP_FAILED;
+    size_t              size    = 0;
+    const unsigned char *end;
+    unsigned char       digest[SHA256_DIGEST_LENGTH];
+    size_t              valid   = 0;
+    uint32_t            count;
+    time_t              now;
+
+    fd = open( ctx->credbundle, O_RDONLY );
+    if( fd < 0 ) { return RVI_ERR_NOCRED; }
+    if( fstat( fd, &st ) == 0 && 
+        st.st_size >= RVI_BUNDLE_HEADER_SIZE + SHA256_DIGEST_LENGTH ) {
+        size = st.st_size;
+        map = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+    close( fd );
+    if( map == MAP_FAILED ) { return RVI_ERR_NOCRED; }
+    end = map + size - SHA256_DIGEST_LENGTH;
+
+    /* Nothing in the bundle is looked at until the whole of it checks out */
+    SHA256( map, end - map, digest );
+    if( memcmp( digest, end, SHA256_DIGEST_LENGTH ) != 0 ) { goto exit; }
+    if( memcmp( map, RVI_BUNDLE_MAGIC, 4 ) != 0 || 
+        rviBundleGet32( map + 4 ) != RVI_BUNDLE_VERSION ) 
+        goto exit;
 
-    TRviContext     *ctx = (TRviContext *)handle;
-    jwt_t           *jwt;
-    char            *key;
-    int             ret;
-    time_t          rawtime;
+    /* A bundle made for another CA or another device is stale */
+    if( rviPubkeyDigest( ctx->cakey, digest ) != RVI_OK || 
+        memcmp( digest, map + 16, SHA256_DIGEST_LENGTH ) != 0 || 
+        memcmp( certDigest, map + 16 + SHA256_DIGEST_LENGTH, 
+                SHA256_DIGEST_LENGTH ) != 0 ) 
+        goto exit;
 
-    key = rviGetPubkeyFile( ctx->cafile );
-    if( !key  ){ ret = -1; goto exit; }
+    /* Every entry is checked before any is loaded, so a bad one costs 
+     * nothing but the fall back to the credential directory */
+    count = rviBundleGet32( map + 8 );
+    time( &now );
+    if( ( err = rviBundleWalk( NULL, map + RVI_BUNDLE_HEADER_SIZE, end, 
+                               count, now, &valid ) ) ) 
+        goto exit;
+    if( !valid ) { err = RVI_ERR_NOCRED; goto exit; }
 
-    /* Load the JWT into memory from base64-encoded string */
-    ret = jwt_decode(&jwt, cred, (unsigned char *)key, strlen(key));
-    if( ret != 0 ) { goto exit; }
+    valid = 0;
+    err = rviBundleWalk( ctx, map + RVI_BUNDLE_HEADER_SIZE, end, count, now, 
+                         &valid );
 
-    /* Check that we are using public/private key cryptography */
-    if( jwt_get_alg( jwt ) != JWT_ALG_RS256 ) { ret = 1; goto exit; }
-    
-    /* Check validity: start/stop */
-    time(&rawtime);
-    json_t *validity = rviGetJsonGrant( jwt, "validity" );
+exit:
+    munmap( map, size );
 
-    int start = json_integer_value( json_object_get( validity, "start" ) );
-    int stop = json_integer_value( json_object_get( validity, "stop" ) );
+    return err;
+}
 
-    if( ( start > rawtime ) || ( stop < rawtime ) ) { ret = -1; goto exit; }
-    
-    /* Load the rights to receive */
-    json_t *receive = rviGetJsonGrant( jwt, "right_to_receive" );
-    char *rcv = json_dumps(receive, JSON_ENCODE_ANY);
-    json_decref(receive);
-    /* Load the right to invoke */
-    json_t *invoke = rviGetJsonGrant(jwt, "right_to_invoke" );
-    char *inv = json_dumps(invoke, JSON_ENCODE_ANY);
-    json_decref(invoke);
-
-    TRviRights *new = rviRightsCreate( rcv, inv, stop );
-
-    rviListInsert( rights, new );
- 
-    free( rcv );
+/* 
+ * This function returns the claims in the body of a decoded JWT as a JSON 
+ * object, which the caller must release. libjwt only hands out string and 
+ * integer grants, so the whole body is parsed once and every grant is read 
+ * from it. 
+ */
+json_t *rviGetJsonBody ( jwt_t *jwt )
+{
+    if( !jwt ) { return NULL; }
 
-    free( inv );
+    /* get token in plaintext */
+    char *plaintext = jwt_dump_str( jwt, 0 );
+    if( !plaintext ) { return NULL; }
 
-exit:
-    free(key);
-    jwt_free(jwt);
-    if ( validity ) json_decref( validity );
+    /* advance past header */
+    char *body = strchr( plaintext, '.' );
 
-    return ret;
+    json_t *claims = body ? 
+        json_loads( body + 1, JSON_REJECT_DUPLICATES, NULL ) : NULL;
+
+    free( plaintext );
+
+    return claims;
 }
 
-int rviRightToReceiveError( TRviList *rlist, const char *serviceName )
+/** Get arrays of rightToReceive and rightToInvoke */
+/* 
+ * This function adds the rights granted by a decoded credential to a rights 
+ * set. The credential must have been validated first. 
+ */
+int rviGetRightsFromCredential( TRviCredential *credential, 
+                                TRviRightsSet *rights )
 {
-    if( !rlist || !serviceName ) { return EINVAL; }
+    if( !credential || !rights ) { return EINVAL; }
 
-    int     err     = -1; /* By default, assume no rights */
-    json_t  *value  = NULL;
-    size_t  index;
+    TRviRights *new = rviRightsCreate( credential->receive, 
+                                       credential->invoke, 
+                                       credential->stop );
 
-    TRviListEntry *ptr = rlist->listHead;
-    while( ptr ) {
-        TRviRights *tmp = (TRviRights *)ptr->pointer;
-        if( !tmp ) goto exit;
-        //json_array_foreach( tmp->receive, index, value ) {
-        for( index = 0; 
-             index < json_array_size( tmp->receive ) && ( value = json_array_get( tmp->receive, index ) ); 
-             index ++) {
-            const char *pattern = json_string_value( value );
-            if( ( err = rviComparePattern( pattern, serviceName ) ) == RVI_OK )
-                goto exit; /* We found a match, exit immediately */
-        }
-        ptr = ptr->next;
-    }
+    return rviRightsSetAdd( rights, new );
+}
 
-exit:
-    return err;
+/* 
+ * These functions check a service name against the rights of a rights set. 
+ * They return RVI_OK if one of the patterns matches, or an error otherwise. 
+ */
+int rviRightToReceiveError( TRviRightsSet *rights, const char *serviceName )
+{
+    if( !rights || !serviceName ) { return EINVAL; }
+
+    return rviRightsSetCheck( rights, RVI_RIGHTS_RECEIVE, serviceName );
 }
 
-int rviRightToInvokeError( TRviList *rlist, const char *serviceName )
+int rviRightToInvokeError( TRviRightsSet *rights, const char *serviceName )
 {
-    if( !rlist || !serviceName ) { return EINVAL; }
+    if( !rights || !serviceName ) { return EINVAL; }
 
-    int     err     = -1; /* By default, assume no rights */
-    json_t  *value  = NULL;
-    size_t  index;
+    return rviRightsSetCheck( rights, RVI_RIGHTS_INVOKE, serviceName );
+}
 
-    TRviListEntry *ptr = rlist->listHead;
-    while( ptr ) {
-        TRviRights *tmp = (TRviRights *)ptr->pointer;
-        //json_array_foreach( tmp->invoke, index, value ) {
-        for( index = 0; 
-             index < json_array_size( tmp->invoke ) && ( value = json_array_get( tmp->invoke, index ) ); 
-             index ++) {
-            const char *pattern = json_string_value( value );
-            if( ( err = rviComparePattern( pattern, serviceName ) ) == RVI_OK )
-                goto exit; /* We found a match, exit immediately */
+/* 
+ * This function decides which of an array of remotes have the right to 
+ * invoke a service, setting bit i of the allowed bitmap for each remote i 
+ * that does. The bitmap must have room for count bits. 
+ * 
+ * Remotes whose credentials grant the same rights are grouped by the keys 
+ * of their rights sets, and the service is checked once for each group, so 
+ * many remotes holding copies of a few credentials cost a few checks. 
+ */
+int rviRightToInvokeRemotes( TRviRemote **remotes, size_t count, 
+                             const char *serviceName, uint64_t *allowed )
+{
+    if( !remotes || !serviceName || !allowed ) { return EINVAL; }
+
+    int             err;
+    TRviHashTable   groupIdx;
+    TRviRightsGroup *groups     = NULL;
+    TRviRightsGroup *group;
+    size_t          ngroups     = 0;
+    size_t          i;
+
+    memset( allowed, 0, RVI_BITMAP_WORDS( count ) * sizeof( uint64_t ) );
+    if( !count ) { return RVI_OK; }
+
+    groups = malloc( count * sizeof( TRviRightsGroup ) );
+    if( !groups ) { return ENOMEM; }
+    if( ( err = rviHashInitialize( &groupIdx, rviRightsGroupMatch ) ) ) {
+        free( groups );
+        return err;
+    }
+
+    for( i = 0; i < count; i++ ) {
+        TRviRightsSet *set = remotes[i]->rights;
+        if( !set ) { continue; }
+
+        group = set->key ? 
+                rviHashLookup( &groupIdx, set->keyHash, set->key ) : NULL;
+        if( !group ) {
+            group = &groups[ngroups++];
+            group->set = set;
+            group->allowed = 
+                !rviRightsSetCheck( set, RVI_RIGHTS_INVOKE, serviceName );
+            /* A group that cannot be indexed just isn't shared */
+            if( set->key )
+                rviHashInsert( &groupIdx, set->keyHash, group );
         }
-        ptr = ptr->next;
+        if( group->allowed )
+            RVI_BITMAP_SET( allowed, i );
     }
 
-exit:
-    return err;
+    rviHashDestroy( &groupIdx );
+    free( groups );
+
+    return RVI_OK;
+}
+
+/* 
+ * This function decides which of an array of services a rights set grants 
+ * the right of the given kind (RVI_RIGHTS_RECEIVE or RVI_RIGHTS_INVOKE) 
+ * for, setting bit i of the allowed bitmap for each service i that it 
+ * does. The bitmap must have room for count bits. 
+ * 
+ * The names are matched against the compiled patterns directly. Running a 
+ * whole batch through the decision cache would only push out the names 
+ * that are checked often. 
+ */
+int rviRightsSetCheckServices( TRviRightsSet *set, int kind, 
+                               TRviService **services, size_t count, 
+                               uint64_t *allowed )
+{
+    if( !set || !services || !allowed ) { return EINVAL; }
+
+    TRviRightsTrie  *trie;
+    size_t          i;
 
+    trie = ( kind == RVI_RIGHTS_RECEIVE ) ? &set->receive : &set->invoke;
+    memset( allowed, 0, RVI_BITMAP_WORDS( count ) * sizeof( uint64_t ) );
+
+    for( i = 0; i < count; i++ ) {
+        if( rviRightsTrieMatch( trie, services[i]->name ) )
+            RVI_BITMAP_SET( allowed, i );
+    }
+
+    return RVI_OK;
 }
 
 /** Get the public key from a certificate file */
@@ -814,97 +1903,475 @@ char *rviGetPubkeyFile( char *filename )
     /* Make sure it's null-formatted, just in case */
     key[length] = '\0';
 
-    ret = RVI_OK;
+    ret = RVI_OK;
+
+exit:
+    /* Free all the memory */
+    EVP_PKEY_free(pkey);
+    X509_free(cert);
+    BIO_free_all(certbio);
+    BIO_free_all(mbio);
+
+    if( ret != RVI_OK ) { return NULL; }
+    return key;
+}
+
+/* 
+ * Reload the public key of the trusted CA from the CA certificate file
+ */
+int rviRefreshCaKey( TRviHandle handle )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext     *ctx = (TRviContext *)handle;
+    char            *key;
+
+    /* If the file cannot be read, keep verifying with the old key */
+    key = rviGetPubkeyFile( ctx->cafile );
+    if( !key ) { return RVI_ERR_OPENSSL; }
+
+    free( ctx->cakey );
+    ctx->cakey = key;
+    ctx->cakeyLength = strlen( key );
+
+    /* Credentials verified with the old key must be verified again */
+    rviCredentialCacheFlush( ctx );
+
+    return RVI_OK;
+}
+
+/* 
+ * This function decodes a JWT credential and verifies its signature with the 
+ * CA's public key. Everything the library needs from the credential is 
+ * copied out of the token, so it is never decoded again. 
+ * 
+ * Returns the new credential, which must be freed with rviCredentialRelease, 
+ * or NULL if the token is not a credential signed by the CA. 
+ */
+TRviCredential *rviCredentialDecode( TRviHandle handle, const char *cred )
+{
+    if( !handle || !cred ) { return NULL; }
+
+    TRviContext     *ctx        = (TRviContext *)handle;
+    TRviCredential  *credential = NULL;
+    jwt_t           *jwt        = NULL;
+    json_t          *body       = NULL;
+    json_t          *validity;
+    const char      *deviceCert;
+    unsigned char   *der        = NULL;
+    size_t          derLength;
+
+    /* The public key of the trusted CA was loaded by rviInit */
+    if( !ctx->cakey ) { goto exit; }
+
+    /* If token does not pass sig check, libjwt supplies errno */
+    if( jwt_decode( &jwt, cred, (unsigned char *)ctx->cakey, 
+                    ctx->cakeyLength ) ) 
+        goto exit;
+
+    /* RVI credentials use RS256 */
+    if( jwt_get_alg( jwt ) != JWT_ALG_RS256 ) { goto exit; }
+
+    body = rviGetJsonBody( jwt );
+    if( !body ) { goto exit; }
+
+    credential = calloc( 1, sizeof( TRviCredential ) );
+    if( !credential ) { goto exit; }
+    credential->refs = 1;
+
+    validity = json_object_get( body, "validity" );
+    credential->start = json_integer_value( json_object_get( validity, 
+                                                             "start" ) );
+    credential->stop = json_integer_value( json_object_get( validity, 
+                                                            "stop" ) );
+
+    /* 
+     * Only the fingerprint of the device certificate is kept, so checking 
+     * the credential against a peer never parses a certificate. A cert 
+     * that is not base64 leaves hasDevice clear, and fails every check. 
+     */
+    deviceCert = json_string_value( json_object_get( body, "device_cert" ) );
+    if( deviceCert ) {
+        der = malloc( strlen( deviceCert ) / 4 * 3 + 3 );
+        if( !der ) {
+            rviCredentialRelease( credential );
+            credential = NULL;
+            goto exit;
+        }
+        if( rviBase64Decode( deviceCert, der, &derLength ) == RVI_OK ) {
+            SHA256( der, derLength, credential->deviceDigest );
+            credential->hasDevice = 1;
+        }
+    }
+
+    credential->receive = json_incref( json_object_get( body, 
+                                                        "right_to_receive" ) );
+    credential->invoke = json_incref( json_object_get( body, 
+                                                       "right_to_invoke" ) );
+
+exit:
+    free( der );
+    json_decref( body );
+    if( jwt ) jwt_free( jwt );
+
+    return credential;
+}
+
+/* 
+ * This function drops a reference to a decoded credential, and frees it 
+ * once nothing holds it any more. 
+ */
+void rviCredentialRelease( TRviCredential *credential )
+{
+    if( !credential || --credential->refs ) { return; }
+
+    json_decref( credential->receive );
+    json_decref( credential->invoke );
+    free( credential );
+}
+
+/* 
+ * This function compares a credential cache entry to a token digest, for 
+ * finding the entry in the cache. 
+ */
+int rviCredentialMatch ( void *record, const void *key )
+{
+    TRviCredentialEntry *entry = record;
+
+    return memcmp( entry->digest, key, SHA256_DIGEST_LENGTH ) == 0;
+}
+
+/* 
+ * This function takes an entry out of the credential cache and frees it. 
+ * The entry must already be out of the expiration heap. 
+ */
+void rviCredentialForget( TRviContext *ctx, TRviCredentialEntry *entry )
+{
+    uint64_t hash;
+
+    memcpy( &hash, entry->digest, sizeof( hash ) );
+    rviHashRemove( &ctx->credentialCache, hash, entry );
+    rviCredentialRelease( entry->credential );
+    free( entry );
+}
+
+/* This function forgets every credential in the credential cache */
+void rviCredentialCacheFlush( TRviContext *ctx )
+{
+    TRviCredentialEntry *entry;
+
+    while( ( entry = rviTimerExpire( &ctx->credentialExpirations, 
+                                     LONG_MAX ) ) )
+        rviCredentialForget( ctx, entry );
+}
+
+/* This function forgets the cached credentials that have expired by now */
+void rviCredentialCacheExpire( TRviContext *ctx, long now )
+{
+    TRviCredentialEntry *entry;
+
+    while( ( entry = rviTimerExpire( &ctx->credentialExpirations, now ) ) )
+        rviCredentialForget( ctx, entry );
+}
+
+/* 
+ * This function computes the SHA-256 digest of a token into digest and 
+ * looks the token up in the credential cache. 
+ * 
+ * Returns a new reference to the cached credential, or NULL if the token is 
+ * not in the cache. 
+ */
+TRviCredential *rviCredentialLookup( TRviContext *ctx, const char *cred, 
+                                     unsigned char *digest )
+{
+    TRviCredentialEntry *entry;
+    uint64_t            hash;
+
+    SHA256( (const unsigned char *)cred, strlen( cred ), digest );
+    memcpy( &hash, digest, sizeof( hash ) );
+
+    entry = rviHashLookup( &ctx->credentialCache, hash, digest );
+    if( !entry ) { return NULL; }
+
+    entry->credential->refs++;
+
+    return entry->credential;
+}
+
+/* 
+ * This function remembers a newly decoded credential in the credential 
+ * cache under the digest of its token. When the cache is full, the 
+ * credential that expires first is forgotten to make room. If the token 
+ * was cached in the meantime, the cached credential replaces the new one. 
+ * 
+ * Returns the credential to use, which the caller holds a reference to. 
+ */
+TRviCredential *rviCredentialRemember( TRviContext *ctx, 
+                                       const unsigned char *digest, 
+                                       TRviCredential *credential )
+{
+    TRviCredentialEntry *entry;
+    uint64_t            hash;
+
+    memcpy( &hash, digest, sizeof( hash ) );
+
+    entry = rviHashLookup( &ctx->credentialCache, hash, digest );
+    if( entry ) {
+        rviCredentialRelease( credential );
+        entry->credential->refs++;
+        return entry->credential;
+    }
+
+    if( rviHashGetCount( &ctx->credentialCache ) >= 
+        RVI_CREDENTIAL_CACHE_SIZE ) {
+        entry = rviTimerExpire( &ctx->credentialExpirations, LONG_MAX );
+        if( entry ) rviCredentialForget( ctx, entry );
+    }
+
+    /* If the credential cannot be remembered, it is simply not cached */
+    entry = malloc( sizeof( TRviCredentialEntry ) );
+    if( !entry ) { return credential; }
+    memcpy( entry->digest, digest, SHA256_DIGEST_LENGTH );
+    entry->credential = credential;
+
+    if( rviHashInsert( &ctx->credentialCache, hash, entry ) ) {
+        free( entry );
+        return credential;
+    }
+    if( rviTimerInsert( &ctx->credentialExpirations, credential->stop, 
+                        entry ) ) {
+        rviHashRemove( &ctx->credentialCache, hash, entry );
+        free( entry );
+        return credential;
+    }
+    credential->refs++;
+
+    return credential;
+}
+
+/* 
+ * This function returns the decoded and verified form of a token. A token 
+ * that was verified before is found in the credential cache by the SHA-256 
+ * digest of its text, without checking its signature again; otherwise it 
+ * is decoded and verified, and then remembered until it expires. 
+ * 
+ * A cached credential is only as good as its signature. It must still be 
+ * checked against the peer's certificate with rviValidateCredential. 
+ * 
+ * Returns the credential, which must be released with 
+ * rviCredentialRelease, or NULL if the token is not a valid credential. 
+ */
+TRviCredential *rviCredentialGet( TRviHandle handle, const char *cred )
+{
+    if( !handle || !cred ) { return NULL; }
+
+    TRviContext         *ctx    = (TRviContext *)handle;
+    TRviCredential      *credential;
+    unsigned char       digest[SHA256_DIGEST_LENGTH];
+    long                now     = time( NULL );
+
+    rviCredentialCacheExpire( ctx, now );
+
+    credential = rviCredentialLookup( ctx, cred, digest );
+    if( credential ) { return credential; }
 
-exit:
-    /* Free all the memory */
-    EVP_PKEY_free(pkey);
-    X509_free(cert);
-    BIO_free_all(certbio);
-    BIO_free_all(mbio);
+    credential = rviCredentialDecode( handle, cred );
+    if( !credential || credential->stop <= now ) { return credential; }
 
-    if( ret != RVI_OK ) { return NULL; }
-    return key;
+    return rviCredentialRemember( ctx, digest, credential );
 }
 
-/** 
- * This function tests whether a credential is valid.
- *
- * Tests:
- *  * Signed by trusted authority
- *  * Timestamp is valid
- *  * Embedded device cert matches supplied cert
- *
- * @param[in] handle    - handle to the RVI context
- * @param[in] cred      - JWT-encoded RVI credential
- * @param[in] cert      - the expected certificate for the device, e.g., peer certificate
- *
- * @return RVI_OK (0) on success, or an error code on failure.
+/* This function decodes one token of a batch, in a worker thread */
+void rviCredentialDecodeTask( void *context, size_t index )
+{
+    TRviCredentialBatch *batch = context;
+
+    if( batch->creds[index] )
+        batch->credentials[index] = rviCredentialDecode( batch->handle, 
+                                                         batch->creds[index] );
+}
+
+/* 
+ * This function decodes and verifies a batch of tokens on the context's 
+ * worker threads, storing the credential for creds[i] in credentials[i] 
+ * (NULL if it is not valid). Entries of creds that are NULL are skipped and 
+ * their credentials are left as they are. 
+ * 
+ * Decoding only reads the context, so the tokens can be verified in any 
+ * order; the results come back in the order of the batch. 
  */
-int rviValidateCredential( TRviHandle handle, const char *cred, X509 *cert )
+int rviCredentialDecodeBatch( TRviHandle handle, const char **creds, 
+                              size_t count, TRviCredential **credentials )
 {
-    if( !handle || !cred ) { return EINVAL; }
+    if( !handle || ( count && ( !creds || !credentials ) ) ) { return EINVAL; }
 
-    int             ret;
-    TRviContext     *ctx = (TRviContext *)handle;
-    char            *key;
-    jwt_t           *jwt;
-    long            length;
-    time_t          rawtime;
-    BIO             *bio = {0};
-    X509            *dcert = {0};
-    const char      certHead[] = "-----BEGIN CERTIFICATE-----\n";
-    const char      certFoot[] = "\n-----END CERTIFICATE-----";
+    TRviContext         *ctx    = (TRviContext *)handle;
+    TRviCredentialBatch batch   = { handle, creds, credentials };
 
-    ret = RVI_OK;
+    return rviPoolRun( &ctx->pool, count, rviCredentialDecodeTask, &batch );
+}
 
-    /* Get the public key from the trusted CA */
-    key = rviGetPubkeyFile( ctx->cafile );
+/* 
+ * This function is rviCredentialGet for a batch of tokens. The cache is 
+ * consulted for all of them first, then the tokens that were not in it are 
+ * verified together on the worker threads, and finally those are added to 
+ * the cache in the order of the batch. Each credential stored in 
+ * credentials must be released by the caller. 
+ */
+int rviCredentialGetBatch( TRviHandle handle, const char **creds, 
+                           size_t count, TRviCredential **credentials )
+{
+    if( !handle || ( count && ( !creds || !credentials ) ) ) { return EINVAL; }
 
-    if( !key ) { ret = -1; goto exit; }
+    TRviContext     *ctx    = (TRviContext *)handle;
+    unsigned char   (*digests)[SHA256_DIGEST_LENGTH] = NULL;
+    const char      **misses = NULL;
+    long            now     = time( NULL );
+    size_t          i;
+    int             err;
 
-    length = strlen(key) + 1;
+    memset( credentials, 0, count * sizeof( TRviCredential * ) );
+    if( !count ) { return RVI_OK; }
 
-    /* If token does not pass sig check, libjwt supplies errno */
-    ret = jwt_decode( &jwt, cred, (unsigned char *)key, length );
-    if( ret ) {
+    digests = malloc( count * sizeof( *digests ) );
+    misses = malloc( count * sizeof( char * ) );
+    if( !digests || !misses ) { err = ENOMEM; goto exit; }
+
+    rviCredentialCacheExpire( ctx, now );
+
+    for( i = 0; i < count; i++ ) {
+        if( creds[i] )
+            credentials[i] = rviCredentialLookup( ctx, creds[i], digests[i] );
+        misses[i] = credentials[i] ? NULL : creds[i];
+    }
+
+    if( ( err = rviCredentialDecodeBatch( handle, misses, count, 
+                                          credentials ) ) )
         goto exit;
+
+    for( i = 0; i < count; i++ ) {
+        if( misses[i] && credentials[i] && credentials[i]->stop > now )
+            credentials[i] = rviCredentialRemember( ctx, digests[i], 
+                                                    credentials[i] );
     }
 
-    /* RVI credentials use RS256 */
-    if( jwt_get_alg( jwt ) != JWT_ALG_RS256 ) { ret = 1; goto exit; }
+exit:
+    free( digests );
+    free( misses );
 
-    /* Check validity: start/stop */
-    time(&rawtime);
-    json_t *validity = rviGetJsonGrant( jwt, "validity" );
+    return err;
+}
+
+/* 
+ * This function returns the value of a base64 digit, or -1 if the character 
+ * is not one. 
+ */
+int rviBase64Value( int c )
+{
+    if( c >= 'A' && c <= 'Z' ) return c - 'A';
+    if( c >= 'a' && c <= 'z' ) return c - 'a' + 26;
+    if( c >= '0' && c <= '9' ) return c - '0' + 52;
+    if( c == '+' ) return 62;
+    if( c == '/' ) return 63;
+
+    return -1;
+}
 
-    int start = json_integer_value( json_object_get( validity, "start" ) );
-    int stop = json_integer_value( json_object_get( validity, "stop" ) );
+/* 
+ * This function decodes base64 text into out, which must have room for 3 
+ * bytes for every 4 characters of the text. Whitespace is skipped, as it is 
+ * in the body of a PEM file, and the text may end with '=' padding. 
+ * 
+ * Returns RVI_OK and sets length to the number of bytes decoded, or 
+ * RVI_ERR_JSON if the text is not base64. 
+ */
+int rviBase64Decode( const char *in, unsigned char *out, size_t *length )
+{
+    if( !in || !out || !length ) { return EINVAL; }
 
-    if( ( start > rawtime ) || ( stop < rawtime ) ) { ret = -1; goto exit; }
+    unsigned long   bits    = 0;    /* Digits not yet written out */
+    int             held    = 0;    /* Number of digits in bits */
+    int             padding = 0;
+    int             value;
+    size_t          n       = 0;
 
-    const char *deviceCert = jwt_get_grant( jwt, "device_cert" );
-    char *tmp = malloc( strlen( deviceCert ) + strlen( certHead ) 
-                        + strlen ( certFoot ) + 1 );
-    if( !tmp ) { ret = ENOMEM; goto exit; }
-    sprintf(tmp, "%s%s%s", certHead, deviceCert, certFoot);
+    for( ; *in; in++ ) {
+        if( *in == ' ' || *in == '\t' || *in == '\r' || *in == '\n' )
+            continue;
+        if( *in == '=' ) { padding++; continue; }
+        /* Nothing but whitespace and padding may follow the padding */
+        if( padding || ( value = rviBase64Value( *in ) ) < 0 )
+            return RVI_ERR_JSON;
+        bits = ( bits << 6 ) | value;
+        if( ++held == 4 ) {
+            out[n++] = ( unsigned char )( bits >> 16 );
+            out[n++] = ( unsigned char )( bits >> 8 );
+            out[n++] = ( unsigned char )bits;
+            bits = 0;
+            held = 0;
+        }
+    }
 
-    /* Check that certificate in credential matches expected cert */
-    bio = BIO_new( BIO_s_mem() );
-    BIO_puts( bio, (const char *)tmp );
-    dcert = PEM_read_bio_X509( bio, NULL, 0, NULL );
-    if( !dcert ) { ret = RVI_ERR_OPENSSL; goto exit; }
-    ret = X509_cmp( dcert, cert );
+    /* A final group of 2 or 3 digits holds 1 or 2 bytes */
+    if( held == 1 || ( padding && held + padding != 4 ) )
+        return RVI_ERR_JSON;
+    if( held == 2 ) {
+        out[n++] = ( unsigned char )( bits >> 4 );
+    } else if( held == 3 ) {
+        out[n++] = ( unsigned char )( bits >> 10 );
+        out[n++] = ( unsigned char )( bits >> 2 );
+    }
+    *length = n;
 
-exit:
-    jwt_free( jwt );
-    if( key ) free( key );
-    if( validity ) json_decref( validity );
-    if( tmp ) free( tmp );
-    BIO_free_all( bio );
-    X509_free( dcert );
+    return RVI_OK;
+}
 
-    return ret;
+/* 
+ * This function computes the SHA-256 fingerprint of a certificate's DER 
+ * encoding, which is what the device certificate in a credential is reduced 
+ * to when the credential is decoded. 
+ * 
+ * Returns RVI_OK, or RVI_ERR_OPENSSL if the digest cannot be computed. 
+ */
+int rviCertDigest( X509 *cert, unsigned char *digest )
+{
+    if( !cert || !digest ) { return EINVAL; }
+
+    unsigned int    length;
+
+    if( !X509_digest( cert, EVP_sha256(), digest, &length ) )
+        return RVI_ERR_OPENSSL;
+
+    return RVI_OK;
+}
+
+/* 
+ * This function checks that a decoded credential is valid now and that it 
+ * was issued for the device whose certificate has the given fingerprint, 
+ * as computed by rviCertDigest. 
+ * 
+ * Returns RVI_OK if it is, or an error otherwise. 
+ */
+int rviValidateCredential( TRviCredential *credential, 
+                           const unsigned char *certDigest )
+{
+    if( !credential || !certDigest ) { return EINVAL; }
+
+    time_t          rawtime;
+
+    /* Check validity: start/stop */
+    time(&rawtime);
+    if( ( credential->start > rawtime ) || ( credential->stop < rawtime ) )
+        return -1;
+
+    if( !credential->hasDevice ) { return RVI_ERR_JSON; }
+
+    /* Check that certificate in credential matches expected cert */
+    if( memcmp( credential->deviceDigest, certDigest, 
+                SHA256_DIGEST_LENGTH ) != 0 )
+        return -1;
+
+    return RVI_OK;
 }
 
 /*
@@ -934,7 +2401,7 @@ TRviHandle rviInit ( char *configFilename )
     /* Allocate a block of memory for storing credentials, then initialize each 
      * pointer to null */
     ctx->creds = malloc( sizeof( TRviList ) );
-    ctx->rights = malloc( sizeof( TRviList ) );
+    ctx->rights = rviRightsSetCreate();
 
     if( !ctx->creds || !ctx->rights ) {
         fprintf(stderr, "Unable to allocate memory\n");
@@ -942,7 +2409,15 @@ TRviHandle rviInit ( char *configFilename )
     }
 
     rviListInitialize( ctx->creds );
-    rviListInitialize( ctx->rights );
+    rviTimerInitialize( &ctx->expirations );
+    rviHashInitialize( &ctx->credentialCache, rviCredentialMatch );
+    rviTimerInitialize( &ctx->credentialExpirations );
+
+    /* Start one worker thread for each additional processor */
+    if( rviPoolInitialize( &ctx->pool, RVI_VERIFY_THREADS ) != 0 ) {
+        fprintf(stderr, "Unable to start worker threads\n");
+        goto err;
+    }
     
     if ( rviReadJsonConfig ( ctx, configFilename ) != 0 ) {
         fprintf(stderr, "Error reading config file\n");
@@ -954,16 +2429,14 @@ TRviHandle rviInit ( char *configFilename )
         goto err;
     }
 
-    TRviListEntry *ptr = ctx->creds->listHead;
-    while( ptr ) {
-        int ret = rviGetRightsFromCredential( ctx, (char *)ptr->pointer, 
-                                         ctx->rights );
-        if( ret != RVI_OK ) { goto err; }
-        ptr = ptr->next;
+    if ( !(ctx->rights->list.count) ) {
+        fprintf(stderr, "Error: no rights available\n");
+        goto err;
     }
 
-    if ( !(ctx->rights->count) ) {
-        fprintf(stderr, "Error: no rights available\n");
+    /* Withdraw this node's rights when its credentials expire */
+    if( rviRightsSetSchedule( ctx, ctx->rights ) != RVI_OK ) {
+        fprintf(stderr, "Unable to allocate memory\n");
         goto err;
     }
 
@@ -977,29 +2450,66 @@ TRviHandle rviInit ( char *configFilename )
     /*  
      * Create empty btrees for indexing remote connections and services. 
      * 
-     * Since we expect that records will frequently be added and removed, use a 
-     * small order for each tree. This means that the tree will be deeper, but 
-     * addition/deletion will usually result in simply changing pointers rather 
-     * than copying data. 
+     * Rather than a fixed order, each tree sizes its nodes to the memory 
+     * geometry of the machine. Nodes are searched with a binary search, so a 
+     * wide node costs a few compares but saves a cache miss for every level 
+     * that the tree is made shallower. The service trees can grow large and 
+     * use page-sized nodes. 
+     *
+     * Each tree also keeps a fingerprint of every record's key inside its 
+     * nodes, so a search only follows a record pointer when the fingerprints 
+     * tie. 
+     *
+     * The trees are kept in B+ mode: every record is stored in a leaf and the 
+     * leaves are linked, so listing the connections or services and building 
+     * announcements is a walk along the leaf arrays. The keys of both trees 
+     * are unique, as B+ mode requires. 
+     *
+     * All of the trees draw their nodes from this context's arena.
      */
+    btree_allocator_t allocator = { rviArenaAlloc, rviArenaFree, &ctx->arena };
+    rviArenaInitialize( &ctx->arena, 0 );
     
     /*   
-     * Remote connections will be indexed by the socket's file descriptor.    
+     * Remote connections will be indexed by the socket's file descriptor. 
+     * Descriptors are small and dense, so they index a table directly. 
      */  
-    ctx->remoteIdx = btree_create(2, rviCompareFd);
+    rviFdTableInitialize( &ctx->remoteIdx );
 
     /*   
      * Services will be indexed by the fully-qualified service name, which is
      * unique across the RVI infrastructure. 
      */  
-    ctx->serviceNameIdx = btree_create(2, rviCompareName);
+    ctx->serviceNameIdx = btree_create_sized(BTREE_NODE_PAGE, rviCompareName, 
+                                             &allocator);
+    if( !ctx->serviceNameIdx || 
+        btree_set_fingerprint(ctx->serviceNameIdx, rviFingerprintName) != 0 ||
+        btree_set_bplus(ctx->serviceNameIdx, true) != 0 )
+        goto err;
 
     /*
      * Services will also be indexed by the file descriptor of the entity 
      * registering the service. Service names are used as a tie-breaker to 
      * ensure each record has a unique position in the tree. 
      */
-    ctx->serviceRegIdx = btree_create(2, rviCompareRegistrant);
+    ctx->serviceRegIdx = btree_create_sized(BTREE_NODE_PAGE, 
+                                            rviCompareRegistrant, &allocator);
+    if( !ctx->serviceRegIdx || 
+        btree_set_fingerprint(ctx->serviceRegIdx, 
+                              rviFingerprintRegistrant) != 0 ||
+        btree_set_bplus(ctx->serviceRegIdx, true) != 0 )
+        goto err;
+
+    /*
+     * Exact lookups by name are served by a hash table rather than the name 
+     * index, so they do not slow down as the number of services grows. 
+     */
+    rviHashInitialize( &ctx->serviceHash, rviServiceMatch );
+    rviInternInitialize( &ctx->names );
+#ifdef RVI_SERVICE_TRIE
+    if( rviTrieInitialize( &ctx->serviceTrie ) != 0 )
+        goto err;
+#endif
     
     return (TRviHandle)ctx;
 
@@ -1018,8 +2528,7 @@ int rviCleanup(TRviHandle handle)
     if( !handle ) { return EINVAL; }
 
     TRviContext * ctx = (TRviContext *)handle;
-    TRviRemote *  rtmp;
-    TRviService * stmp;
+    int           fd;
 
     /* free all SSL structs */
     SSL_CTX_free(ctx->sslCtx);
@@ -1029,54 +2538,36 @@ int rviCleanup(TRviHandle handle)
      */
     
     /*  
-     * As long as the context contains remote connections, find the first 
-     * struct in the tree, and disconnect the corresponding file descriptor. 
-     * The disconnect function removes the entry from the tree and frees the 
-     * underlying memory. 
+     * Every remote connection is closed and freed in a single walk of the 
+     * remote table. Their services are freed along with all of the others 
+     * below, so nothing has to be removed from the trees one record at a 
+     * time. 
      */
-
-    if(ctx->remoteIdx) {
-        while(ctx->remoteIdx->count != 0) {
-            rtmp = (TRviRemote *)ctx->remoteIdx->root->dataRecords[0];
-            if(!rtmp) {
-                perror("Getting remote data in cleanup"); 
-                break;
-            }
-            /* Disconnect the remote SSL connection, delete the entry from the 
-            * tree & free the remote struct */
-            rviDisconnect(handle, rtmp->fd);
-        }
-        btree_destroy(ctx->remoteIdx);
+    for( fd = rviFdTableNext( &ctx->remoteIdx, -1 ); fd >= 0; 
+         fd = rviFdTableNext( &ctx->remoteIdx, fd ) ) {
+        rviRemoteDestroy( rviFdTableLookup( &ctx->remoteIdx, fd ) );
     }
+    rviFdTableDestroy( &ctx->remoteIdx );
 
     /* 
-     * As long as the context contains services, find the first struct from 
-     * either service tree. Delete the entry from each service tree, then free 
-     * the underlying memory. 
+     * Each service is in both service trees. The registrant index only 
+     * shares the records, so it is destroyed without visiting them, and the 
+     * services are freed while the name index is destroyed. 
      */
-    if(ctx->serviceNameIdx) {
-        while(ctx->serviceNameIdx->count != 0) {
-            /* Delete the first data record in the root node */
-            stmp = (TRviService *)ctx->serviceNameIdx->root->dataRecords[0];
-            if ( !stmp ) {
-                perror("Getting service data in cleanup"); 
-                break;
-            }
-            /* Delete the entry from the service name index */
-            btree_delete ( ctx->serviceNameIdx, 
-                           ctx->serviceNameIdx->root, stmp);
-            /* Delete the entry from the service registrant index */
-            btree_delete ( ctx->serviceRegIdx, 
-                           ctx->serviceRegIdx->root, stmp);
-            /* Free the service memory */
-            rviServiceDestroy ( stmp );
-        }
-
-        /* Destroy both service trees */
-        btree_destroy(ctx->serviceNameIdx);
-
+    if(ctx->serviceRegIdx) {
         btree_destroy(ctx->serviceRegIdx);
     }
+    if(ctx->serviceNameIdx) {
+        btree_destroy_with(ctx->serviceNameIdx, rviServiceRelease, ctx);
+    }
+    rviHashDestroy( &ctx->serviceHash );
+#ifdef RVI_SERVICE_TRIE
+    rviTrieDestroy( &ctx->serviceTrie );
+#endif
+    rviInternDestroy( &ctx->names );
+
+    /* Release the node memory of all of the trees at once */
+    rviArenaDestroy( &ctx->arena );
 
     /* Free all credentials and other entities set when parsing config */
     rviCredentialListDestroy( ctx->creds );
@@ -1087,14 +2578,25 @@ int rviCleanup(TRviHandle handle)
         free ( ctx->keyfile );
     if( ctx->cafile )
         free ( ctx->cafile );
+    if( ctx->cakey )
+        free ( ctx->cakey );
     if( ctx->cadir )
         free ( ctx->cadir );
     if( ctx->creddir )
         free ( ctx->creddir );
+    if( ctx->credbundle )
+        free ( ctx->credbundle );
     if( ctx->id )
         free ( ctx->id );
 
-    rviRightsListDestroy( ctx->rights );
+    rviRightsSetDestroy( ctx->rights );
+    rviTimerDestroy( &ctx->expirations );
+
+    rviCredentialCacheFlush( ctx );
+    rviHashDestroy( &ctx->credentialCache );
+    rviTimerDestroy( &ctx->credentialExpirations );
+
+    rviPoolDestroy( &ctx->pool );
 
     /* Free the memory allocated to the TRviContext struct */
     free(ctx);
@@ -1119,6 +2621,7 @@ int rviConnect(TRviHandle handle, const char *addr, const char *port)
     TRviRemote    *remote = NULL;
     TRviContext   *ctx    = (TRviContext *)handle;
     int ret;
+    int fd;
 
     ret = RVI_OK;
 
@@ -1151,20 +2654,16 @@ int rviConnect(TRviHandle handle, const char *addr, const char *port)
     BIO_set_conn_port(sbio, port);
 
     /* check if we're already connected to that host... */
-    if( ctx->remoteIdx->count ) {
-        btree_iter iter = btree_iter_begin( ctx->remoteIdx );
-        while( !btree_iter_at_end( iter ) ) {
-            TRviRemote *rtmp = btree_iter_data( iter );
-            if( 0 == strcmp( BIO_get_conn_hostname ( sbio ), 
-                             BIO_get_conn_hostname( rtmp->sbio )
-                           )  
-              ) { /* We already have a connection to that host */
-                ret = -1;
-                break;
-            }
-            btree_iter_next( iter );
+    for( fd = rviFdTableNext( &ctx->remoteIdx, -1 ); fd >= 0; 
+         fd = rviFdTableNext( &ctx->remoteIdx, fd ) ) {
+        TRviRemote *rtmp = rviFdTableLookup( &ctx->remoteIdx, fd );
+        if( 0 == strcmp( BIO_get_conn_hostname ( sbio ), 
+                         BIO_get_conn_hostname( rtmp->sbio )
+                       )  
+          ) { /* We already have a connection to that host */
+            ret = -1;
+            break;
         }
-        btree_iter_cleanup( iter );
     }
     if( ret != RVI_OK ) goto err;
 
@@ -1180,8 +2679,8 @@ int rviConnect(TRviHandle handle, const char *addr, const char *port)
 
     remote = rviRemoteCreate ( sbio, SSL_get_fd ( ssl ) );
 
-    /* Add this data structure to our lookup tree */
-    btree_insert(ctx->remoteIdx, remote);
+    /* Add this data structure to our lookup table */
+    rviFdTableInsert( &ctx->remoteIdx, remote->fd, remote );
     
     rviWriteAu( handle, remote ); 
     
@@ -1212,34 +2711,27 @@ int rviDisconnect(TRviHandle handle, int fd)
     if( !handle || fd < 3 ) { return -EINVAL; }
     
     TRviContext * ctx = (TRviContext *)handle;
-    TRviRemote    rkey = {0};
     TRviRemote *  rtmp;
     TRviService   skey = {0};
-    TRviService * stmp;
-    int             res;
     
-    rkey.fd = fd;
-
-    rtmp = btree_search(ctx->remoteIdx, &rkey);
+    rtmp = rviFdTableRemove( &ctx->remoteIdx, fd );
     if(!rtmp) {
         return -ENXIO;
     }
 
-    if( ( res = btree_delete(ctx->remoteIdx, 
-                             ctx->remoteIdx->root, rtmp ) ) < 0 ) {
-        return res;
-    } 
-    /* Search the service tree for any services registered by the remote */
+    /* 
+     * Remove all of the services registered by the remote. A key without a 
+     * name compares equal to every service of the registrant, so they form a 
+     * single range of the registrant index. Each removed service is then 
+     * taken out of the name index and freed. 
+     */
     skey.registrant = fd;
-    while((stmp = btree_search(ctx->serviceRegIdx, &skey))) {
-        /* We have a match, so delete the service and free the node from
-        * the tree */
-        btree_delete(ctx->serviceNameIdx, ctx->serviceNameIdx->root, stmp);
-        btree_delete(ctx->serviceRegIdx, ctx->serviceRegIdx->root, stmp);
-        /* Close connection & free memory for the service structure */
-        rviServiceDestroy(stmp);
-    }
+    btree_delete_range(ctx->serviceRegIdx, &skey, &skey, 
+                       rviServiceDiscard, ctx);
 
+    rviTimerRemove( &ctx->expirations, rtmp->rights );
+    ctx->rightsCacheHits += rtmp->rights->cache.hits;
+    ctx->rightsCacheMisses += rtmp->rights->cache.misses;
     rviRemoteDestroy( rtmp );
 
     return RVI_OK;
@@ -1254,24 +2746,16 @@ int rviGetConnections(TRviHandle handle, int *conn, int *connSize)
 
     TRviContext *ctx = (TRviContext *)handle;
 
-    if( ctx->remoteIdx->count == 0 ) {
-        *connSize = 0;
-        return RVI_OK;
-    }
-    btree_iter iter = btree_iter_begin( ctx->remoteIdx );
     int i = 0;
-    while( ! btree_iter_at_end( iter ) ) {
+    int fd;
+    for( fd = rviFdTableNext( &ctx->remoteIdx, -1 ); fd >= 0; 
+         fd = rviFdTableNext( &ctx->remoteIdx, fd ) ) {
         if( i == *connSize )
             break;
-        TRviRemote *remote = btree_iter_data( iter );
-        if( ! remote )
-            break;
-        *conn++ = remote->fd ;
+        *conn++ = fd;
         i++;
-        btree_iter_next( iter );
     }
     *connSize = i;
-    btree_iter_cleanup( iter );
 
     return RVI_OK;
 }
@@ -1298,15 +2782,27 @@ int rviRegisterService( TRviHandle handle, const char *serviceName,
 
     fqsn = rviFqsnGet( handle, serviceName );
     if( !fqsn ) { return ENOMEM; }
+
+    /* Make sure that expired rights are gone before checking them */
+    rviProcessExpirations( handle );
     
     if( (err = rviRightToReceiveError( ctx->rights, fqsn ) ) ) {
         goto exit;
     }
 
     /* Create a new TRviService structure */
-    service = rviServiceCreate( fqsn, 0, callback, serviceData, dataSize );
+    service = rviServiceCreate( &ctx->names, fqsn, 0, callback, 
+                                serviceData, dataSize );
+    if( !service ) {
+        err = ENOMEM;
+        goto exit;
+    }
 
     /* Add service to services by name */
+    if( ( err = rviServiceAddName( ctx, service ) ) ) {
+        rviServiceDestroy( &ctx->names, service );
+        goto exit;
+    }
     btree_insert( ctx->serviceNameIdx, service );
     /* Add service to services by registrant */
     btree_insert( ctx->serviceRegIdx, service );
@@ -1328,10 +2824,11 @@ int rviUnregisterService(TRviHandle handle, const char *serviceName)
 
     int             err     = RVI_OK;
     TRviContext     *ctx    = (TRviContext *)handle;
-    TRviService     skey    = { 0 };
+    char            *fqsn   = NULL;
     
-    skey.name = rviFqsnGet( handle, serviceName );
-    TRviService *stmp = btree_search( ctx->serviceNameIdx, &skey );
+    fqsn = rviFqsnGet( handle, serviceName );
+    if( !fqsn ) { return ENOMEM; }
+    TRviService *stmp = rviServiceLookup( ctx, fqsn );
     
     if( !stmp ) {
         err = -ENXIO;
@@ -1345,10 +2842,10 @@ int rviUnregisterService(TRviHandle handle, const char *serviceName)
 
     rviServiceAnnounce( handle, stmp, 0 );
 
-    err = rviRemoveService( handle, skey.name );
+    err = rviRemoveService( handle, fqsn );
 
 exit:
-    free( skey.name );
+    free( fqsn );
 
     return err;
 }
@@ -1358,18 +2855,14 @@ int rviRemoveService(TRviHandle handle, const char *serviceName)
     if( !handle || !serviceName ) { return EINVAL; }
 
     TRviContext   *ctx    = (TRviContext *)handle;
-    TRviService   skey    = { 0 };
     
-    skey.name = strdup( serviceName );
-    TRviService *stmp = btree_search( ctx->serviceNameIdx, &skey );
-    free( skey.name );
+    TRviService *stmp = rviServiceLookup( ctx, serviceName );
     
     if( !stmp ) { return ENOENT; }
-    btree_delete( ctx->serviceNameIdx, 
-                          ctx->serviceNameIdx->root, stmp );
-    btree_delete( ctx->serviceRegIdx, 
-                          ctx->serviceRegIdx->root, stmp );
-    rviServiceDestroy( stmp );
+    rviServiceRemoveName( ctx, stmp );
+    btree_delete( ctx->serviceNameIdx, ctx->serviceNameIdx->root, stmp );
+    btree_delete( ctx->serviceRegIdx, ctx->serviceRegIdx->root, stmp );
+    rviServiceDestroy( &ctx->names, stmp );
 
     return RVI_OK;
 }
@@ -1388,20 +2881,50 @@ int rviGetServices(TRviHandle handle, char **result, int *len)
         return RVI_OK;
     }
 
-    btree_iter iter = btree_iter_begin( ctx->serviceNameIdx );
+    btree_iterator_t iter;
+    btree_iter_begin_init( &iter, ctx->serviceNameIdx );
     int i = 0;
-    while( ! btree_iter_at_end( iter ) ) {
+    while( ! btree_iter_at_end( &iter ) ) {
         if( i == *len )
             break;
-        TRviService *service = btree_iter_data( iter );
+        TRviService *service = btree_iter_data( &iter );
         if( ! service )
             break;
         *result++ = strdup( service->name );
         i++;
-        btree_iter_next( iter );
+        btree_iter_next( &iter );
     }
     *len = i;
-    btree_iter_cleanup( iter );
+
+    return RVI_OK;
+}
+
+/* 
+ * Get list of services matching a pattern
+ */
+int rviFindServices(TRviHandle handle, const char *pattern, char **result, 
+                    int *len)
+{
+    if( !handle || !pattern || !result || ( *len < 1 ) ) { return EINVAL; }
+
+    TRviContext *ctx = (TRviContext *)handle;
+    TRviFindResult find = { result, *len, 0 };
+
+#ifdef RVI_SERVICE_TRIE
+    /* Only the branches of the trie that can match are visited */
+    rviTrieWalk( &ctx->serviceTrie, pattern, rviFindVisit, &find );
+#else
+    btree_iterator_t iter;
+    btree_iter_begin_init( &iter, ctx->serviceNameIdx );
+    while( ! btree_iter_at_end( &iter ) ) {
+        TRviService *service = btree_iter_data( &iter );
+        if( rviComparePattern( pattern, service->name ) == RVI_OK &&
+            rviFindVisit( service, &find ) )
+            break;
+        btree_iter_next( &iter );
+    }
+#endif
+    *len = find.count;
 
     return RVI_OK;
 }
@@ -1416,9 +2939,7 @@ int rviInvokeService(TRviHandle handle, const char *serviceName,
     /* get service from service name index */
 
     TRviContext *ctx = (TRviContext *)handle;
-    TRviService skey = {0};
     TRviService *stmp = NULL;
-    TRviRemote rkey = {0};
     TRviRemote *rtmp = NULL;
     time_t rawtime; /* the unix epoch time for the current time */
     int wait = 1000; /* the timeout length in ms */
@@ -1427,15 +2948,11 @@ int rviInvokeService(TRviHandle handle, const char *serviceName,
     json_t *rcv;
     int ret;
     
-    skey.name = strdup(serviceName);
-
-    stmp = btree_search(ctx->serviceNameIdx, &skey);
+    stmp = rviServiceLookup( ctx, serviceName );
     if( !stmp ) { ret = ENOENT; goto exit; }
 
     /* identify registrant, get SSL session from remote index */
-    rkey.fd = stmp->registrant;
-
-    rtmp = btree_search(ctx->remoteIdx, &rkey);
+    rtmp = rviFdTableLookup( &ctx->remoteIdx, stmp->registrant );
     if( !rtmp ) { ret = ENXIO; goto exit; }
 
     time(&rawtime);
@@ -1473,8 +2990,6 @@ int rviInvokeService(TRviHandle handle, const char *serviceName,
     ret = 0;
 
 exit:
-    free(skey.name);
-
     return ret;
 }
 
@@ -1487,8 +3002,8 @@ int rviProcessInput(TRviHandle handle, int *fdArr, int fdLen)
     if( !handle || !fdArr || ( fdLen < 1 ) ) { return EINVAL; }
 
     TRviContext   *ctx    = (TRviContext *)handle;
-    TRviRemote    rkey    = {0};
     TRviRemote    *rtmp   = NULL;
+    int             fd;
     char            cmd[5]  = {0};
 
     SSL             *ssl    = NULL;
@@ -1502,14 +3017,18 @@ int rviProcessInput(TRviHandle handle, int *fdArr, int fdLen)
     int             i       = 0;
     int             err     = 0;
 
+    /* Make sure that expired rights are gone before checking them */
+    rviProcessExpirations( handle );
+
     /* For each file descriptor we've received */
     while( i < fdLen ) {
-        rkey.fd = fdArr[i]; /* Set the key to the requested fd */
+        fd = fdArr[i];
         i++;
-        rtmp = btree_search( ctx->remoteIdx, &rkey ); /* Find the connection */
+        /* Find the connection */
+        rtmp = rviFdTableLookup( &ctx->remoteIdx, fd );
         if( !rtmp ) {
             err = ENXIO;
-            fprintf( stderr, "No connection on %d\n", rkey.fd );
+            fprintf( stderr, "No connection on %d\n", fd );
             continue;
         }
         BIO_get_ssl( rtmp->sbio, &ssl );
@@ -1569,16 +3088,79 @@ exit:
     return err;
 }
 
+/* 
+ * Return the time at which the next credential expires
+ */
+long rviGetNextExpiration(TRviHandle handle)
+{
+    if( !handle ) { return 0; }
+
+    TRviContext   *ctx    = (TRviContext *)handle;
+
+    return rviTimerNext( &ctx->expirations );
+}
+
+/* 
+ * Withdraw the rights of every credential that has expired
+ */
+int rviProcessExpirations(TRviHandle handle)
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRightsSet   *set;
+    long            now     = time( NULL );
+    int             err     = RVI_OK;
+    int             ret;
+
+    while( ( set = rviTimerExpire( &ctx->expirations, now ) ) ) {
+        if( ( ret = rviRightsSetExpire( ctx, set, now ) ) )
+            err = ret;
+    }
+
+    return err;
+}
+
+/* 
+ * Return the hits and misses of the rights caches of this node and of every 
+ * remote, including the remotes already disconnected
+ */
+int rviGetRightsCacheStats(TRviHandle handle, unsigned long *hits, 
+                           unsigned long *misses)
+{
+    if( !handle || !hits || !misses ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *remote;
+    int             fd;
+
+    *hits = ctx->rightsCacheHits + ctx->rights->cache.hits;
+    *misses = ctx->rightsCacheMisses + ctx->rights->cache.misses;
+
+    for( fd = rviFdTableNext( &ctx->remoteIdx, -1 ); fd >= 0; 
+         fd = rviFdTableNext( &ctx->remoteIdx, fd ) ) {
+        remote = rviFdTableLookup( &ctx->remoteIdx, fd );
+        *hits += remote->rights->cache.hits;
+        *misses += remote->rights->cache.misses;
+    }
+
+    return RVI_OK;
+}
+
 int rviReadAu( TRviHandle handle, json_t *msg, TRviRemote *remote )
 {
     if( !handle || !msg || !remote ) { return EINVAL; }
 
     int             err     = 0;
+    TRviContext     *ctx    = ( TRviContext * )handle;
     SSL             *ssl    = NULL;
     size_t          index;
     json_t          *value  = NULL;
     X509            *cert   = NULL;
     json_t          *tmp    = NULL;
+    const char      **creds = NULL;
+    TRviCredential  **credentials = NULL;
+    size_t          count   = 0;
 
     tmp = json_object_get( msg, "creds" );
     if( !tmp ) {
@@ -1586,30 +3168,68 @@ int rviReadAu( TRviHandle handle, json_t *msg, TRviRemote *remote )
         goto exit;
     }
 
-    BIO_get_ssl( remote->sbio, &ssl );
-    if( !ssl ) {
-        err = RVI_ERR_OPENSSL;
-        goto exit;
+    /* The peer's certificate is fingerprinted once per connection */
+    if( !remote->certDigested ) {
+        BIO_get_ssl( remote->sbio, &ssl );
+        if( !ssl ) {
+            err = RVI_ERR_OPENSSL;
+            goto exit;
+        }
+
+        if( ! ( cert = SSL_get_peer_certificate( ssl ) ) ) {
+            err = RVI_ERR_OPENSSL;
+            goto exit;
+        }
+
+        if( ( err = rviCertDigest( cert, remote->certDigest ) ) )
+            goto exit;
+        remote->certDigested = 1;
     }
 
-    if( ! ( cert = SSL_get_peer_certificate( ssl ) ) ) {
-        err = RVI_ERR_OPENSSL;
+    count = json_array_size( tmp );
+    creds = malloc( ( count ? count : 1 ) * sizeof( char * ) );
+    credentials = malloc( ( count ? count : 1 ) * sizeof( TRviCredential * ) );
+    if( !creds || !credentials ) {
+        count = 0;
+        err = ENOMEM;
         goto exit;
     }
 
 //    json_array_foreach( tmp, index, value ) {
-    for( index = 0; 
-         index < json_array_size( tmp ) && ( value = json_array_get( tmp, index ) ); 
-         index ++) {
-        const char *val = json_string_value( value );
-        if(  rviValidateCredential( handle, val, cert ) != RVI_OK ) {
-            continue;
-        }
-        err = rviGetRightsFromCredential( handle, val, remote->rights );
-        if( err ) goto exit;
+    for( index = 0; index < count; index ++) {
+        value = json_array_get( tmp, index );
+        creds[index] = json_string_value( value );
+    }
+
+    /* 
+     * Tokens seen before come from the credential cache, and the rest are 
+     * verified together on the worker threads. 
+     */
+    if( ( err = rviCredentialGetBatch( handle, creds, count, 
+                                       credentials ) ) ) {
+        count = 0;
+        goto exit;
+    }
+
+    /* Each credential must have been issued for this peer's certificate */
+    for( index = 0; index < count; index++ ) {
+        if( !err && credentials[index] && 
+            rviValidateCredential( credentials[index], 
+                                   remote->certDigest ) == RVI_OK )
+            err = rviGetRightsFromCredential( credentials[index], 
+                                              remote->rights );
     }
 
 exit:
+    for( index = 0; index < count; index++ )
+        rviCredentialRelease( credentials[index] );
+    free( creds );
+    free( credentials );
+    /* Rights that cannot be expired on time are not kept at all */
+    if( rviRightsSetSchedule( ctx, remote->rights ) != RVI_OK ) {
+        rviRightsSetPrune( remote->rights, LONG_MAX );
+        err = ENOMEM;
+    }
     if( cert ) X509_free( cert );
     return err;
 }
@@ -1660,9 +3280,12 @@ int rviReadSa( TRviHandle handle, json_t *msg, TRviRemote *remote )
     int             err     = 0;
     TRviContext   *ctx    = ( TRviContext * )handle;
     size_t          index;
+    size_t          count   = 0;
+    size_t          i;
     json_t          *value  = NULL;
     json_t          *tmp    = NULL;
     int             av      = 0;
+    TRviService     **batch = NULL;
 
     tmp = json_object_get( msg, "svcs" );
     if( !tmp ) {
@@ -1675,6 +3298,18 @@ int rviReadSa( TRviHandle handle, json_t *msg, TRviRemote *remote )
         av = 1;
     }
 
+    /* 
+     * Newly available services are collected into a batch and added to the 
+     * indices together once the whole message has been read. 
+     */
+    if( av && json_array_size( tmp ) ) {
+        batch = malloc( json_array_size( tmp ) * sizeof( TRviService * ) );
+        if( !batch ) {
+            err = ENOMEM;
+            goto exit;
+        }
+    }
+
     //json_array_foreach( tmp, index, value ) {
     for( index = 0; 
          index < json_array_size( tmp ) && ( value = json_array_get( tmp, index ) ); 
@@ -1688,13 +3323,13 @@ int rviReadSa( TRviHandle handle, json_t *msg, TRviRemote *remote )
             if ( ( err = rviRightToInvokeError( ctx->rights, val ) ) )
                 continue;
             
-            /* Otherwise, add the service to services available */
+            /* Otherwise, add the service to the batch */
             TRviService *service = rviServiceCreate( 
-                                                 val, remote->fd, 
+                                                 &ctx->names, val, remote->fd, 
                                                  NULL, NULL, 0
                                                        );
-            btree_insert( ctx->serviceNameIdx, service );
-            btree_insert( ctx->serviceRegIdx, service );
+            if( service )
+                batch[count++] = service;
         } else { /* Service not available, find it and remove it */
             /* If remote doesn't have right to receive, ignore this message */
             if ( ( err = rviRightToReceiveError( remote->rights, val ) ) ) 
@@ -1703,7 +3338,64 @@ int rviReadSa( TRviHandle handle, json_t *msg, TRviRemote *remote )
         }
     }
 
+    if( !count ) 
+        goto exit;
+
+    /* 
+     * Sort the batch by name and drop any service that is repeated in the 
+     * message or that we already know about. 
+     */
+    qsort( batch, count, sizeof( TRviService * ), rviSortByName );
+
+    index = 0;
+    for( i = 0; i < count; i++ ) {
+        if( ( index && batch[index - 1]->name == batch[i]->name ) ||
+            rviHashLookup( &ctx->serviceHash, batch[i]->hash, 
+                           batch[i]->name ) ) {
+            rviServiceDestroy( &ctx->names, batch[i] );
+            continue;
+        }
+        batch[index++] = batch[i];
+    }
+    count = index;
+
+    /* Add the services to the name indices first; they are easy to undo */
+    for( index = 0; index < count; index++ ) {
+        if( rviServiceAddName( ctx, batch[index] ) ) {
+            err = ENOMEM;
+            goto err;
+        }
+    }
+
+    /* 
+     * Every service in the batch has the same registrant, so the batch is 
+     * sorted for the registrant index as well as for the name index. 
+     */
+    if( btree_merge_sorted( ctx->serviceNameIdx, (void **)batch, count ) ) {
+        err = ENOMEM;
+        goto err;
+    }
+    if( btree_merge_sorted( ctx->serviceRegIdx, (void **)batch, count ) ) {
+        for( i = 0; i < count; i++ )
+            btree_delete( ctx->serviceNameIdx, ctx->serviceNameIdx->root, 
+                          batch[i] );
+        err = ENOMEM;
+        goto err;
+    }
+
 exit:
+    free( batch );
+
+    return err;
+
+err:
+    /* Only the first index services of the batch were added by name */
+    for( i = 0; i < index; i++ )
+        rviServiceRemoveName( ctx, batch[i] );
+    for( i = 0; i < count; i++ )
+        rviServiceDestroy( &ctx->names, batch[i] );
+    free( batch );
+
     return err;
 }
 
@@ -1716,23 +3408,34 @@ int rviAllServiceAnnounce( TRviHandle handle, TRviRemote *remote )
     TRviContext   *ctx    = ( TRviContext * )handle;
     json_t          *svcs   = NULL;
     json_t          *sa     = NULL;
+    char            *saString = NULL;
+    TRviService     **batch = NULL;
+    uint64_t        *allowed = NULL;
+    size_t          count   = 0;
+    size_t          i;
 
 
     svcs = json_array();
-    if( ctx->serviceNameIdx->count ) {
-        btree_iter iter = btree_iter_begin( ctx->serviceNameIdx );
-        while ( !btree_iter_at_end( iter ) ) {
-            TRviService *stmp = btree_iter_data( iter );
-            if ( /* The remote is allowed to invoke it */
-                 !( err = rviRightToInvokeError( remote->rights, stmp->name ) ) &&
-                 /* The service was registered locally */
-                 stmp->registrant == 0
-               ) {
-                json_array_append_new( svcs, json_string( stmp->name ) );
-            }
-            btree_iter_next( iter );
+    /* Services registered locally have a registrant of 0 */
+    if( ( err = rviServiceGetRange( ctx, 0, 0, &batch, &count ) ) ) {
+        json_decref( svcs );
+        goto exit;
+    }
+    if( count ) {
+        allowed = malloc( RVI_BITMAP_WORDS( count ) * sizeof( uint64_t ) );
+        if( !allowed ) {
+            json_decref( svcs );
+            err = ENOMEM;
+            goto exit;
+        }
+
+        /* Announce the services that the remote is allowed to invoke */
+        rviRightsSetCheckServices( remote->rights, RVI_RIGHTS_INVOKE, 
+                                   batch, count, allowed );
+        for( i = 0; i < count; i++ ) {
+            if( RVI_BITMAP_TEST( allowed, i ) )
+                json_array_append_new( svcs, json_string( batch[i]->name ) );
         }
-        btree_iter_cleanup( iter );
     }
 
     sa = json_pack( "{s:s, s:s, s:o}", 
@@ -1746,13 +3449,15 @@ int rviAllServiceAnnounce( TRviHandle handle, TRviRemote *remote )
     }
 
     /* send "sa" reply */
-    char *saString = json_dumps(sa, JSON_COMPACT);
+    saString = json_dumps(sa, JSON_COMPACT);
 
     BIO_puts( remote->sbio, saString );
 
 exit:
     free(saString);
     json_decref(sa);
+    free( batch );
+    free( allowed );
 
     return err;
 }
@@ -1766,9 +3471,16 @@ int rviServiceAnnounce( TRviHandle handle, TRviService *service, int available )
     json_t          *svcs   = NULL;
     json_t          *sa     = NULL;
     char            *saString = NULL;
+    TRviRemote      **batch = NULL;
+    uint64_t        *allowed = NULL;
+    size_t          count   = 0;
+    size_t          i;
+    int             fd;
 
     svcs = json_pack( "[s]", service->name );
-    if( ( err = rviRightToReceiveError( ctx->rights, service->name ) ) ) {
+    /* Withdrawing a service is allowed even after the right to it expired */
+    if( available && 
+        ( err = rviRightToReceiveError( ctx->rights, service->name ) ) ) {
         err = -RVI_ERR_RIGHTS; 
         goto exit;
     }
@@ -1778,7 +3490,7 @@ int rviServiceAnnounce( TRviHandle handle, TRviService *service, int available )
         goto exit;
     }
 
-    if( !(ctx->remoteIdx->count) ) {
+    if( !rviFdTableGetCount( &ctx->remoteIdx ) ) {
         err = -ENXIO; 
         goto exit;
     }
@@ -1791,22 +3503,35 @@ int rviServiceAnnounce( TRviHandle handle, TRviService *service, int available )
 
     saString = json_dumps(sa, JSON_COMPACT);
 
-    btree_iter iter = btree_iter_begin( ctx->remoteIdx );
-        while( !btree_iter_at_end( iter  ) ) {
-            TRviRemote *remote = btree_iter_data( iter );
-            if( ( err = rviRightToInvokeError( remote->rights, service->name ) ) ) {
-                btree_iter_next( iter );
-                continue; /* If the remote can't invoke, don't announce */
-            }
-            BIO_puts( remote->sbio, saString );
-            btree_iter_next( iter );
-        }
-    btree_iter_cleanup( iter );
+    count = rviFdTableGetCount( &ctx->remoteIdx );
+    batch = malloc( count * sizeof( TRviRemote * ) );
+    allowed = malloc( RVI_BITMAP_WORDS( count ) * sizeof( uint64_t ) );
+    if( !batch || !allowed ) {
+        err = ENOMEM;
+        goto exit;
+    }
+
+    count = 0;
+    for( fd = rviFdTableNext( &ctx->remoteIdx, -1 ); fd >= 0; 
+         fd = rviFdTableNext( &ctx->remoteIdx, fd ) ) {
+        batch[count++] = rviFdTableLookup( &ctx->remoteIdx, fd );
+    }
+
+    /* If a remote can't invoke the service, don't announce it there */
+    if( ( err = rviRightToInvokeRemotes( batch, count, service->name, 
+                                         allowed ) ) )
+        goto exit;
+    for( i = 0; i < count; i++ ) {
+        if( RVI_BITMAP_TEST( allowed, i ) )
+            BIO_puts( batch[i]->sbio, saString );
+    }
 
 
 exit:
     if( saString ) free( saString );
     json_decref(sa);
+    free( batch );
+    free( allowed );
 
     return err;
 }
@@ -1819,7 +3544,6 @@ int rviReadRcv( TRviHandle handle, json_t *msg, TRviRemote *remote )
     TRviContext   *ctx    = ( TRviContext * )handle;
     json_t          *tmp    = NULL;
     json_t          *params = NULL;
-    TRviService   skey    = {0};
     TRviService   *stmp   = NULL;
     char            *parameters = NULL;
     time_t          rawtime;
@@ -1838,8 +3562,7 @@ int rviReadRcv( TRviHandle handle, json_t *msg, TRviRemote *remote )
     if( ( err = rviRightToReceiveError( ctx->rights, sname ) ) )
         goto exit; /* This node does not have the right to receive */
 
-    skey.name = strdup( sname );
-    stmp = btree_search( ctx->serviceNameIdx, &skey );
+    stmp = rviServiceLookup( ctx, sname );
     if( !stmp ) { err = ENXIO; goto exit; }
 
     params = json_object_get( tmp, "parameters" );
@@ -1849,7 +3572,6 @@ int rviReadRcv( TRviHandle handle, json_t *msg, TRviRemote *remote )
     stmp->callback( remote->fd, stmp->data, parameters );
 
 exit:
-    if( skey.name ) free( skey.name );
     if( parameters ) free( parameters );
     return err;
 }
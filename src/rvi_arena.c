@@ -0,0 +1,162 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_arena.h"
+
+//
+//  All blocks handed out by the arena are aligned to this boundary.
+//
+#define RVI_ARENA_ALIGN ( 16 )
+
+#define ARENA_ROUND( size ) \
+    ( ( (size) + RVI_ARENA_ALIGN - 1 ) & ~( (size_t)RVI_ARENA_ALIGN - 1 ) )
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ i n i t i a l i z e
+
+	@brief Initialize a new arena data structure.
+
+	This function will initialize a new arena by initializing all of the
+    fields in the structure.  No memory is obtained from the system until the
+    first allocation is made from the arena.
+
+	@param[in] arena - The address of the arena structure to initialize
+	@param[in] chunkSize - The size of each chunk obtained from the system,
+                           or 0 to use RVI_ARENA_CHUNK_SIZE.
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviArenaInitialize ( TRviArena* arena, size_t chunkSize )
+{
+    arena->chunks    = NULL;
+    arena->chunkSize = chunkSize ? chunkSize : RVI_ARENA_CHUNK_SIZE;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ a l l o c
+
+	@brief Allocate a block of memory from the arena.
+
+	This function will carve a block of the requested size out of the current
+    chunk of the arena.  If the current chunk does not have enough room left,
+    a new chunk is obtained from the system first.  Requests larger than the
+    chunk size get a chunk of their own.
+
+    The arena argument is declared as a void pointer so that this function
+    can be used directly as a btree allocator callback.
+
+	@param[in] arena - The address of the arena to allocate from
+	@param[in] size - The number of bytes needed
+
+	@return The address of the new block or NULL if out of memory
+
+------------------------------------------------------------------------*/
+void* rviArenaAlloc ( void* arena, size_t size )
+{
+    TRviArena*      a      = arena;
+    TRviArenaChunk* chunk  = a->chunks;
+    size_t          header = ARENA_ROUND ( sizeof(TRviArenaChunk) );
+    size_t          need   = ARENA_ROUND ( size );
+    void*           block;
+
+    //
+    //  If there is no current chunk or it is too full, go get a new one.
+    //
+    if ( chunk == NULL || chunk->size - chunk->used < need )
+    {
+        size_t chunkSize = a->chunkSize;
+
+        if ( need > chunkSize - header )
+        {
+            chunkSize = need + header;
+        }
+        chunk = malloc ( chunkSize );
+        if ( !chunk )
+        {
+            return NULL;
+        }
+        chunk->size = chunkSize;
+        chunk->used = header;
+        chunk->next = a->chunks;
+        a->chunks   = chunk;
+    }
+    //
+    //  Hand out the next piece of the current chunk.
+    //
+    block = (char*)chunk + chunk->used;
+    chunk->used += need;
+
+    return block;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ f r e e
+
+	@brief Release a block of memory back to the arena.
+
+	Blocks are not returned individually.  All of the memory in an arena is
+    released at once by rviArenaDestroy, so this function does nothing.  It
+    exists so that the arena can be plugged in wherever a matching pair of
+    allocation functions is required.
+
+	@param[in] arena - The address of the arena
+	@param[in] block - The block being released
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviArenaFree ( void* arena, void* block )
+{
+    return;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ d e s t r o y
+
+	@brief Release all memory held by the arena.
+
+	This function will return every chunk obtained by the arena to the
+    system.  Any block previously handed out by the arena becomes invalid.
+    The arena may be used again after this call.
+
+	@param[in] arena - The address of the arena to destroy
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviArenaDestroy ( TRviArena* arena )
+{
+    TRviArenaChunk* chunk = arena->chunks;
+    TRviArenaChunk* next;
+
+    while ( chunk != NULL )
+    {
+        next = chunk->next;
+        free ( chunk );
+        chunk = next;
+    }
+    arena->chunks = NULL;
+}
@@ -0,0 +1,47 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_ARENA_H_
+#define _RVI_ARENA_H_
+
+#include <stddef.h>
+
+//
+//  The default size of each chunk of memory obtained from the system.
+//
+#define RVI_ARENA_CHUNK_SIZE ( 64 * 1024 )
+
+typedef struct TRviArenaChunk
+{
+    struct TRviArenaChunk* next;
+    size_t                 size;
+    size_t                 used;
+
+}   TRviArenaChunk;
+
+
+typedef struct TRviArena
+{
+    TRviArenaChunk* chunks;
+
+    size_t          chunkSize;
+
+}   TRviArena;
+
+
+int rviArenaInitialize ( TRviArena* arena, size_t chunkSize );
+
+void* rviArenaAlloc ( void* arena, size_t size );
+
+void rviArenaFree ( void* arena, void* block );
+
+void rviArenaDestroy ( TRviArena* arena );
+
+
+#endif // _RVI_ARENA_H_
@@ -0,0 +1,243 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_fdtable.h"
+
+//
+//  The number of 64 bit bitmap words needed to cover the given number of
+//  slots.
+//
+#define BITMAP_WORDS( size ) ( ( (size) + 63 ) / 64 )
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ f d _ t a b l e _ i n i t i a l i z e
+
+	@brief Initialize a new file descriptor table.
+
+	This function will initialize an empty table.  No memory is obtained
+    from the system until the first record is inserted.
+
+	@param[in] table - The address of the table structure to initialize
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviFdTableInitialize ( TRviFdTable* table )
+{
+    table->slots  = NULL;
+    table->bitmap = NULL;
+    table->size   = 0;
+    table->count  = 0;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ f d _ t a b l e _ g r o w
+
+	@brief Grow a table so that it has a slot for the given descriptor.
+
+	The number of slots is doubled until the descriptor fits.  The new slots
+    are empty.
+
+	@param[in] table - The address of the table
+	@param[in] fd - The file descriptor that must fit
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+static int rviFdTableGrow ( TRviFdTable* table, int fd )
+{
+    unsigned int size = table->size ? table->size : RVI_FDTABLE_MIN_SIZE;
+    void**       slots;
+    uint64_t*    bitmap;
+
+    while ( (unsigned int)fd >= size )
+    {
+        size *= 2;
+    }
+    slots = realloc ( table->slots, size * sizeof(void*) );
+    if ( !slots )
+    {
+        return ENOMEM;
+    }
+    table->slots = slots;
+
+    bitmap = realloc ( table->bitmap, BITMAP_WORDS ( size ) *
+                                      sizeof(uint64_t) );
+    if ( !bitmap )
+    {
+        return ENOMEM;
+    }
+    table->bitmap = bitmap;
+
+    memset ( &table->slots[table->size], 0,
+             ( size - table->size ) * sizeof(void*) );
+    memset ( &table->bitmap[BITMAP_WORDS ( table->size )], 0,
+             ( BITMAP_WORDS ( size ) - BITMAP_WORDS ( table->size ) ) *
+             sizeof(uint64_t) );
+
+    table->size = size;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ f d _ t a b l e _ i n s e r t
+
+	@brief Insert a record into the table.
+
+	This function will store the record in the slot for the given file
+    descriptor, growing the table first if needed.
+
+	@param[in] table - The address of the table
+	@param[in] fd - The file descriptor of the record
+	@param[in] record - The record to be stored
+
+	@return status - 0: Success
+                    ~0: An error code (EEXIST if the slot is taken)
+
+------------------------------------------------------------------------*/
+int rviFdTableInsert ( TRviFdTable* table, int fd, void* record )
+{
+    int status;
+
+    if ( fd < 0 || !record )
+    {
+        return EINVAL;
+    }
+    if ( (unsigned int)fd >= table->size )
+    {
+        if ( ( status = rviFdTableGrow ( table, fd ) ) != 0 )
+        {
+            return status;
+        }
+    }
+    if ( table->slots[fd] )
+    {
+        return EEXIST;
+    }
+    table->slots[fd] = record;
+    table->bitmap[fd / 64] |= (uint64_t)1 << ( fd % 64 );
+    table->count++;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ f d _ t a b l e _ r e m o v e
+
+	@brief Remove a record from the table.
+
+	@param[in] table - The address of the table
+	@param[in] fd - The file descriptor of the record
+
+	@return The record that was removed or NULL if there was none
+
+------------------------------------------------------------------------*/
+void* rviFdTableRemove ( TRviFdTable* table, int fd )
+{
+    void* record = rviFdTableLookup ( table, fd );
+
+    if ( record )
+    {
+        table->slots[fd] = NULL;
+        table->bitmap[fd / 64] &= ~( (uint64_t)1 << ( fd % 64 ) );
+        table->count--;
+    }
+    return record;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ f d _ t a b l e _ n e x t
+
+	@brief Find the next occupied slot of the table.
+
+	This function will return the smallest file descriptor greater than the
+    given one that has a record in the table.  The bitmap is scanned a word
+    at a time so empty stretches of the table are skipped quickly.  To visit
+    every record in the table:
+
+        for ( fd = rviFdTableNext ( table, -1 ); fd >= 0;
+              fd = rviFdTableNext ( table, fd ) )
+        {
+            record = rviFdTableLookup ( table, fd );
+            ...
+        }
+
+	@param[in] table - The address of the table
+	@param[in] fd - The file descriptor to start after, or -1 to start at the
+                    beginning of the table
+
+	@return The next file descriptor or -1 if there is none
+
+------------------------------------------------------------------------*/
+int rviFdTableNext ( TRviFdTable* table, int fd )
+{
+    unsigned int next = (unsigned int)( fd + 1 );
+    unsigned int word;
+    uint64_t     bits;
+
+    if ( fd < -1 || next >= table->size )
+    {
+        return -1;
+    }
+    word = next / 64;
+    bits = table->bitmap[word] & ( ~(uint64_t)0 << ( next % 64 ) );
+
+    while ( !bits )
+    {
+        if ( ++word >= BITMAP_WORDS ( table->size ) )
+        {
+            return -1;
+        }
+        bits = table->bitmap[word];
+    }
+    return (int)( word * 64 + __builtin_ctzll ( bits ) );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ f d _ t a b l e _ d e s t r o y
+
+	@brief Release all memory held by the table.
+
+	The records themselves are not touched.  The table may be used again
+    after this call.
+
+	@param[in] table - The address of the table to destroy
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviFdTableDestroy ( TRviFdTable* table )
+{
+    free ( table->slots );
+    free ( table->bitmap );
+
+    rviFdTableInitialize ( table );
+}
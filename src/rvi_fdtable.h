@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_FDTABLE_H_
+#define _RVI_FDTABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+//  The number of slots allocated the first time an entry is inserted, unless
+//  the file descriptor needs more.
+//
+#define RVI_FDTABLE_MIN_SIZE ( 64 )
+
+//
+//  A table of records indexed directly by file descriptor.  Since the system
+//  hands out the lowest free descriptor, the descriptors in use are dense and
+//  a lookup is just an array access.  The table grows (doubling) to fit the
+//  largest descriptor inserted.
+//
+//  Each slot has a bit in the occupancy bitmap so that the occupied slots
+//  can be visited in descriptor order without looking at the empty ones.
+//
+typedef struct TRviFdTable
+{
+    void**       slots;     // The record for each descriptor or NULL
+    uint64_t*    bitmap;    // One bit for each slot, set if it is occupied
+    unsigned int size;      // The number of slots
+    unsigned int count;     // The number of occupied slots
+
+}   TRviFdTable;
+
+
+int rviFdTableInitialize ( TRviFdTable* table );
+
+int rviFdTableInsert ( TRviFdTable* table, int fd, void* record );
+
+void* rviFdTableRemove ( TRviFdTable* table, int fd );
+
+int rviFdTableNext ( TRviFdTable* table, int fd );
+
+void rviFdTableDestroy ( TRviFdTable* table );
+
+//
+//  Return the record for the given file descriptor or NULL if there is none.
+//
+static inline void* rviFdTableLookup ( TRviFdTable* table, int fd )
+{
+    if ( fd < 0 || (unsigned int)fd >= table->size )
+    {
+        return NULL;
+    }
+    return table->slots[fd];
+}
+
+//
+//  Return the number of records in the table.
+//
+static inline unsigned int rviFdTableGetCount ( TRviFdTable* table )
+{
+    return table->count;
+}
+
+
+#endif // _RVI_FDTABLE_H_
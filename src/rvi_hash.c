@@ -0,0 +1,345 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_hash.h"
+
+//
+//  The record pointer stored in a slot whose record has been removed.  Only
+//  its address is used.
+//
+static char deletedRecord;
+
+#define HASH_DELETED ( (void*)&deletedRecord )
+
+//
+//  The 64 bit FNV-1a parameters.
+//
+#define FNV_OFFSET_BASIS ( 0xcbf29ce484222325ULL )
+#define FNV_PRIME        ( 0x100000001b3ULL )
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ i n i t i a l i z e
+
+	@brief Initialize a new hash table.
+
+	This function will initialize an empty table.  No memory is obtained
+    from the system until the first record is inserted.
+
+	@param[in] table - The address of the table structure to initialize
+	@param[in] match - The function that matches records to lookup keys
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviHashInitialize ( TRviHashTable* table, TRviHashMatch match )
+{
+    if ( !match )
+    {
+        return EINVAL;
+    }
+    table->entries = NULL;
+    table->match   = match;
+    table->size    = 0;
+    table->count   = 0;
+    table->deleted = 0;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ r e b u i l d
+
+	@brief Move all of the records of a table into a new array of slots.
+
+	The new array is made large enough that it is at most half full after
+    one more record is inserted.  The deleted slots are dropped, so a table
+    that is full of them is rebuilt at the same size rather than grown.
+
+	@param[in] table - The address of the table
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+static int rviHashRebuild ( TRviHashTable* table )
+{
+    unsigned int   size = RVI_HASH_MIN_SIZE;
+    unsigned int   mask;
+    unsigned int   i;
+    unsigned int   j;
+    TRviHashEntry* entries;
+
+    while ( ( table->count + 1 ) * 2 > size )
+    {
+        size *= 2;
+    }
+    entries = calloc ( size, sizeof(TRviHashEntry) );
+    if ( !entries )
+    {
+        return ENOMEM;
+    }
+    mask = size - 1;
+
+    for ( i = 0; i < table->size; i++ )
+    {
+        if ( !table->entries[i].record ||
+             table->entries[i].record == HASH_DELETED )
+        {
+            continue;
+        }
+        j = table->entries[i].hash & mask;
+        while ( entries[j].record )
+        {
+            j = ( j + 1 ) & mask;
+        }
+        entries[j] = table->entries[i];
+    }
+    free ( table->entries );
+
+    table->entries = entries;
+    table->size    = size;
+    table->deleted = 0;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ i n s e r t
+
+	@brief Insert a record into the table.
+
+	The table does not check for a record that matches the same key; the
+    caller must not insert one if it wants lookups to be unambiguous.
+
+	@param[in] table - The address of the table
+	@param[in] hash - The hash of the key of the record
+	@param[in] record - The record to be inserted
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviHashInsert ( TRviHashTable* table, uint64_t hash, void* record )
+{
+    unsigned int mask;
+    unsigned int i;
+    int          status;
+
+    if ( !record )
+    {
+        return EINVAL;
+    }
+    if ( ( table->count + table->deleted + 1 ) * 4 > table->size * 3 )
+    {
+        if ( ( status = rviHashRebuild ( table ) ) != 0 )
+        {
+            return status;
+        }
+    }
+    mask = table->size - 1;
+    i    = hash & mask;
+
+    while ( table->entries[i].record &&
+            table->entries[i].record != HASH_DELETED )
+    {
+        i = ( i + 1 ) & mask;
+    }
+    if ( table->entries[i].record == HASH_DELETED )
+    {
+        table->deleted--;
+    }
+    table->entries[i].hash   = hash;
+    table->entries[i].record = record;
+    table->count++;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ l o o k u p
+
+	@brief Find the record that matches a key.
+
+	The slots are probed starting at the home slot of the hash until an
+    empty slot is found.  The match function is only called for the records
+    that were inserted with the same hash.
+
+	@param[in] table - The address of the table
+	@param[in] hash - The hash of the key
+	@param[in] key - The key to be passed to the match function
+
+	@return The record that matches the key or NULL if there is none
+
+------------------------------------------------------------------------*/
+void* rviHashLookup ( TRviHashTable* table, uint64_t hash, const void* key )
+{
+    TRviHashEntry* entry;
+    unsigned int   mask;
+    unsigned int   i;
+
+    if ( !table->count )
+    {
+        return NULL;
+    }
+    mask = table->size - 1;
+    i    = hash & mask;
+
+    while ( ( entry = &table->entries[i] )->record )
+    {
+        if ( entry->hash == hash && entry->record != HASH_DELETED &&
+             table->match ( entry->record, key ) )
+        {
+            return entry->record;
+        }
+        i = ( i + 1 ) & mask;
+    }
+    return NULL;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ r e m o v e
+
+	@brief Remove a record from the table.
+
+	The record is found by its address, so the match function is not used.
+
+	@param[in] table - The address of the table
+	@param[in] hash - The hash the record was inserted with
+	@param[in] record - The record to be removed
+
+	@return status - 0: Success
+                    ~0: An error code (ENOENT if the record is not found)
+
+------------------------------------------------------------------------*/
+int rviHashRemove ( TRviHashTable* table, uint64_t hash, void* record )
+{
+    TRviHashEntry* entry;
+    unsigned int   mask;
+    unsigned int   i;
+
+    if ( !table->count || !record )
+    {
+        return ENOENT;
+    }
+    mask = table->size - 1;
+    i    = hash & mask;
+
+    while ( ( entry = &table->entries[i] )->record )
+    {
+        if ( entry->record == record )
+        {
+            entry->record = HASH_DELETED;
+            table->count--;
+            table->deleted++;
+
+            return 0;
+        }
+        i = ( i + 1 ) & mask;
+    }
+    return ENOENT;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ d e s t r o y
+
+	@brief Release all memory held by the table.
+
+	The records themselves are not touched.  The table may be used again
+    after this call.
+
+	@param[in] table - The address of the table to destroy
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviHashDestroy ( TRviHashTable* table )
+{
+    free ( table->entries );
+
+    table->entries = NULL;
+    table->size    = 0;
+    table->count   = 0;
+    table->deleted = 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ d e s t r o y _ w i t h
+
+	@brief Visit every record of the table and then destroy it.
+
+	Each record is passed to the visit function exactly once, so it can be
+    freed there.  The table must not be used by the visit function.
+
+	@param[in] table - The address of the table to destroy
+	@param[in] visit - The function to call for each record
+	@param[in] context - Passed through to the visit function
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviHashDestroyWith ( TRviHashTable* table, TRviHashVisit visit,
+                          void* context )
+{
+    unsigned int i;
+
+    for ( i = 0; i < table->size; i++ )
+    {
+        if ( table->entries[i].record &&
+             table->entries[i].record != HASH_DELETED )
+        {
+            visit ( table->entries[i].record, context );
+        }
+    }
+    rviHashDestroy ( table );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ s t r i n g
+
+	@brief Compute the 64 bit FNV-1a hash of a string.
+
+	@param[in] string - The null terminated string to hash
+
+	@return The hash of the string
+
+------------------------------------------------------------------------*/
+uint64_t rviHashString ( const char* string )
+{
+    const unsigned char* s    = (const unsigned char*)string;
+    uint64_t             hash = FNV_OFFSET_BASIS;
+
+    while ( *s )
+    {
+        hash ^= *s++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
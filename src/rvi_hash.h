@@ -0,0 +1,88 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_HASH_H_
+#define _RVI_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+//  The number of slots allocated the first time an entry is inserted.  This
+//  must be a power of 2.
+//
+#define RVI_HASH_MIN_SIZE ( 16 )
+
+//
+//  Define the function that decides whether a record in the table matches a
+//  lookup key.  It is only called for records whose hash equals the hash of
+//  the key and returns non-zero if the record matches.
+//
+typedef int (*TRviHashMatch) ( void* record, const void* key );
+
+//
+//  Define the function called for each record when a table is destroyed.
+//
+typedef void (*TRviHashVisit) ( void* record, void* context );
+
+//
+//  Each slot holds a record and the hash it was inserted with, so that
+//  probing compares the hashes without touching the records.
+//
+typedef struct TRviHashEntry
+{
+    uint64_t hash;
+    void*    record;
+
+}   TRviHashEntry;
+
+//
+//  An open addressing hash table with linear probing.  The table does not
+//  hash the records itself; the caller computes the hash (usually once, when
+//  the record is created) and passes it in.  Removed slots are marked as
+//  deleted so that the probe sequences running through them are not broken.
+//  The table is rebuilt when it gets more than 3/4 full, counting the
+//  deleted slots.
+//
+typedef struct TRviHashTable
+{
+    TRviHashEntry* entries;
+    TRviHashMatch  match;
+    unsigned int   size;        // The number of slots, a power of 2
+    unsigned int   count;       // The number of records in the table
+    unsigned int   deleted;     // The number of deleted slots
+
+}   TRviHashTable;
+
+
+int rviHashInitialize ( TRviHashTable* table, TRviHashMatch match );
+
+int rviHashInsert ( TRviHashTable* table, uint64_t hash, void* record );
+
+void* rviHashLookup ( TRviHashTable* table, uint64_t hash, const void* key );
+
+int rviHashRemove ( TRviHashTable* table, uint64_t hash, void* record );
+
+void rviHashDestroy ( TRviHashTable* table );
+
+void rviHashDestroyWith ( TRviHashTable* table, TRviHashVisit visit,
+                          void* context );
+
+uint64_t rviHashString ( const char* string );
+
+//
+//  Return the number of records in the table.
+//
+static inline unsigned int rviHashGetCount ( TRviHashTable* table )
+{
+    return table->count;
+}
+
+
+#endif // _RVI_HASH_H_
@@ -0,0 +1,187 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_intern.h"
+
+//
+//  Return the header of an interned string.
+//
+#define INTERN_HEADER( string ) \
+    ( (TRviInternString*)( (char*)(string) - \
+                           offsetof ( TRviInternString, string ) ) )
+
+
+//
+//  The match function of the hash table.  The key is a plain string.
+//
+static int rviInternMatch ( void* record, const void* key )
+{
+    return strcmp ( ( (TRviInternString*)record )->string, key ) == 0;
+}
+
+//
+//  The visit function used to free the strings left when the table is
+//  destroyed.
+//
+static void rviInternFree ( void* record, void* context )
+{
+    (void)context;
+
+    free ( record );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ i n t e r n _ i n i t i a l i z e
+
+	@brief Initialize a new intern table.
+
+	@param[in] table - The address of the table structure to initialize
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviInternInitialize ( TRviInternTable* table )
+{
+    return rviHashInitialize ( &table->strings, rviInternMatch );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ i n t e r n _ a c q u i r e
+
+	@brief Get a reference to the canonical copy of a string.
+
+	If the string is already in the table, its reference count is
+    incremented.  Otherwise a copy of it is added to the table.  Every
+    reference obtained here must be given back with rviInternRelease.
+
+	@param[in] table - The address of the table
+	@param[in] string - The string to intern
+
+	@return The canonical copy of the string or NULL if out of memory
+
+------------------------------------------------------------------------*/
+const char* rviInternAcquire ( TRviInternTable* table, const char* string )
+{
+    uint64_t          hash = rviHashString ( string );
+    TRviInternString* interned;
+    size_t            length;
+
+    interned = rviHashLookup ( &table->strings, hash, string );
+    if ( interned )
+    {
+        interned->refs++;
+        return interned->string;
+    }
+
+    length   = strlen ( string );
+    interned = malloc ( sizeof(TRviInternString) + length + 1 );
+    if ( !interned )
+    {
+        return NULL;
+    }
+    interned->hash = hash;
+    interned->refs = 1;
+    memcpy ( interned->string, string, length + 1 );
+
+    if ( rviHashInsert ( &table->strings, hash, interned ) != 0 )
+    {
+        free ( interned );
+        return NULL;
+    }
+    return interned->string;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ i n t e r n _ f i n d
+
+	@brief Find the canonical copy of a string without taking a reference.
+
+	This is meant for lookups: a string that is not in the table cannot be
+    the name of anything that holds a reference, and a string that is can be
+    compared to other interned strings by address.
+
+	@param[in] table - The address of the table
+	@param[in] string - The string to look for
+
+	@return The canonical copy of the string or NULL if it is not interned
+
+------------------------------------------------------------------------*/
+const char* rviInternFind ( TRviInternTable* table, const char* string )
+{
+    TRviInternString* interned;
+
+    interned = rviHashLookup ( &table->strings, rviHashString ( string ),
+                               string );
+
+    return interned ? interned->string : NULL;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ i n t e r n _ r e l e a s e
+
+	@brief Give back a reference to an interned string.
+
+	The string is removed from the table and freed when its last reference
+    is released.
+
+	@param[in] table - The address of the table
+	@param[in] string - The interned string, NULL is ignored
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviInternRelease ( TRviInternTable* table, const char* string )
+{
+    TRviInternString* interned;
+
+    if ( !string )
+    {
+        return;
+    }
+    interned = INTERN_HEADER ( string );
+
+    if ( --interned->refs == 0 )
+    {
+        rviHashRemove ( &table->strings, interned->hash, interned );
+        free ( interned );
+    }
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ i n t e r n _ d e s t r o y
+
+	@brief Free every string in the table and the table itself.
+
+	Any references still held become invalid.
+
+	@param[in] table - The address of the table to destroy
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviInternDestroy ( TRviInternTable* table )
+{
+    rviHashDestroyWith ( &table->strings, rviInternFree, NULL );
+}
@@ -0,0 +1,63 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_INTERN_H_
+#define _RVI_INTERN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rvi_hash.h"
+
+//
+//  An interned string.  The characters follow the header in the same block,
+//  and the interned string handed out is the address of the characters.
+//
+typedef struct TRviInternString
+{
+    uint64_t     hash;      // The rviHashString hash of the characters
+    unsigned int refs;      // The number of references handed out
+    char         string[];
+
+}   TRviInternString;
+
+//
+//  A table holding one canonical, reference counted copy of each string put
+//  into it.  Two interned strings from the same table are equal exactly when
+//  their addresses are equal, so they can be compared as pointers.
+//
+typedef struct TRviInternTable
+{
+    TRviHashTable strings;
+
+}   TRviInternTable;
+
+
+int rviInternInitialize ( TRviInternTable* table );
+
+const char* rviInternAcquire ( TRviInternTable* table, const char* string );
+
+const char* rviInternFind ( TRviInternTable* table, const char* string );
+
+void rviInternRelease ( TRviInternTable* table, const char* string );
+
+void rviInternDestroy ( TRviInternTable* table );
+
+//
+//  Return the hash of an interned string without rehashing its characters.
+//  The string must have come from rviInternAcquire or rviInternFind.
+//
+static inline uint64_t rviInternHash ( const char* string )
+{
+    return ( (const TRviInternString*)
+             ( string - offsetof ( TRviInternString, string ) ) )->hash;
+}
+
+
+#endif // _RVI_INTERN_H_
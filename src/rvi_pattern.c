@@ -0,0 +1,378 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rvi_pattern.h"
+
+#if defined(__x86_64__) || ( defined(__i386__) && defined(__SSE2__) )
+#define RVI_PATTERN_X86
+#include <immintrin.h>
+#endif
+
+//
+//  A vector load of the given width starting at p stays within the page
+//  that p is in.  Loads past the end of a string are only made when they
+//  cannot touch a page that the string does not.
+//
+#define RVI_PAGE_SIZE ( 4096 )
+
+#define PAGE_SAFE( p, width ) \
+    ( ( (uintptr_t)(p) & ( RVI_PAGE_SIZE - 1 ) ) <= RVI_PAGE_SIZE - (width) )
+
+//
+//  Those loads may still read past the end of the object that a string is
+//  in, so the vector versions are not instrumented by AddressSanitizer.
+//
+#define PAGE_SAFE_LOADS __attribute__((no_sanitize_address))
+
+//
+//  Define the functions that a version of the matcher is built from.
+//
+//  A run function returns the number of bytes at the start of the pattern
+//  and the name that the byte loop would step over one at a time: bytes
+//  that are equal and are neither a '\0' nor a '+' in the pattern.  It may
+//  return fewer, down to 0, when it cannot look further safely.
+//
+//  A skip function returns how far the loop moves a string when it skips
+//  the rest of a segment for a '+': past the next '/', or up to the '\0'
+//  that ends the string if there is no '/'.
+//
+typedef size_t (*TRviPatternRun) ( const char* pattern, const char* fqsn );
+
+typedef size_t (*TRviPatternSkip) ( const char* s );
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ c o m p a r e _ p a t t e r n _ s c a l a r
+
+	@brief Compare an RVI pattern to a fully-qualified service name.
+
+	This is the reference version of the matcher.  Every other version must
+    give exactly the same result for every input.
+
+	A '+' skips the rest of its segment in both strings, and the characters
+    after the skips are compared without looking for another '+'.  When the
+    skip reaches the end of the pattern there is nothing left to compare;
+    the loop used to step past the end of both strings there, and the
+    pattern is now taken not to match.
+
+	@param[in] pattern - The pattern
+	@param[in] fqsn - The fully-qualified service name
+
+	@return 0 if the name matches the pattern, an error code otherwise
+
+------------------------------------------------------------------------*/
+int rviComparePatternScalar ( const char* pattern, const char* fqsn )
+{
+    /* Check input */
+    if( !pattern || !fqsn ) { return EINVAL; }
+    /* While there are bytes to compare */
+    while( *pattern != '\0' && *fqsn != '\0' ) {
+        /* If there's a topic wildcard... */
+        if( *pattern == '+' ) {
+            /* Advance topic in pattern */
+            while( *pattern++ != '/' && *pattern != '\0' );
+            /* Advance topic in fqsn */
+            while( *fqsn++ != '/' && *fqsn != '\0' );
+            /* A '+' in the last topic of the pattern matches nothing */
+            if( *pattern == '\0' ) { return -1; }
+        }
+        /* If the bytes don't match, return error */
+        if( *pattern++ != *fqsn++ ) { return -1; }
+    }
+    /* If the pattern still has characters, the fqsn doesn't match */
+    if( *pattern != '\0' ) { return -1; }
+
+    /* Otherwise, the fqsn matches the pattern */
+    return 0;
+}
+
+
+//
+//  The byte loop of rviComparePatternScalar, with the literal runs and the
+//  segment skips done by the given functions.  Each vector version of the
+//  matcher is this function inlined with its own run and skip functions.
+//
+//  Both skips start on a byte that is not '\0', which is what makes the
+//  skip functions' closed form equal to the byte loop's.
+//
+PAGE_SAFE_LOADS
+static inline int rviComparePatternWith ( const char* pattern,
+                                          const char* fqsn,
+                                          TRviPatternRun run,
+                                          TRviPatternSkip skip )
+{
+    size_t length;
+
+    while ( *pattern != '\0' && *fqsn != '\0' )
+    {
+        if ( *pattern == '+' )
+        {
+            pattern += skip ( pattern );
+            fqsn    += skip ( fqsn );
+
+            if ( *pattern == '\0' )
+            {
+                return -1;
+            }
+        }
+        else if ( ( length = run ( pattern, fqsn ) ) != 0 )
+        {
+            pattern += length;
+            fqsn    += length;
+            continue;
+        }
+        if ( *pattern++ != *fqsn++ )
+        {
+            return -1;
+        }
+    }
+    return *pattern != '\0' ? -1 : 0;
+}
+
+
+#ifdef RVI_PATTERN_X86
+
+//
+//  The SSE2 run function, 16 bytes at a time.
+//
+PAGE_SAFE_LOADS
+static inline size_t rviPatternRunSse2 ( const char* pattern,
+                                         const char* fqsn )
+{
+    const __m128i plus = _mm_set1_epi8 ( '+' );
+    const __m128i zero = _mm_setzero_si128 ();
+    __m128i       p;
+    __m128i       f;
+    unsigned int  stop;
+    size_t        i = 0;
+
+    while ( PAGE_SAFE ( pattern + i, 16 ) && PAGE_SAFE ( fqsn + i, 16 ) )
+    {
+        p = _mm_loadu_si128 ( (const __m128i*)( pattern + i ) );
+        f = _mm_loadu_si128 ( (const __m128i*)( fqsn + i ) );
+
+        stop = ~_mm_movemask_epi8 ( _mm_cmpeq_epi8 ( p, f ) ) |
+               _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( p, zero ) ) |
+               _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( p, plus ) );
+        stop &= 0xffff;
+
+        if ( stop )
+        {
+            return i + __builtin_ctz ( stop );
+        }
+        i += 16;
+    }
+    return i;
+}
+
+//
+//  The SSE2 skip function, 16 bytes at a time.
+//
+PAGE_SAFE_LOADS
+static inline size_t rviPatternSkipSse2 ( const char* s )
+{
+    const __m128i slash = _mm_set1_epi8 ( '/' );
+    const __m128i zero  = _mm_setzero_si128 ();
+    __m128i       v;
+    unsigned int  stop;
+    size_t        i = 0;
+
+    while ( PAGE_SAFE ( s + i, 16 ) )
+    {
+        v    = _mm_loadu_si128 ( (const __m128i*)( s + i ) );
+        stop = _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( v, slash ) ) |
+               _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( v, zero ) );
+
+        if ( stop )
+        {
+            i += __builtin_ctz ( stop );
+            return s[i] == '/' ? i + 1 : i;
+        }
+        i += 16;
+    }
+    for ( ; s[i] != '/'; i++ )
+    {
+        if ( s[i] == '\0' )
+        {
+            return i;
+        }
+    }
+    return i + 1;
+}
+
+PAGE_SAFE_LOADS
+static int rviComparePatternSse2 ( const char* pattern, const char* fqsn )
+{
+    return rviComparePatternWith ( pattern, fqsn, rviPatternRunSse2,
+                                   rviPatternSkipSse2 );
+}
+
+
+//
+//  The AVX2 run function, 32 bytes at a time.
+//
+__attribute__((target("avx2"))) PAGE_SAFE_LOADS
+static inline size_t rviPatternRunAvx2 ( const char* pattern,
+                                         const char* fqsn )
+{
+    const __m256i plus = _mm256_set1_epi8 ( '+' );
+    const __m256i zero = _mm256_setzero_si256 ();
+    __m256i       p;
+    __m256i       f;
+    unsigned int  stop;
+    size_t        i = 0;
+
+    while ( PAGE_SAFE ( pattern + i, 32 ) && PAGE_SAFE ( fqsn + i, 32 ) )
+    {
+        p = _mm256_loadu_si256 ( (const __m256i*)( pattern + i ) );
+        f = _mm256_loadu_si256 ( (const __m256i*)( fqsn + i ) );
+
+        stop = ~(unsigned int)_mm256_movemask_epi8 (
+                                  _mm256_cmpeq_epi8 ( p, f ) ) |
+               (unsigned int)_mm256_movemask_epi8 (
+                                  _mm256_cmpeq_epi8 ( p, zero ) ) |
+               (unsigned int)_mm256_movemask_epi8 (
+                                  _mm256_cmpeq_epi8 ( p, plus ) );
+
+        if ( stop )
+        {
+            return i + __builtin_ctz ( stop );
+        }
+        i += 32;
+    }
+    //
+    //  Near the end of a page, try the narrower loads before giving up.
+    //
+    return i + rviPatternRunSse2 ( pattern + i, fqsn + i );
+}
+
+//
+//  The AVX2 skip function, 32 bytes at a time.
+//
+__attribute__((target("avx2"))) PAGE_SAFE_LOADS
+static inline size_t rviPatternSkipAvx2 ( const char* s )
+{
+    const __m256i slash = _mm256_set1_epi8 ( '/' );
+    const __m256i zero  = _mm256_setzero_si256 ();
+    __m256i       v;
+    unsigned int  stop;
+    size_t        i = 0;
+
+    while ( PAGE_SAFE ( s + i, 32 ) )
+    {
+        v    = _mm256_loadu_si256 ( (const __m256i*)( s + i ) );
+        stop = (unsigned int)_mm256_movemask_epi8 (
+                                  _mm256_cmpeq_epi8 ( v, slash ) ) |
+               (unsigned int)_mm256_movemask_epi8 (
+                                  _mm256_cmpeq_epi8 ( v, zero ) );
+
+        if ( stop )
+        {
+            i += __builtin_ctz ( stop );
+            return s[i] == '/' ? i + 1 : i;
+        }
+        i += 32;
+    }
+    return i + rviPatternSkipSse2 ( s + i );
+}
+
+__attribute__((target("avx2"))) PAGE_SAFE_LOADS
+static int rviComparePatternAvx2 ( const char* pattern, const char* fqsn )
+{
+    return rviComparePatternWith ( pattern, fqsn, rviPatternRunAvx2,
+                                   rviPatternSkipAvx2 );
+}
+
+#endif // RVI_PATTERN_X86
+
+
+//
+//  Every version of the matcher, from the portable one to the fastest.
+//
+static const TRviPatternVersion rviPatternVersionList[] =
+{
+    { "scalar", rviComparePatternScalar },
+#ifdef RVI_PATTERN_X86
+    { "sse2",   rviComparePatternSse2 },
+    { "avx2",   rviComparePatternAvx2 },
+#endif
+};
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ p a t t e r n _ v e r s i o n s
+
+	@brief List the versions of the matcher that this processor can run.
+
+	The versions are listed from the portable one to the fastest, and the
+    last of them is the one that rviComparePattern uses.  SSE2 is part of
+    every x86-64 processor, and AVX2 is listed only when the processor
+    supports it.
+
+	@param[out] versions - Set to the first version
+
+	@return The number of versions
+
+------------------------------------------------------------------------*/
+unsigned int rviPatternVersions ( const TRviPatternVersion** versions )
+{
+    unsigned int count = 1;
+
+#ifdef RVI_PATTERN_X86
+    __builtin_cpu_init ();
+
+    count = __builtin_cpu_supports ( "avx2" ) ? 3 : 2;
+#endif
+
+    *versions = rviPatternVersionList;
+
+    return count;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ c o m p a r e _ p a t t e r n
+
+	@brief Compare an RVI pattern to a fully-qualified service name.
+
+	The version of the matcher is picked on the first call.  Threads racing
+    on the first call all pick the same version, so the unsynchronized
+    store is harmless.
+
+	@param[in] pattern - The pattern
+	@param[in] fqsn - The fully-qualified service name
+
+	@return 0 if the name matches the pattern, an error code otherwise
+
+------------------------------------------------------------------------*/
+int rviComparePattern ( const char* pattern, const char* fqsn )
+{
+    static TRviPatternCompare compare = NULL;
+
+    if ( !pattern || !fqsn )
+    {
+        return EINVAL;
+    }
+    if ( !compare )
+    {
+        const TRviPatternVersion* versions;
+        unsigned int              count = rviPatternVersions ( &versions );
+
+        compare = versions[count - 1].compare;
+    }
+    return compare ( pattern, fqsn );
+}
@@ -0,0 +1,51 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_PATTERN_H_
+#define _RVI_PATTERN_H_
+
+//
+//  Compare an RVI pattern to a fully-qualified service name.  Returns 0
+//  (RVI_OK) if the name matches the pattern, EINVAL if either argument is
+//  NULL or -1 otherwise.  A pattern whose last segment holds a '+' matches
+//  nothing.
+//
+//  The comparison is done with SSE2 or AVX2 when the processor has them,
+//  picked the first time the function is called.  Every version gives the
+//  same results as rviComparePatternScalar.
+//
+int rviComparePattern ( const char* pattern, const char* fqsn );
+
+//
+//  The portable version of rviComparePattern, comparing a byte at a time.
+//
+int rviComparePatternScalar ( const char* pattern, const char* fqsn );
+
+//
+//  A version of the matcher.  Unlike rviComparePattern, the compare
+//  function must not be given NULL strings.
+//
+typedef int (*TRviPatternCompare) ( const char* pattern, const char* fqsn );
+
+typedef struct TRviPatternVersion
+{
+    const char*        name;    // "scalar", "sse2" or "avx2"
+    TRviPatternCompare compare;
+
+}   TRviPatternVersion;
+
+//
+//  List the versions of the matcher that this processor can run, from the
+//  portable one to the one that rviComparePattern uses.  Returns the number
+//  of versions and sets *versions to the first of them.
+//
+unsigned int rviPatternVersions ( const TRviPatternVersion** versions );
+
+
+#endif // _RVI_PATTERN_H_
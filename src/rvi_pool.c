@@ -0,0 +1,257 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rvi_pool.h"
+
+
+//
+//  Run items of the current job until there are none left to hand out.
+//
+static void rviPoolWork ( TRviPool* pool, TRviPoolTask task, void* context,
+                          size_t size )
+{
+    size_t index;
+
+    while ( ( index = __atomic_fetch_add ( &pool->next, 1,
+                                           __ATOMIC_RELAXED ) ) < size )
+    {
+        task ( context, index );
+    }
+}
+
+//
+//  The body of each worker thread: wait for a job, help with it, and report
+//  when done, until the pool is shut down.
+//
+static void* rviPoolWorker ( void* arg )
+{
+    TRviPool*     pool = arg;
+    unsigned long seen = 0;
+    TRviPoolTask  task;
+    void*         context;
+    size_t        size;
+
+    pthread_mutex_lock ( &pool->lock );
+
+    for ( ;; )
+    {
+        while ( pool->generation == seen && !pool->stop )
+        {
+            pthread_cond_wait ( &pool->start, &pool->lock );
+        }
+        if ( pool->stop )
+        {
+            break;
+        }
+        seen    = pool->generation;
+        task    = pool->task;
+        context = pool->context;
+        size    = pool->size;
+
+        pthread_mutex_unlock ( &pool->lock );
+
+        rviPoolWork ( pool, task, context, size );
+
+        pthread_mutex_lock ( &pool->lock );
+
+        if ( --pool->busy == 0 )
+        {
+            pthread_cond_signal ( &pool->done );
+        }
+    }
+    pthread_mutex_unlock ( &pool->lock );
+
+    return NULL;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ p o o l _ i n i t i a l i z e
+
+	@brief Initialize a pool and start its worker threads.
+
+	If fewer threads can be started than asked for, the pool works with the
+    ones that did start.  A pool without any workers runs every job in the
+    calling thread.
+
+	@param[in] pool - The address of the pool structure to initialize
+	@param[in] threads - The number of worker threads, or RVI_POOL_ONLINE
+                         for one less than the number of online processors
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviPoolInitialize ( TRviPool* pool, unsigned int threads )
+{
+    long online;
+    int  status;
+
+    memset ( pool, 0, sizeof(TRviPool) );
+
+    if ( threads == RVI_POOL_ONLINE )
+    {
+        online  = sysconf ( _SC_NPROCESSORS_ONLN );
+        threads = online > 1 ? (unsigned int)( online - 1 ) : 0;
+    }
+    if ( threads > RVI_POOL_MAX_THREADS )
+    {
+        threads = RVI_POOL_MAX_THREADS;
+    }
+
+    if ( ( status = pthread_mutex_init ( &pool->lock, NULL ) ) != 0 )
+    {
+        return status;
+    }
+    if ( ( status = pthread_cond_init ( &pool->start, NULL ) ) != 0 )
+    {
+        pthread_mutex_destroy ( &pool->lock );
+        return status;
+    }
+    if ( ( status = pthread_cond_init ( &pool->done, NULL ) ) != 0 )
+    {
+        pthread_cond_destroy ( &pool->start );
+        pthread_mutex_destroy ( &pool->lock );
+        return status;
+    }
+    pool->ready = true;
+
+    if ( threads == 0 )
+    {
+        return 0;
+    }
+    pool->threads = malloc ( threads * sizeof(pthread_t) );
+    if ( !pool->threads )
+    {
+        return 0;
+    }
+    while ( pool->count < threads &&
+            pthread_create ( &pool->threads[pool->count], NULL,
+                             rviPoolWorker, pool ) == 0 )
+    {
+        pool->count++;
+    }
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ p o o l _ r u n
+
+	@brief Run a task for every item of a job and wait for all of them.
+
+	A job of a single item is run in the calling thread without waking the
+    workers.
+
+	@param[in] pool - The address of the pool
+	@param[in] size - The number of items in the job
+	@param[in] task - The function to run for each item
+	@param[in] context - Passed to every call of the task
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviPoolRun ( TRviPool* pool, size_t size, TRviPoolTask task,
+                 void* context )
+{
+    size_t index;
+
+    if ( !pool->ready || !task )
+    {
+        return EINVAL;
+    }
+    if ( pool->count == 0 || size < 2 )
+    {
+        for ( index = 0; index < size; index++ )
+        {
+            task ( context, index );
+        }
+        return 0;
+    }
+
+    pthread_mutex_lock ( &pool->lock );
+
+    pool->task    = task;
+    pool->context = context;
+    pool->size    = size;
+    pool->next    = 0;
+    pool->busy    = pool->count;
+    pool->generation++;
+
+    pthread_cond_broadcast ( &pool->start );
+    pthread_mutex_unlock ( &pool->lock );
+
+    rviPoolWork ( pool, task, context, size );
+
+    //
+    //  Every worker has to see the job before the next one can start, even
+    //  if there was nothing left for it to do.
+    //
+    pthread_mutex_lock ( &pool->lock );
+
+    while ( pool->busy > 0 )
+    {
+        pthread_cond_wait ( &pool->done, &pool->lock );
+    }
+    pthread_mutex_unlock ( &pool->lock );
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ p o o l _ d e s t r o y
+
+	@brief Stop the worker threads and release the pool.
+
+	It is safe to destroy a pool structure that was zeroed but never
+    initialized.
+
+	@param[in] pool - The address of the pool to destroy
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviPoolDestroy ( TRviPool* pool )
+{
+    unsigned int i;
+
+    if ( !pool->ready )
+    {
+        return;
+    }
+    pthread_mutex_lock ( &pool->lock );
+
+    pool->stop = true;
+
+    pthread_cond_broadcast ( &pool->start );
+    pthread_mutex_unlock ( &pool->lock );
+
+    for ( i = 0; i < pool->count; i++ )
+    {
+        pthread_join ( pool->threads[i], NULL );
+    }
+    free ( pool->threads );
+
+    pthread_cond_destroy ( &pool->done );
+    pthread_cond_destroy ( &pool->start );
+    pthread_mutex_destroy ( &pool->lock );
+
+    memset ( pool, 0, sizeof(TRviPool) );
+}
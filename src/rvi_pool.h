@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_POOL_H_
+#define _RVI_POOL_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//
+//  The largest number of worker threads a pool will start.
+//
+#define RVI_POOL_MAX_THREADS ( 64 )
+
+//
+//  Asks rviPoolInitialize for one worker thread for each online processor
+//  after the first.
+//
+#define RVI_POOL_ONLINE ( ~0u )
+
+//
+//  The function run for each item of a job.  It is called once for every
+//  index from 0 up to the number of items, from any of the threads, in no
+//  particular order.  Each call must only write to the result for its own
+//  index; the results can then be used in index order once the job is done.
+//
+typedef void (*TRviPoolTask) ( void* context, size_t index );
+
+//
+//  A small pool of worker threads for running batches of independent items
+//  on all cores.  The thread that runs a job works on it too, and does not
+//  return until every item is done.
+//
+//  Only one job runs at a time, and jobs must be started from one thread.
+//
+typedef struct TRviPool
+{
+    pthread_t*      threads;    // The worker threads
+    unsigned int    count;      // The number of worker threads
+    bool            ready;      // The pool has been initialized
+
+    pthread_mutex_t lock;       // Protects the rest of the structure
+    pthread_cond_t  start;      // Signaled when a job starts or at shutdown
+    pthread_cond_t  done;       // Signaled when the last worker finishes
+
+    TRviPoolTask    task;       // The current job
+    void*           context;
+    size_t          size;       // The number of items in the job
+    size_t          next;       // The next item to be handed out
+    unsigned int    busy;       // The workers that have not finished the job
+    unsigned long   generation; // Counts the jobs started so far
+    bool            stop;       // The workers must exit
+
+}   TRviPool;
+
+
+int rviPoolInitialize ( TRviPool* pool, unsigned int threads );
+
+int rviPoolRun ( TRviPool* pool, size_t size, TRviPoolTask task,
+                 void* context );
+
+void rviPoolDestroy ( TRviPool* pool );
+
+
+#endif // _RVI_POOL_H_
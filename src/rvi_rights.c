@@ -0,0 +1,472 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_rights.h"
+
+//
+//  The number of literal edges allocated the first time a state gets one.
+//  The arrays are doubled whenever they fill up.
+//
+#define RIGHTS_MIN_EDGES ( 4 )
+
+//
+//  The number of states a match can track without allocating memory.
+//
+#define RIGHTS_STACK_STATES ( 32 )
+
+
+//
+//  Free everything reachable from a state, but not the state itself.
+//
+static void rviRightsClearNode ( TRviRightsTrie* trie, TRviRightsNode* node )
+{
+    unsigned int i;
+
+    for ( i = 0; i < node->count; i++ )
+    {
+        rviRightsClearNode ( trie, node->next[i] );
+        free ( node->next[i] );
+    }
+    if ( node->plus )
+    {
+        rviRightsClearNode ( trie, node->plus );
+        free ( node->plus );
+        trie->plusCount--;
+    }
+    free ( node->labels );
+    free ( node->next );
+
+    memset ( node, 0, sizeof(TRviRightsNode) );
+}
+
+//
+//  Return the state reached from the given one by the literal edge for c, or
+//  NULL if there is no such edge.
+//
+static TRviRightsNode* rviRightsFindEdge ( TRviRightsNode* node,
+                                           unsigned char c )
+{
+    unsigned char* label;
+
+    if ( !node->count )
+    {
+        return NULL;
+    }
+    label = memchr ( node->labels, c, node->count );
+
+    return label ? node->next[label - node->labels] : NULL;
+}
+
+//
+//  Return the state reached from the given one by the literal edge for c,
+//  adding the edge and the state if needed.
+//
+static TRviRightsNode* rviRightsAddEdge ( TRviRightsNode* node,
+                                          unsigned char c )
+{
+    TRviRightsNode*  child = rviRightsFindEdge ( node, c );
+    TRviRightsNode** next;
+    unsigned char*   labels;
+    unsigned int     size;
+
+    if ( child )
+    {
+        return child;
+    }
+    if ( node->count == node->size )
+    {
+        size = node->size ? node->size * 2 : RIGHTS_MIN_EDGES;
+
+        labels = realloc ( node->labels, size );
+        if ( !labels )
+        {
+            return NULL;
+        }
+        node->labels = labels;
+
+        next = realloc ( node->next, size * sizeof(TRviRightsNode*) );
+        if ( !next )
+        {
+            return NULL;
+        }
+        node->next = next;
+        node->size = size;
+    }
+    child = calloc ( 1, sizeof(TRviRightsNode) );
+    if ( !child )
+    {
+        return NULL;
+    }
+    node->labels[node->count] = c;
+    node->next[node->count]   = child;
+    node->count++;
+
+    return child;
+}
+
+//
+//  Return the rest of a string after the '/' that ends its first segment,
+//  or the end of the string if there is none.
+//
+static const char* rviRightsSkipSegment ( const char* s )
+{
+    const char* slash = strchr ( s, '/' );
+
+    return slash ? slash + 1 : s + strlen ( s );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ r i g h t s _ t r i e _ i n i t i a l i z e
+
+	@brief Initialize a new, empty set of rights patterns.
+
+	An empty set matches no names.
+
+	@param[in] trie - The address of the set to initialize
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviRightsTrieInitialize ( TRviRightsTrie* trie )
+{
+    memset ( trie, 0, sizeof(TRviRightsTrie) );
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ r i g h t s _ t r i e _ a d d
+
+	@brief Compile a pattern into the set.
+
+	A '+' in a pattern stands for the rest of a segment: the characters of
+    the pattern after it, up to and including the next '/', are skipped and
+    it consumes the same part of the name.  The character after that is
+    always compiled as a literal edge, since rviComparePattern compares it
+    without looking for another '+'.  If nothing is left of the pattern
+    after a '+', the pattern matches nothing and no states are added for it.
+
+	A pattern that extends one already in the set adds nothing, since every
+    name it matches is matched by the shorter one already; adding a pattern
+    that is a prefix of ones already in the set frees the states they no
+    longer need.
+
+	@param[in] trie - The address of the set
+	@param[in] pattern - The pattern to add
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviRightsTrieAdd ( TRviRightsTrie* trie, const char* pattern )
+{
+    TRviRightsNode* node    = &trie->root;
+    const char*     p       = pattern;
+    bool            literal = false;
+
+    if ( !pattern )
+    {
+        return EINVAL;
+    }
+    while ( *p != '\0' )
+    {
+        if ( node->accept )
+        {
+            trie->count++;
+            return 0;
+        }
+        if ( *p == '+' && !literal )
+        {
+            p = rviRightsSkipSegment ( p );
+            if ( *p == '\0' )
+            {
+                trie->count++;
+                return 0;
+            }
+            if ( !node->plus )
+            {
+                node->plus = calloc ( 1, sizeof(TRviRightsNode) );
+                if ( !node->plus )
+                {
+                    return ENOMEM;
+                }
+                trie->plusCount++;
+            }
+            node    = node->plus;
+            literal = true;
+        }
+        else
+        {
+            node = rviRightsAddEdge ( node, (unsigned char)*p++ );
+            if ( !node )
+            {
+                return ENOMEM;
+            }
+            literal = false;
+        }
+    }
+    rviRightsClearNode ( trie, node );
+    node->accept = true;
+    trie->count++;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ r i g h t s _ t r i e _ m a t c h
+
+	@brief Check whether any pattern in the set matches a name.
+
+	The name is read once, one character at a time, while every state that
+    the characters so far lead to is tracked at once.  The states reached by
+    the plus edges of the current states wait until the name reaches the
+    character after its next '/', which is where the skip of every '+' taken
+    within this segment ends.  A state is never active at two places in the
+    name, so there are never more states than plus states plus the root.
+
+	@param[in] trie - The address of the set
+	@param[in] name - The fully qualified service name to check
+
+	@return true if some pattern matches the name, false if none does or
+            the memory needed to check cannot be allocated
+
+------------------------------------------------------------------------*/
+bool rviRightsTrieMatch ( TRviRightsTrie* trie, const char* name )
+{
+    TRviRightsNode*  stack[3 * RIGHTS_STACK_STATES];
+    TRviRightsNode** states;    // The states at the current character
+    TRviRightsNode** next;      // The states at the next character
+    TRviRightsNode** pending;   // The states waiting for the next segment
+    TRviRightsNode** swap;
+    TRviRightsNode*  child;
+    unsigned int     size = trie->plusCount + 1;
+    unsigned int     count;
+    unsigned int     nextCount;
+    unsigned int     pendingCount = 0;
+    unsigned int     i;
+    unsigned char    c;
+    bool             match = false;
+
+    if ( !name || !trie->count )
+    {
+        return false;
+    }
+    if ( size <= RIGHTS_STACK_STATES )
+    {
+        states = stack;
+    }
+    else if ( !( states = malloc ( 3 * size * sizeof(TRviRightsNode*) ) ) )
+    {
+        return false;
+    }
+    next    = states + size;
+    pending = next + size;
+
+    states[0] = &trie->root;
+    count     = 1;
+
+    for ( ; ; name++ )
+    {
+        for ( i = 0; i < count && !match; i++ )
+        {
+            match = states[i]->accept;
+        }
+        c = (unsigned char)*name;
+
+        if ( match || c == '\0' || ( count == 0 && pendingCount == 0 ) )
+        {
+            break;
+        }
+        nextCount = 0;
+
+        for ( i = 0; i < count; i++ )
+        {
+            if ( states[i]->plus )
+            {
+                pending[pendingCount++] = states[i]->plus;
+            }
+            if ( ( child = rviRightsFindEdge ( states[i], c ) ) )
+            {
+                next[nextCount++] = child;
+            }
+        }
+        if ( c == '/' )
+        {
+            for ( i = 0; i < pendingCount; i++ )
+            {
+                next[nextCount++] = pending[i];
+            }
+            pendingCount = 0;
+        }
+        swap   = states;
+        states = next;
+        next   = swap;
+        count  = nextCount;
+    }
+    if ( size > RIGHTS_STACK_STATES )
+    {
+        free ( states < next ? states : next );
+    }
+    return match;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ r i g h t s _ t r i e _ d e s t r o y
+
+	@brief Free all of the states of the set.
+
+	The set is left empty and may be used again.
+
+	@param[in] trie - The address of the set to destroy
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviRightsTrieDestroy ( TRviRightsTrie* trie )
+{
+    rviRightsClearNode ( trie, &trie->root );
+    trie->count = 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ r i g h t s _ c a c h e _ i n i t i a l i z e
+
+	@brief Initialize a new, empty decision cache.
+
+	@param[in] cache - The address of the cache to initialize
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviRightsCacheInitialize ( TRviRightsCache* cache )
+{
+    memset ( cache, 0, sizeof(TRviRightsCache) );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ r i g h t s _ c a c h e _ g e t
+
+	@brief Look up a cached decision.
+
+	Every call counts as a hit or a miss in the cache's counters.
+
+	@param[in] cache - The address of the cache
+	@param[in] hash - The hash of the name
+	@param[in] name - The service name
+	@param[in] kind - RVI_RIGHTS_RECEIVE or RVI_RIGHTS_INVOKE
+
+	@return 1 if allowed, 0 if denied or -1 if there is no decision cached
+
+------------------------------------------------------------------------*/
+int rviRightsCacheGet ( TRviRightsCache* cache, uint64_t hash,
+                        const char* name, int kind )
+{
+    TRviRightsCacheEntry* entry;
+
+    entry = &cache->entries[hash & ( RVI_RIGHTS_CACHE_SIZE - 1 )];
+
+    if ( entry->name && entry->hash == hash &&
+         entry->decision[kind] >= 0 && strcmp ( entry->name, name ) == 0 )
+    {
+        cache->hits++;
+        return entry->decision[kind];
+    }
+    cache->misses++;
+
+    return -1;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ r i g h t s _ c a c h e _ p u t
+
+	@brief Remember a decision.
+
+	If the entry the name maps to holds another name, that name's decisions
+    are replaced.
+
+	@param[in] cache - The address of the cache
+	@param[in] hash - The hash of the name
+	@param[in] name - The service name
+	@param[in] kind - RVI_RIGHTS_RECEIVE or RVI_RIGHTS_INVOKE
+	@param[in] allowed - The decision
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviRightsCachePut ( TRviRightsCache* cache, uint64_t hash,
+                         const char* name, int kind, bool allowed )
+{
+    TRviRightsCacheEntry* entry;
+    char*                 copy;
+
+    entry = &cache->entries[hash & ( RVI_RIGHTS_CACHE_SIZE - 1 )];
+
+    if ( !entry->name || entry->hash != hash ||
+         strcmp ( entry->name, name ) != 0 )
+    {
+        //
+        //  If the copy cannot be made, the old entry is simply kept.
+        //
+        if ( !( copy = strdup ( name ) ) )
+        {
+            return;
+        }
+        free ( entry->name );
+
+        entry->hash = hash;
+        entry->name = copy;
+        memset ( entry->decision, -1, sizeof(entry->decision) );
+    }
+    entry->decision[kind] = allowed ? 1 : 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ r i g h t s _ c a c h e _ f l u s h
+
+	@brief Forget every cached decision.
+
+	The hit and miss counters are kept.
+
+	@param[in] cache - The address of the cache
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviRightsCacheFlush ( TRviRightsCache* cache )
+{
+    unsigned int i;
+
+    for ( i = 0; i < RVI_RIGHTS_CACHE_SIZE; i++ )
+    {
+        free ( cache->entries[i].name );
+        cache->entries[i].name = NULL;
+    }
+}
@@ -0,0 +1,118 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_RIGHTS_H_
+#define _RVI_RIGHTS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+//  The number of entries in a rights decision cache.  This must be a power
+//  of 2.
+//
+#define RVI_RIGHTS_CACHE_SIZE ( 32 )
+
+//
+//  The kinds of right that a decision cache entry remembers.
+//
+#define RVI_RIGHTS_RECEIVE ( 0 )
+#define RVI_RIGHTS_INVOKE  ( 1 )
+#define RVI_RIGHTS_KINDS   ( 2 )
+
+//
+//  A state of the rights automaton.  Each literal edge is labeled with the
+//  character it consumes; the labels are kept in an array of their own so
+//  that the edge for a character can be found with memchr.  The plus edge
+//  stands for a '+' in a pattern and consumes the rest of a segment of the
+//  name, including the '/' that ends it.  A state reached by a plus edge
+//  has only literal edges.
+//
+typedef struct TRviRightsNode
+{
+    unsigned char*          labels;     // The character of each literal edge
+    struct TRviRightsNode** next;       // The state each literal edge leads to
+    unsigned int            count;      // The number of literal edges
+    unsigned int            size;       // The allocated size of the arrays
+    struct TRviRightsNode*  plus;       // The state the plus edge leads to
+    bool                    accept;     // A pattern ends at this state
+
+}   TRviRightsNode;
+
+//
+//  A set of rights patterns compiled into a single automaton.  Patterns
+//  sharing a prefix share the states for it, so checking a name is one pass
+//  over its characters no matter how many patterns are in the set; only a
+//  '+' makes the match try both the wildcard and the literal edges.
+//
+//  The patterns are matched exactly as rviComparePattern matches them.  A
+//  '+' skips the rest of the segment it is in, in both the pattern and the
+//  name, and the character after it must then match literally, even if it
+//  is another '+'.  Anything else must match literally, and a pattern
+//  matches every name that it is a prefix of.  A pattern whose last segment
+//  holds a '+' matches nothing.
+//
+typedef struct TRviRightsTrie
+{
+    TRviRightsNode root;
+    unsigned int   count;       // The number of patterns added
+    unsigned int   plusCount;   // The number of states reached by plus edges
+
+}   TRviRightsTrie;
+
+
+//
+//  A cache entry holds the decisions made for one service name.  Each
+//  decision is 1 (allowed), 0 (denied) or -1 (not decided yet).
+//
+typedef struct TRviRightsCacheEntry
+{
+    uint64_t    hash;                       // The hash of the name
+    char*       name;                       // A copy of the name or NULL
+    signed char decision[RVI_RIGHTS_KINDS];
+
+}   TRviRightsCacheEntry;
+
+//
+//  A small direct mapped cache of rights decisions by service name.  The
+//  same few services are checked against the same rights over and over, and
+//  a hit answers without running the automaton.  The owner must flush the
+//  cache whenever the rights it caches change.  The hit and miss counts are
+//  reported to applications by rviGetRightsCacheStats.
+//
+typedef struct TRviRightsCache
+{
+    TRviRightsCacheEntry entries[RVI_RIGHTS_CACHE_SIZE];
+    unsigned long        hits;
+    unsigned long        misses;
+
+}   TRviRightsCache;
+
+
+int rviRightsTrieInitialize ( TRviRightsTrie* trie );
+
+int rviRightsTrieAdd ( TRviRightsTrie* trie, const char* pattern );
+
+bool rviRightsTrieMatch ( TRviRightsTrie* trie, const char* name );
+
+void rviRightsTrieDestroy ( TRviRightsTrie* trie );
+
+void rviRightsCacheInitialize ( TRviRightsCache* cache );
+
+int rviRightsCacheGet ( TRviRightsCache* cache, uint64_t hash,
+                        const char* name, int kind );
+
+void rviRightsCachePut ( TRviRightsCache* cache, uint64_t hash,
+                         const char* name, int kind, bool allowed );
+
+void rviRightsCacheFlush ( TRviRightsCache* cache );
+
+
+#endif // _RVI_RIGHTS_H_
@@ -0,0 +1,243 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_timer.h"
+
+
+//
+//  Move the entry at the given position towards the top of the heap until
+//  its parent is due no later than it is.
+//
+static void rviTimerSiftUp ( TRviTimerHeap* heap, unsigned int i )
+{
+    TRviTimerEntry entry = heap->entries[i];
+    unsigned int   parent;
+
+    while ( i > 0 )
+    {
+        parent = ( i - 1 ) / 2;
+        if ( heap->entries[parent].deadline <= entry.deadline )
+        {
+            break;
+        }
+        heap->entries[i] = heap->entries[parent];
+        i = parent;
+    }
+    heap->entries[i] = entry;
+}
+
+//
+//  Move the entry at the given position towards the bottom of the heap until
+//  neither of its children is due before it is.
+//
+static void rviTimerSiftDown ( TRviTimerHeap* heap, unsigned int i )
+{
+    TRviTimerEntry entry = heap->entries[i];
+    unsigned int   child;
+
+    while ( ( child = 2 * i + 1 ) < heap->count )
+    {
+        if ( child + 1 < heap->count &&
+             heap->entries[child + 1].deadline < heap->entries[child].deadline )
+        {
+            child++;
+        }
+        if ( entry.deadline <= heap->entries[child].deadline )
+        {
+            break;
+        }
+        heap->entries[i] = heap->entries[child];
+        i = child;
+    }
+    heap->entries[i] = entry;
+}
+
+//
+//  Take the entry at the given position out of the heap.
+//
+static void rviTimerRemoveAt ( TRviTimerHeap* heap, unsigned int i )
+{
+    heap->count--;
+    if ( i == heap->count )
+    {
+        return;
+    }
+    heap->entries[i] = heap->entries[heap->count];
+
+    rviTimerSiftDown ( heap, i );
+    rviTimerSiftUp ( heap, i );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t i m e r _ i n i t i a l i z e
+
+	@brief Initialize a new, empty timer heap.
+
+	No memory is obtained from the system until the first record is
+    inserted.
+
+	@param[in] heap - The address of the heap structure to initialize
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviTimerInitialize ( TRviTimerHeap* heap )
+{
+    heap->entries = NULL;
+    heap->count   = 0;
+    heap->size    = 0;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t i m e r _ i n s e r t
+
+	@brief Schedule a record for the given deadline.
+
+	The caller must make sure that the record is not in the heap already;
+    to move a record to a new deadline, remove it first.
+
+	@param[in] heap - The address of the heap
+	@param[in] deadline - The time the record is due
+	@param[in] record - The record to be scheduled
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviTimerInsert ( TRviTimerHeap* heap, long deadline, void* record )
+{
+    TRviTimerEntry* entries;
+    unsigned int    size;
+
+    if ( !record )
+    {
+        return EINVAL;
+    }
+    if ( heap->count == heap->size )
+    {
+        size = heap->size ? heap->size * 2 : RVI_TIMER_MIN_SIZE;
+
+        entries = realloc ( heap->entries, size * sizeof(TRviTimerEntry) );
+        if ( !entries )
+        {
+            return ENOMEM;
+        }
+        heap->entries = entries;
+        heap->size    = size;
+    }
+    heap->entries[heap->count].deadline = deadline;
+    heap->entries[heap->count].record   = record;
+
+    rviTimerSiftUp ( heap, heap->count++ );
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t i m e r _ r e m o v e
+
+	@brief Cancel the deadline of a record.
+
+	The heap is not indexed by record, so the record is found by a linear
+    search.  Records are only removed when their owner goes away, which is
+    much rarer than checking what is due.
+
+	@param[in] heap - The address of the heap
+	@param[in] record - The record to be removed
+
+	@return status - 0: Success
+                    ~0: An error code (ENOENT if the record is not there)
+
+------------------------------------------------------------------------*/
+int rviTimerRemove ( TRviTimerHeap* heap, void* record )
+{
+    unsigned int i;
+
+    for ( i = 0; i < heap->count; i++ )
+    {
+        if ( heap->entries[i].record == record )
+        {
+            rviTimerRemoveAt ( heap, i );
+            return 0;
+        }
+    }
+    return ENOENT;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t i m e r _ e x p i r e
+
+	@brief Take the next record that is due out of the heap.
+
+	To handle every record that is due:
+
+        while ( ( record = rviTimerExpire ( heap, now ) ) )
+        {
+            ...
+        }
+
+	@param[in] heap - The address of the heap
+	@param[in] now - The current time
+
+	@return The record with the earliest deadline at or before now, or NULL
+            if nothing is due
+
+------------------------------------------------------------------------*/
+void* rviTimerExpire ( TRviTimerHeap* heap, long now )
+{
+    void* record;
+
+    if ( !heap->count || heap->entries[0].deadline > now )
+    {
+        return NULL;
+    }
+    record = heap->entries[0].record;
+
+    rviTimerRemoveAt ( heap, 0 );
+
+    return record;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t i m e r _ d e s t r o y
+
+	@brief Release all memory held by the heap.
+
+	The records themselves are not touched.  The heap may be used again
+    after this call.
+
+	@param[in] heap - The address of the heap to destroy
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviTimerDestroy ( TRviTimerHeap* heap )
+{
+    free ( heap->entries );
+
+    rviTimerInitialize ( heap );
+}
@@ -0,0 +1,65 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_TIMER_H_
+#define _RVI_TIMER_H_
+
+//
+//  The number of entries allocated the first time a timer is inserted.  The
+//  array is doubled whenever it fills up.
+//
+#define RVI_TIMER_MIN_SIZE ( 16 )
+
+//
+//  A record that is due at the given time, in seconds since the epoch.
+//
+typedef struct TRviTimerEntry
+{
+    long  deadline;
+    void* record;
+
+}   TRviTimerEntry;
+
+//
+//  A binary min-heap of records ordered by deadline.  The earliest deadline
+//  is always at the top, so finding out whether anything is due is a single
+//  comparison and each record that comes due costs a logarithmic amount of
+//  work when it does.
+//
+//  A record may be in the heap at most once.
+//
+typedef struct TRviTimerHeap
+{
+    TRviTimerEntry* entries;    // The heap, earliest deadline first
+    unsigned int    count;      // The number of entries in the heap
+    unsigned int    size;       // The allocated size of the array
+
+}   TRviTimerHeap;
+
+
+int rviTimerInitialize ( TRviTimerHeap* heap );
+
+int rviTimerInsert ( TRviTimerHeap* heap, long deadline, void* record );
+
+int rviTimerRemove ( TRviTimerHeap* heap, void* record );
+
+void* rviTimerExpire ( TRviTimerHeap* heap, long now );
+
+void rviTimerDestroy ( TRviTimerHeap* heap );
+
+//
+//  Return the earliest deadline in the heap or 0 if the heap is empty.
+//
+static inline long rviTimerNext ( TRviTimerHeap* heap )
+{
+    return heap->count ? heap->entries[0].deadline : 0;
+}
+
+
+#endif // _RVI_TIMER_H_
@@ -0,0 +1,506 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_trie.h"
+
+//
+//  The number of child pointers allocated the first time a node gets a
+//  child.  The array is doubled whenever it fills up.
+//
+#define TRIE_MIN_CHILDREN ( 4 )
+
+//
+//  Return the length of the segment at the start of the given string.
+//
+#define SEGMENT_LENGTH( s ) ( strcspn ( (s), "/" ) )
+
+
+//
+//  Compare the segment of a node to the segment of the given length at s.
+//
+static int rviTrieCompare ( const char* segment, const char* s,
+                            size_t length )
+{
+    int result = strncmp ( segment, s, length );
+
+    if ( result == 0 && segment[length] != '\0' )
+    {
+        result = 1;
+    }
+    return result;
+}
+
+//
+//  Return the index of the first child of a node whose segment is not less
+//  than the segment of the given length at s.  If prefix is true, only the
+//  first length characters of the child segments are compared, which finds
+//  the first child whose segment starts with s.
+//
+static unsigned int rviTrieLowerBound ( TRviTrieNode* node, const char* s,
+                                        size_t length, int prefix )
+{
+    unsigned int low  = 0;
+    unsigned int high = node->childCount;
+    unsigned int mid;
+    int          result;
+
+    while ( low < high )
+    {
+        mid = low + ( high - low ) / 2;
+
+        if ( prefix )
+        {
+            result = strncmp ( node->children[mid]->segment, s, length );
+        }
+        else
+        {
+            result = rviTrieCompare ( node->children[mid]->segment, s,
+                                      length );
+        }
+        if ( result < 0 )
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+//
+//  Return the child of a node for the segment of the given length at s, or
+//  NULL if there is none.
+//
+static TRviTrieNode* rviTrieFindChild ( TRviTrieNode* node, const char* s,
+                                        size_t length )
+{
+    unsigned int i = rviTrieLowerBound ( node, s, length, 0 );
+
+    if ( i < node->childCount &&
+         rviTrieCompare ( node->children[i]->segment, s, length ) == 0 )
+    {
+        return node->children[i];
+    }
+    return NULL;
+}
+
+//
+//  Allocate a new node for the segment of the given length at s.
+//
+static TRviTrieNode* rviTrieNewNode ( const char* s, size_t length )
+{
+    TRviTrieNode* node = malloc ( sizeof(TRviTrieNode) + length + 1 );
+
+    if ( node )
+    {
+        node->children   = NULL;
+        node->childCount = 0;
+        node->childSize  = 0;
+        node->record     = NULL;
+        memcpy ( node->segment, s, length );
+        node->segment[length] = '\0';
+    }
+    return node;
+}
+
+//
+//  Free a node and everything below it.
+//
+static void rviTrieFreeNode ( TRviTrieNode* node )
+{
+    unsigned int i;
+
+    for ( i = 0; i < node->childCount; i++ )
+    {
+        rviTrieFreeNode ( node->children[i] );
+    }
+    free ( node->children );
+    free ( node );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ i n i t i a l i z e
+
+	@brief Initialize a new trie.
+
+	The root node stands for the empty prefix and never holds a record.
+
+	@param[in] trie - The address of the trie structure to initialize
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviTrieInitialize ( TRviTrie* trie )
+{
+    trie->count = 0;
+    trie->root  = rviTrieNewNode ( "", 0 );
+
+    return trie->root ? 0 : ENOMEM;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ r e m o v e _ f r o m
+
+	@brief Remove the record with the given name from below a node.
+
+	This function follows the name down the trie and takes the record off
+    the node where the name ends.  On the way back up, every node that was
+    left with neither a record nor children is freed and dropped from its
+    parent.  It is also used to clean up the empty nodes left behind by an
+    insert that ran out of memory.
+
+	@param[in] node - The node to start at
+	@param[in] name - The rest of the name, starting with a segment
+
+	@return The record that was removed or NULL if there was none
+
+------------------------------------------------------------------------*/
+static void* rviTrieRemoveFrom ( TRviTrieNode* node, const char* name )
+{
+    size_t        length = SEGMENT_LENGTH ( name );
+    unsigned int  i      = rviTrieLowerBound ( node, name, length, 0 );
+    TRviTrieNode* child;
+    void*         record;
+
+    if ( i == node->childCount ||
+         rviTrieCompare ( node->children[i]->segment, name, length ) != 0 )
+    {
+        return NULL;
+    }
+    child = node->children[i];
+
+    if ( name[length] == '\0' )
+    {
+        record        = child->record;
+        child->record = NULL;
+    }
+    else
+    {
+        record = rviTrieRemoveFrom ( child, name + length + 1 );
+    }
+
+    if ( !child->record && child->childCount == 0 )
+    {
+        memmove ( &node->children[i], &node->children[i + 1],
+                  ( node->childCount - i - 1 ) * sizeof(TRviTrieNode*) );
+        node->childCount--;
+        rviTrieFreeNode ( child );
+    }
+    return record;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ i n s e r t
+
+	@brief Insert a record into the trie.
+
+	The name is split on '/' and a node is created for each segment that is
+    not in the trie yet.
+
+	@param[in] trie - The address of the trie
+	@param[in] name - The name of the record
+	@param[in] record - The record to be inserted
+
+	@return status - 0: Success
+                    ~0: An error code (EEXIST if the name is taken)
+
+------------------------------------------------------------------------*/
+int rviTrieInsert ( TRviTrie* trie, const char* name, void* record )
+{
+    TRviTrieNode*  node = trie->root;
+    TRviTrieNode*  child;
+    TRviTrieNode** children;
+    const char*    s    = name;
+    size_t         length;
+    unsigned int   i;
+
+    if ( !name || !*name || !record )
+    {
+        return EINVAL;
+    }
+    while ( true )
+    {
+        length = SEGMENT_LENGTH ( s );
+        i      = rviTrieLowerBound ( node, s, length, 0 );
+
+        if ( i < node->childCount &&
+             rviTrieCompare ( node->children[i]->segment, s, length ) == 0 )
+        {
+            child = node->children[i];
+        }
+        else
+        {
+            if ( node->childCount == node->childSize )
+            {
+                unsigned int size = node->childSize ? node->childSize * 2
+                                                    : TRIE_MIN_CHILDREN;
+
+                children = realloc ( node->children,
+                                     size * sizeof(TRviTrieNode*) );
+                if ( !children )
+                {
+                    goto err;
+                }
+                node->children  = children;
+                node->childSize = size;
+            }
+            child = rviTrieNewNode ( s, length );
+            if ( !child )
+            {
+                goto err;
+            }
+            memmove ( &node->children[i + 1], &node->children[i],
+                      ( node->childCount - i ) * sizeof(TRviTrieNode*) );
+            node->children[i] = child;
+            node->childCount++;
+        }
+        if ( s[length] == '\0' )
+        {
+            break;
+        }
+        node = child;
+        s   += length + 1;
+    }
+    if ( child->record )
+    {
+        return EEXIST;
+    }
+    child->record = record;
+    trie->count++;
+
+    return 0;
+
+err:
+    //
+    //  Drop the nodes created for this name, which have no record yet.
+    //
+    rviTrieRemoveFrom ( trie->root, name );
+
+    return ENOMEM;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ l o o k u p
+
+	@brief Find the record with the given name.
+
+	@param[in] trie - The address of the trie
+	@param[in] name - The name to look for
+
+	@return The record or NULL if there is none
+
+------------------------------------------------------------------------*/
+void* rviTrieLookup ( TRviTrie* trie, const char* name )
+{
+    TRviTrieNode* node = trie->root;
+    const char*   s    = name;
+    size_t        length;
+
+    while ( node )
+    {
+        length = SEGMENT_LENGTH ( s );
+        node   = rviTrieFindChild ( node, s, length );
+
+        if ( s[length] == '\0' )
+        {
+            break;
+        }
+        s += length + 1;
+    }
+    return node ? node->record : NULL;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ r e m o v e
+
+	@brief Remove the record with the given name from the trie.
+
+	Nodes that no longer lead to any record are freed.
+
+	@param[in] trie - The address of the trie
+	@param[in] name - The name of the record
+
+	@return The record that was removed or NULL if there was none
+
+------------------------------------------------------------------------*/
+void* rviTrieRemove ( TRviTrie* trie, const char* name )
+{
+    void* record;
+
+    if ( !name || !*name )
+    {
+        return NULL;
+    }
+    record = rviTrieRemoveFrom ( trie->root, name );
+    if ( record )
+    {
+        trie->count--;
+    }
+    return record;
+}
+
+
+//
+//  Visit the record of a node and then the records of all of its children,
+//  in order.
+//
+static int rviTrieWalkAll ( TRviTrieNode* node, TRviTrieVisit visit,
+                            void* context )
+{
+    unsigned int i;
+    int          result;
+
+    if ( node->record && ( result = visit ( node->record, context ) ) != 0 )
+    {
+        return result;
+    }
+    for ( i = 0; i < node->childCount; i++ )
+    {
+        if ( ( result = rviTrieWalkAll ( node->children[i], visit,
+                                         context ) ) != 0 )
+        {
+            return result;
+        }
+    }
+    return 0;
+}
+
+//
+//  Visit the records below a node that match the rest of a pattern.
+//
+static int rviTrieWalkFrom ( TRviTrieNode* node, const char* pattern,
+                             TRviTrieVisit visit, void* context )
+{
+    size_t        length   = SEGMENT_LENGTH ( pattern );
+    int           wildcard = ( length == 1 && pattern[0] == '+' );
+    unsigned int  i        = 0;
+    TRviTrieNode* child;
+    int           result   = 0;
+
+    if ( pattern[length] == '\0' )
+    {
+        //
+        //  The last segment of the pattern matches every child whose segment
+        //  starts with it, and everything below those children.  The
+        //  children that match are next to each other.
+        //
+        if ( !wildcard )
+        {
+            i = rviTrieLowerBound ( node, pattern, length, 1 );
+        }
+        for ( ; i < node->childCount && result == 0; i++ )
+        {
+            child = node->children[i];
+            if ( !wildcard && strncmp ( child->segment, pattern, length ) )
+            {
+                break;
+            }
+            result = rviTrieWalkAll ( child, visit, context );
+        }
+        return result;
+    }
+
+    if ( wildcard )
+    {
+        for ( ; i < node->childCount && result == 0; i++ )
+        {
+            result = rviTrieWalkFrom ( node->children[i], pattern + 2,
+                                       visit, context );
+        }
+        return result;
+    }
+
+    child = rviTrieFindChild ( node, pattern, length );
+
+    return child ? rviTrieWalkFrom ( child, pattern + length + 1, visit,
+                                     context )
+                 : 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ w a l k
+
+	@brief Visit the records whose names match a pattern, in order.
+
+	A pattern is made of '/' separated segments like a name.  Every segment
+    but the last must be equal to the segment of the name at the same place,
+    or be a '+', which matches any one segment.  The last segment of the
+    pattern need only be a prefix of the segment of the name at that place,
+    and every name below a match matches too.  So "genivi.org/vehicle/" and
+    "genivi.org/+/" match every name with at least three segments that
+    starts with "genivi.org/vehicle/" or "genivi.org/" respectively.  A NULL
+    or empty pattern visits every record.
+
+	Only the parts of the trie that can hold a match are looked at.  The
+    records are visited in the order of their segments, compared one
+    segment at a time.
+
+	@param[in] trie - The address of the trie
+	@param[in] pattern - The pattern the names must match
+	@param[in] visit - The function to call for each record that matches
+	@param[in] context - Passed through to the visit function
+
+	@return 0 if every match was visited, otherwise the non-zero value
+            returned by the visit function that stopped the walk
+
+------------------------------------------------------------------------*/
+int rviTrieWalk ( TRviTrie* trie, const char* pattern, TRviTrieVisit visit,
+                  void* context )
+{
+    if ( !pattern || !*pattern )
+    {
+        return rviTrieWalkAll ( trie->root, visit, context );
+    }
+    return rviTrieWalkFrom ( trie->root, pattern, visit, context );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ d e s t r o y
+
+	@brief Free all of the nodes of the trie.
+
+	The records themselves are not touched.
+
+	@param[in] trie - The address of the trie to destroy
+
+	@return None
+
+------------------------------------------------------------------------*/
+void rviTrieDestroy ( TRviTrie* trie )
+{
+    if ( trie->root )
+    {
+        rviTrieFreeNode ( trie->root );
+    }
+    trie->root  = NULL;
+    trie->count = 0;
+}
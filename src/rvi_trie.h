@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_TRIE_H_
+#define _RVI_TRIE_H_
+
+#include <stddef.h>
+
+//
+//  Define the function called for each record found by a walk.  Returning
+//  non-zero stops the walk.
+//
+typedef int (*TRviTrieVisit) ( void* record, void* context );
+
+//
+//  A node of the trie.  Each node stands for one '/' separated segment of
+//  the names below it, so a prefix shared by many names is stored once.  The
+//  children are kept sorted by segment, which makes the walk of a node an
+//  ordered one and lets a segment be found with a binary search.
+//
+typedef struct TRviTrieNode
+{
+    struct TRviTrieNode** children;
+    unsigned int          childCount;
+    unsigned int          childSize;    // The allocated size of children
+    void*                 record;       // The record whose name ends here
+    char                  segment[];
+
+}   TRviTrieNode;
+
+//
+//  A trie of records keyed by names made of '/' separated segments, such as
+//  fully qualified service names.
+//
+typedef struct TRviTrie
+{
+    TRviTrieNode* root;
+    unsigned int  count;        // The number of records in the trie
+
+}   TRviTrie;
+
+
+int rviTrieInitialize ( TRviTrie* trie );
+
+int rviTrieInsert ( TRviTrie* trie, const char* name, void* record );
+
+void* rviTrieLookup ( TRviTrie* trie, const char* name );
+
+void* rviTrieRemove ( TRviTrie* trie, const char* name );
+
+int rviTrieWalk ( TRviTrie* trie, const char* pattern, TRviTrieVisit visit,
+                  void* context );
+
+void rviTrieDestroy ( TRviTrie* trie );
+
+//
+//  Return the number of records in the trie.
+//
+static inline unsigned int rviTrieGetCount ( TRviTrie* trie )
+{
+    return trie->count;
+}
+
+
+#endif // _RVI_TRIE_H_
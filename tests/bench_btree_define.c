@@ -0,0 +1,280 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+//
+//  Compare the search that BTREE_DEFINE generates, with the comparison
+//  compiled inline, with btree_search, which calls the compare function of
+//  the btree through a pointer.  Both search the same btrees for the same
+//  random services.
+//
+//  The btrees are set up the way rviInit sets up the service indices: B+
+//  mode, nodes sized to the page, fingerprints and nodes drawn from an
+//  arena.  One is keyed by service name and one by registrant and then
+//  name.  The names share their first 8 bytes, as the names of one RVI
+//  domain do, so the fingerprints tie and the comparison is always called.
+//
+//  Usage: bench_btree_define [services [lookups]]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "btree_define.h"
+#include "rvi_arena.h"
+
+#define BENCH_SERVICES    ( 10000 )
+#define BENCH_LOOKUPS     ( 10000000 )
+#define BENCH_REGISTRANTS ( 100 )
+
+//
+//  The first descriptor handed out, after stdin, stdout and stderr.
+//
+#define BENCH_FIRST_FD ( 3 )
+
+typedef struct TBenchService
+{
+    char* name;
+    int   registrant;
+
+}   TBenchService;
+
+
+//
+//  The comparisons of the service indices in rvi.c, as functions for the
+//  btree and as key and compare macros for BTREE_DEFINE.  Equal names are
+//  the same pointer, as interned names are.
+//
+static int benchCompareName ( void* a, void* b )
+{
+    TBenchService* serviceA = a;
+    TBenchService* serviceB = b;
+
+    if ( serviceA->name == serviceB->name )
+    {
+        return 0;
+    }
+    return strcmp ( serviceA->name, serviceB->name );
+}
+
+static int benchCompareRegistrant ( void* a, void* b )
+{
+    TBenchService* serviceA = a;
+    TBenchService* serviceB = b;
+    int            result;
+
+    result = serviceA->registrant - serviceB->registrant;
+    if ( result == 0 && serviceA->name && serviceB->name )
+    {
+        result = strcmp ( serviceA->name, serviceB->name );
+    }
+    return result;
+}
+
+#define BENCH_NAME( service )    ( ( service )->name )
+#define BENCH_SERVICE( service ) ( service )
+#define BENCH_COMPARE_NAME( a, b ) ( ( a ) == ( b ) ? 0 : strcmp ( a, b ) )
+
+BTREE_DEFINE ( bench_name_idx, TBenchService, BENCH_NAME,
+               BENCH_COMPARE_NAME )
+
+BTREE_DEFINE ( bench_reg_idx, TBenchService, BENCH_SERVICE,
+               benchCompareRegistrant )
+
+static uint64_t benchFingerprintName ( void* a )
+{
+    const unsigned char* name   = (const unsigned char*)BENCH_NAME (
+                                      (TBenchService*)a );
+    uint64_t             result = 0;
+    int                  i;
+
+    for ( i = 0; i < 8; i++ )
+    {
+        result <<= 8;
+        if ( *name != '\0' )
+        {
+            result |= *name++;
+        }
+    }
+    return result;
+}
+
+static uint64_t benchFingerprintRegistrant ( void* a )
+{
+    return (uint32_t)( (TBenchService*)a )->registrant ^ 0x80000000u;
+}
+
+
+//
+//  Return the time in nanoseconds from an arbitrary starting point.
+//
+static double benchNow ( void )
+{
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//
+//  A small, fast pseudo-random number generator (xorshift32).
+//
+static unsigned int benchRandom ( unsigned int* state )
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return *state;
+}
+
+//
+//  Create an index the way rviInit does.
+//
+static btree_t* benchCreate ( compareFunc compare,
+                              fingerprintFunc fingerprint,
+                              btree_allocator_t* allocator )
+{
+    btree_t* btree = btree_create_sized ( BTREE_NODE_PAGE, compare,
+                                          allocator );
+
+    if ( !btree || btree_set_fingerprint ( btree, fingerprint ) != 0 ||
+         btree_set_bplus ( btree, true ) != 0 )
+    {
+        fprintf ( stderr, "Unable to allocate memory\n" );
+        exit ( 1 );
+    }
+    return btree;
+}
+
+
+int main ( int argc, char* argv[] )
+{
+    unsigned int      services = argc > 1 ? atoi ( argv[1] ) :
+                                            BENCH_SERVICES;
+    unsigned int      lookups  = argc > 2 ? atoi ( argv[2] ) :
+                                            BENCH_LOOKUPS;
+    TBenchService*    records;
+    TBenchService*    key;
+    TRviArena         arena;
+    btree_allocator_t allocator = { rviArenaAlloc, rviArenaFree, &arena };
+    btree_t*          nameIdx;
+    btree_t*          regIdx;
+    unsigned int      state;
+    unsigned int      i;
+    unsigned long     sum[2] = { 0, 0 };
+    double            start;
+    double            pointerTime;
+    double            inlineTime;
+    char              name[80];
+
+    if ( services == 0 )
+    {
+        fprintf ( stderr, "Usage: %s [services [lookups]]\n", argv[0] );
+        return 2;
+    }
+    records = malloc ( services * sizeof(TBenchService) );
+    if ( !records )
+    {
+        fprintf ( stderr, "Unable to allocate memory\n" );
+        return 1;
+    }
+    rviArenaInitialize ( &arena, 0 );
+    nameIdx = benchCreate ( benchCompareName, benchFingerprintName,
+                            &allocator );
+    regIdx  = benchCreate ( benchCompareRegistrant,
+                            benchFingerprintRegistrant, &allocator );
+
+    for ( i = 0; i < services; i++ )
+    {
+        snprintf ( name, sizeof(name),
+                   "genivi.org/vehicle/%08x-8635-4c10-8aeb-34c13dad60b6/"
+                   "service/%u", i * 2654435761u, i );
+
+        records[i].name       = strdup ( name );
+        records[i].registrant = BENCH_FIRST_FD + i % BENCH_REGISTRANTS;
+
+        if ( !records[i].name ||
+             bench_name_idx_insert ( nameIdx, &records[i] ) != 0 ||
+             bench_reg_idx_insert ( regIdx, &records[i] ) != 0 )
+        {
+            fprintf ( stderr, "Unable to insert service %u\n", i );
+            return 1;
+        }
+    }
+
+    //
+    //  Look up the same sequence of random services in each index, once
+    //  through the compare function pointer and once with the generated
+    //  search.
+    //
+    printf ( "%u services, ns per lookup\n", services );
+
+    state = 2463534242u;
+    start = benchNow ();
+    for ( i = 0; i < lookups; i++ )
+    {
+        key     = &records[benchRandom ( &state ) % services];
+        sum[0] += ( (TBenchService*)btree_search ( nameIdx, key ) )->
+                      registrant;
+    }
+    pointerTime = benchNow () - start;
+
+    state = 2463534242u;
+    start = benchNow ();
+    for ( i = 0; i < lookups; i++ )
+    {
+        key     = &records[benchRandom ( &state ) % services];
+        sum[1] += bench_name_idx_search ( nameIdx, key )->registrant;
+    }
+    inlineTime = benchNow () - start;
+
+    printf ( "name        pointer %7.1f  generated %7.1f\n",
+             pointerTime / lookups, inlineTime / lookups );
+
+    state = 2463534242u;
+    start = benchNow ();
+    for ( i = 0; i < lookups; i++ )
+    {
+        key     = &records[benchRandom ( &state ) % services];
+        sum[0] += ( (TBenchService*)btree_search ( regIdx, key ) )->
+                      registrant;
+    }
+    pointerTime = benchNow () - start;
+
+    state = 2463534242u;
+    start = benchNow ();
+    for ( i = 0; i < lookups; i++ )
+    {
+        key     = &records[benchRandom ( &state ) % services];
+        sum[1] += bench_reg_idx_search ( regIdx, key )->registrant;
+    }
+    inlineTime = benchNow () - start;
+
+    printf ( "registrant  pointer %7.1f  generated %7.1f\n",
+             pointerTime / lookups, inlineTime / lookups );
+
+    btree_destroy ( nameIdx );
+    btree_destroy ( regIdx );
+    rviArenaDestroy ( &arena );
+    for ( i = 0; i < services; i++ )
+    {
+        free ( records[i].name );
+    }
+    free ( records );
+
+    if ( sum[0] != sum[1] )
+    {
+        fprintf ( stderr, "The searches found different services\n" );
+        return 1;
+    }
+    return 0;
+}
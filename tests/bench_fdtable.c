@@ -0,0 +1,203 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+//
+//  Compare the file descriptor table that indexes the remote connections
+//  with the btree it replaced.  Both hold the same remotes, keyed by
+//  descriptor, and are timed for lookups of random descriptors and for
+//  walks over every remote in descriptor order.
+//
+//  The btree is set up the way rviInit used to set up the remote index: B+
+//  mode, nodes sized to the cache line, fingerprints of the descriptor and
+//  nodes drawn from an arena.
+//
+//  Usage: bench_fdtable [remotes [lookups]]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "btree.h"
+#include "rvi_arena.h"
+#include "rvi_fdtable.h"
+
+#define BENCH_REMOTES ( 10000 )
+#define BENCH_LOOKUPS ( 10000000 )
+#define BENCH_WALKS   ( 1000 )
+
+//
+//  The first descriptor handed out, after stdin, stdout and stderr.
+//
+#define BENCH_FIRST_FD ( 3 )
+
+typedef struct TBenchRemote
+{
+    int fd;
+
+}   TBenchRemote;
+
+
+//
+//  Return the time in nanoseconds from an arbitrary starting point.
+//
+static double benchNow ( void )
+{
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//
+//  A small, fast pseudo-random number generator (xorshift32).
+//
+static unsigned int benchRandom ( unsigned int* state )
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return *state;
+}
+
+static int benchCompareFd ( void* a, void* b )
+{
+    return ( (TBenchRemote*)a )->fd - ( (TBenchRemote*)b )->fd;
+}
+
+static uint64_t benchFingerprintFd ( void* a )
+{
+    return (uint32_t)( (TBenchRemote*)a )->fd ^ 0x80000000u;
+}
+
+
+int main ( int argc, char* argv[] )
+{
+    unsigned int      remotes = argc > 1 ? atoi ( argv[1] ) : BENCH_REMOTES;
+    unsigned int      lookups = argc > 2 ? atoi ( argv[2] ) : BENCH_LOOKUPS;
+    TBenchRemote*     records;
+    TBenchRemote      key;
+    TRviArena         arena;
+    btree_allocator_t allocator = { rviArenaAlloc, rviArenaFree, &arena };
+    btree_t*          btree;
+    btree_iterator_t  iter;
+    TRviFdTable       table;
+    unsigned int      state;
+    unsigned int      i;
+    unsigned int      walk;
+    unsigned long     sum[2] = { 0, 0 };
+    double            start;
+    double            btreeTime;
+    double            tableTime;
+    int               fd;
+
+    if ( remotes == 0 )
+    {
+        fprintf ( stderr, "Usage: %s [remotes [lookups]]\n", argv[0] );
+        return 2;
+    }
+    records = malloc ( remotes * sizeof(TBenchRemote) );
+    rviArenaInitialize ( &arena, 0 );
+    rviFdTableInitialize ( &table );
+    btree = btree_create_sized ( BTREE_NODE_CACHE_LINE, benchCompareFd,
+                                 &allocator );
+    if ( !records || !btree ||
+         btree_set_fingerprint ( btree, benchFingerprintFd ) != 0 ||
+         btree_set_bplus ( btree, true ) != 0 )
+    {
+        fprintf ( stderr, "Unable to allocate memory\n" );
+        return 1;
+    }
+
+    for ( i = 0; i < remotes; i++ )
+    {
+        records[i].fd = BENCH_FIRST_FD + i;
+
+        if ( btree_insert ( btree, &records[i] ) != 0 ||
+             rviFdTableInsert ( &table, records[i].fd, &records[i] ) != 0 )
+        {
+            fprintf ( stderr, "Unable to insert remote %u\n", i );
+            return 1;
+        }
+    }
+
+    //
+    //  Look up the same sequence of random descriptors in each index.
+    //
+    state = 2463534242u;
+    start = benchNow ();
+    for ( i = 0; i < lookups; i++ )
+    {
+        key.fd  = BENCH_FIRST_FD + benchRandom ( &state ) % remotes;
+        sum[0] += ( (TBenchRemote*)btree_search ( btree, &key ) )->fd;
+    }
+    btreeTime = benchNow () - start;
+
+    state = 2463534242u;
+    start = benchNow ();
+    for ( i = 0; i < lookups; i++ )
+    {
+        fd      = BENCH_FIRST_FD + benchRandom ( &state ) % remotes;
+        sum[1] += ( (TBenchRemote*)rviFdTableLookup ( &table, fd ) )->fd;
+    }
+    tableTime = benchNow () - start;
+
+    printf ( "lookup  %8u remotes: btree %7.1f ns  fd table %7.1f ns\n",
+             remotes, btreeTime / lookups, tableTime / lookups );
+
+    if ( sum[0] != sum[1] )
+    {
+        fprintf ( stderr, "The indices found different remotes\n" );
+        return 1;
+    }
+
+    //
+    //  Walk every remote in descriptor order.
+    //
+    start = benchNow ();
+    for ( walk = 0; walk < BENCH_WALKS; walk++ )
+    {
+        for ( btree_iter_begin_init ( &iter, btree );
+              !btree_iter_at_end ( &iter ); btree_iter_next ( &iter ) )
+        {
+            sum[0] += ( (TBenchRemote*)btree_iter_data ( &iter ) )->fd;
+        }
+    }
+    btreeTime = benchNow () - start;
+
+    start = benchNow ();
+    for ( walk = 0; walk < BENCH_WALKS; walk++ )
+    {
+        for ( fd = rviFdTableNext ( &table, -1 ); fd >= 0;
+              fd = rviFdTableNext ( &table, fd ) )
+        {
+            sum[1] += ( (TBenchRemote*)rviFdTableLookup ( &table, fd ) )->fd;
+        }
+    }
+    tableTime = benchNow () - start;
+
+    printf ( "walk    %8u remotes: btree %7.1f ns  fd table %7.1f ns "
+             "per remote\n", remotes,
+             btreeTime / ( (double)BENCH_WALKS * remotes ),
+             tableTime / ( (double)BENCH_WALKS * remotes ) );
+
+    btree_destroy ( btree );
+    rviFdTableDestroy ( &table );
+    rviArenaDestroy ( &arena );
+    free ( records );
+
+    if ( sum[0] != sum[1] )
+    {
+        fprintf ( stderr, "The indices walked different remotes\n" );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+//
+//  Time every version of the pattern matcher that this processor can run
+//  on patterns and names shaped like the ones in RVI credentials: a long
+//  literal match, a match through a wildcard segment, a mismatch near the
+//  end of the name and one at its start.
+//
+//  Usage: bench_pattern [compares]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rvi_pattern.h"
+
+#define BENCH_COMPARES ( 10000000 )
+
+#define BENCH_NAME \
+    "genivi.org/vehicle/dc23f560-8635-4c10-8aeb-34c13dad60b6/control/unlock"
+
+static const struct
+{
+    const char* label;
+    const char* pattern;
+    const char* fqsn;
+
+}   benchCases[] =
+{
+    { "literal",  BENCH_NAME, BENCH_NAME },
+    { "wildcard", "genivi.org/vehicle/+/control", BENCH_NAME },
+    { "late",
+      "genivi.org/vehicle/dc23f560-8635-4c10-8aeb-34c13dad60b6/control/lock",
+      BENCH_NAME },
+    { "early",    "jaguarlandrover.com", BENCH_NAME }
+};
+
+#define COUNT_OF( a ) ( sizeof(a) / sizeof((a)[0]) )
+
+
+//
+//  Return the time in nanoseconds from an arbitrary starting point.
+//
+static double benchNow ( void )
+{
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+int main ( int argc, char* argv[] )
+{
+    unsigned int              compares = argc > 1 ? atoi ( argv[1] ) :
+                                                    BENCH_COMPARES;
+    const TRviPatternVersion* versions;
+    unsigned int              count;
+    unsigned int              c;
+    unsigned int              v;
+    unsigned int              i;
+    int                       sum;
+    int                       expected = 0;
+    double                    start;
+
+    if ( compares == 0 )
+    {
+        fprintf ( stderr, "Usage: %s [compares]\n", argv[0] );
+        return 2;
+    }
+    count = rviPatternVersions ( &versions );
+
+    printf ( "%-10s", "" );
+    for ( v = 0; v < count; v++ )
+    {
+        printf ( "%10s", versions[v].name );
+    }
+    printf ( "\n" );
+
+    for ( c = 0; c < COUNT_OF ( benchCases ); c++ )
+    {
+        printf ( "%-10s", benchCases[c].label );
+
+        for ( v = 0; v < count; v++ )
+        {
+            sum   = 0;
+            start = benchNow ();
+            for ( i = 0; i < compares; i++ )
+            {
+                sum += versions[v].compare ( benchCases[c].pattern,
+                                             benchCases[c].fqsn );
+            }
+            printf ( "%7.1f ns", ( benchNow () - start ) / compares );
+
+            //
+            //  Every version must agree, which also keeps the calls from
+            //  being optimized away.
+            //
+            if ( v == 0 )
+            {
+                expected = sum;
+            }
+            else if ( sum != expected )
+            {
+                fprintf ( stderr, "\n%s disagrees with %s\n",
+                          versions[v].name, versions[0].name );
+                return 1;
+            }
+        }
+        printf ( "\n" );
+    }
+    return 0;
+}
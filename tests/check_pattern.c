@@ -0,0 +1,319 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+//
+//  Check that every version of the pattern matcher that this processor can
+//  run gives the same result as rviComparePatternScalar.
+//
+//  Names are mostly made from the pattern they are compared with, so that
+//  long literal runs and wildcard segments line up and a difference can
+//  fall anywhere.  Each string is placed so that its '\0' is 0 to
+//  CHECK_MAX_SLACK bytes before a page that cannot be read, which is where
+//  the vector loads have to stop short.  A load that strays into that page
+//  faults.
+//
+//  Usage: check_pattern [rounds [seed]]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rvi_pattern.h"
+
+#define CHECK_ROUNDS      ( 200000 )
+#define CHECK_MAX_SLACK   ( 40 )
+#define CHECK_MAX_SEGMENT ( 40 )
+#define CHECK_SEGMENTS    ( 6 )
+#define CHECK_MAX_LENGTH  ( 512 )
+
+//
+//  Patterns and names that have tripped matchers up before, and some that
+//  are longer than a vector.
+//
+static const char* checkPatterns[] =
+{
+    "", "+", "+/", "a/+", "a/+/", "a/+/b", "a/+/+/b", "+/+", "a/+x/b",
+    "a/b+/c", "++/a", "a//+/b", "/+/a", "a/b", "a/bc", "a",
+    "genivi.org/vehicle/+/control",
+    "genivi.org/vehicle/dc23f560-8635-4c10-8aeb-34c13dad60b6/control/unlock"
+};
+
+static const char* checkNames[] =
+{
+    "", "a", "a/", "a/b", "a/b/", "a/b/b", "a/x/+/b", "a//b", "a/+/b",
+    "+/+", "a/bc/d", "/x/a", "a/b/c", "ab",
+    "genivi.org/vehicle/dc23f560-8635-4c10-8aeb-34c13dad60b6/control/unlock",
+    "genivi.org/vehicle/dc23f560-8635-4c10-8aeb-34c13dad60b6/control/lock"
+};
+
+#define COUNT_OF( a ) ( sizeof(a) / sizeof((a)[0]) )
+
+//
+//  A string in the page just before an unreadable one.
+//
+typedef struct TCheckBuffer
+{
+    char* page;
+    long  pageSize;
+
+}   TCheckBuffer;
+
+
+//
+//  A small, fast pseudo-random number generator (xorshift32).
+//
+static unsigned int checkRandom ( unsigned int* state )
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return *state;
+}
+
+//
+//  Map two pages and make the second one unreadable.
+//
+static void checkBufferInitialize ( TCheckBuffer* buffer )
+{
+    buffer->pageSize = sysconf ( _SC_PAGESIZE );
+    buffer->page     = mmap ( NULL, 2 * buffer->pageSize,
+                              PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+    if ( buffer->page == MAP_FAILED ||
+         mprotect ( buffer->page + buffer->pageSize, buffer->pageSize,
+                    PROT_NONE ) != 0 )
+    {
+        perror ( "Unable to map the guard page" );
+        exit ( 1 );
+    }
+}
+
+//
+//  Copy a string into the buffer so that slack bytes lie between its '\0'
+//  and the unreadable page.
+//
+static const char* checkBufferPlace ( TCheckBuffer* buffer, const char* s,
+                                      unsigned int slack )
+{
+    size_t length = strlen ( s );
+    char*  copy   = buffer->page + buffer->pageSize - slack - length - 1;
+
+    memcpy ( copy, s, length + 1 );
+
+    return copy;
+}
+
+//
+//  Append a random segment of up to CHECK_MAX_SEGMENT characters.  Mostly
+//  'a' so that two random segments often share a long run.
+//
+static char* checkSegment ( unsigned int* state, char* s )
+{
+    unsigned int length = checkRandom ( state ) % ( CHECK_MAX_SEGMENT + 1 );
+    unsigned int i;
+
+    for ( i = 0; i < length; i++ )
+    {
+        *s++ = checkRandom ( state ) % 8 ? 'a' : 'b';
+    }
+    return s;
+}
+
+//
+//  Make a random pattern of up to CHECK_SEGMENTS segments, some of them
+//  wildcards.
+//
+static void checkPattern ( unsigned int* state, char* s )
+{
+    unsigned int segments = 1 + checkRandom ( state ) % CHECK_SEGMENTS;
+    unsigned int i;
+
+    for ( i = 0; i < segments; i++ )
+    {
+        if ( i )
+        {
+            *s++ = '/';
+        }
+        if ( checkRandom ( state ) % 4 == 0 )
+        {
+            *s++ = '+';
+        }
+        s = checkSegment ( state, s );
+    }
+    *s = '\0';
+}
+
+//
+//  Make a name that the pattern matches, or nearly so: each wildcard
+//  segment is replaced by a random one, and then one character may be
+//  changed, or the name cut short or extended.
+//
+static void checkName ( unsigned int* state, const char* pattern, char* s )
+{
+    static const char alphabet[] = "ab/+";
+    char*             start = s;
+    size_t            length;
+
+    while ( *pattern != '\0' )
+    {
+        if ( *pattern == '+' )
+        {
+            while ( *pattern != '/' && *pattern != '\0' )
+            {
+                pattern++;
+            }
+            s = checkSegment ( state, s );
+        }
+        else
+        {
+            *s++ = *pattern++;
+        }
+    }
+    *s     = '\0';
+    length = s - start;
+
+    switch ( checkRandom ( state ) % 4 )
+    {
+        case 0:
+            if ( length )
+            {
+                start[checkRandom ( state ) % length] =
+                    alphabet[checkRandom ( state ) % 4];
+            }
+            break;
+
+        case 1:
+            start[checkRandom ( state ) % ( length + 1 )] = '\0';
+            break;
+
+        case 2:
+            *s++ = alphabet[checkRandom ( state ) % 4];
+            s    = checkSegment ( state, s );
+            *s   = '\0';
+            break;
+    }
+}
+
+//
+//  Compare a pattern and a name with every version, each string placed
+//  with the given slack before its guard page.  Returns 1 if any version
+//  disagrees with the scalar one.
+//
+static int checkPair ( const TRviPatternVersion* versions,
+                       unsigned int count, TCheckBuffer* buffers,
+                       const char* pattern, const char* name,
+                       unsigned int patternSlack, unsigned int nameSlack )
+{
+    const char*  p = checkBufferPlace ( &buffers[0], pattern, patternSlack );
+    const char*  n = checkBufferPlace ( &buffers[1], name, nameSlack );
+    int          expected;
+    int          result;
+    unsigned int i;
+
+    expected = rviComparePatternScalar ( p, n );
+
+    for ( i = 1; i < count; i++ )
+    {
+        result = versions[i].compare ( p, n );
+
+        if ( result != expected )
+        {
+            fprintf ( stderr, "%s: \"%s\" against \"%s\" (slack %u and %u) "
+                      "gave %d instead of %d\n", versions[i].name, pattern,
+                      name, patternSlack, nameSlack, result, expected );
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int main ( int argc, char* argv[] )
+{
+    unsigned int              rounds = argc > 1 ? atoi ( argv[1] ) :
+                                                  CHECK_ROUNDS;
+    unsigned int              state  = argc > 2 ?
+                                       (unsigned int)atoi ( argv[2] ) :
+                                       2463534242u;
+    const TRviPatternVersion* versions;
+    unsigned int              count;
+    TCheckBuffer              buffers[2];
+    char                      pattern[CHECK_MAX_LENGTH];
+    char                      name[CHECK_MAX_LENGTH];
+    unsigned int              round;
+    unsigned int              i;
+    unsigned int              j;
+    unsigned int              patternSlack;
+    unsigned int              nameSlack;
+    int                       failures = 0;
+
+    if ( state == 0 )
+    {
+        state = 1;
+    }
+
+    count = rviPatternVersions ( &versions );
+    checkBufferInitialize ( &buffers[0] );
+    checkBufferInitialize ( &buffers[1] );
+
+    //
+    //  Every fixed pair at every placement.
+    //
+    for ( i = 0; i < COUNT_OF ( checkPatterns ); i++ )
+    {
+        for ( j = 0; j < COUNT_OF ( checkNames ); j++ )
+        {
+            for ( patternSlack = 0; patternSlack <= CHECK_MAX_SLACK;
+                  patternSlack++ )
+            {
+                for ( nameSlack = 0; nameSlack <= CHECK_MAX_SLACK;
+                      nameSlack++ )
+                {
+                    failures += checkPair ( versions, count, buffers,
+                                            checkPatterns[i], checkNames[j],
+                                            patternSlack, nameSlack );
+                }
+            }
+        }
+    }
+
+    //
+    //  Random pairs at random placements.
+    //
+    for ( round = 0; round < rounds && failures < 10; round++ )
+    {
+        checkPattern ( &state, pattern );
+        checkName ( &state, pattern, name );
+
+        patternSlack = checkRandom ( &state ) % ( CHECK_MAX_SLACK + 1 );
+        nameSlack    = checkRandom ( &state ) % ( CHECK_MAX_SLACK + 1 );
+
+        failures += checkPair ( versions, count, buffers, pattern, name,
+                                patternSlack, nameSlack );
+    }
+
+    if ( failures )
+    {
+        fprintf ( stderr, "%d pairs were matched wrongly\n", failures );
+        return 1;
+    }
+    printf ( "%u rounds, the versions", rounds );
+    for ( i = 0; i < count; i++ )
+    {
+        printf ( " %s", versions[i].name );
+    }
+    printf ( " agree\n" );
+
+    return 0;
+}
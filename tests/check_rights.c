@@ -0,0 +1,195 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+//
+//  Check that a compiled set of rights patterns grants exactly what
+//  rviComparePattern grants: a name matches the set if and only if it
+//  matches at least one of the patterns added to it.
+//
+//  Random sets of patterns and random names are drawn from a small alphabet
+//  of letters, '/' and '+' so that wildcards, empty segments and shared
+//  prefixes come up often.  Some sets hold enough wildcards that a match
+//  has to track its states on the heap.
+//
+//  Usage: check_rights [rounds [seed]]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_pattern.h"
+#include "rvi_rights.h"
+
+#define CHECK_ROUNDS       ( 20000 )
+#define CHECK_NAMES        ( 50 )
+#define CHECK_MAX_PATTERNS ( 8 )
+#define CHECK_BIG_PATTERNS ( 200 )
+#define CHECK_MAX_LENGTH   ( 16 )
+
+//
+//  Patterns and names that have tripped matchers up before.
+//
+static const char* checkPatterns[] =
+{
+    "", "+", "+/", "a/+", "a/+/", "a/+/b", "a/+/+/b", "+/+", "a/+x/b",
+    "a/b+/c", "++/a", "a//+/b", "/+/a", "a/b", "a/bc", "a"
+};
+
+static const char* checkNames[] =
+{
+    "", "a", "a/", "a/b", "a/b/", "a/b/b", "a/x/+/b", "a//b", "a/+/b",
+    "+/+", "a/bc/d", "/x/a", "a/b/c", "ab"
+};
+
+#define COUNT_OF( a ) ( sizeof(a) / sizeof((a)[0]) )
+
+
+//
+//  A small, fast pseudo-random number generator (xorshift32).
+//
+static unsigned int checkRandom ( unsigned int* state )
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return *state;
+}
+
+//
+//  Fill a buffer with a random string of up to CHECK_MAX_LENGTH characters.
+//
+static void checkString ( unsigned int* state, char* s, const char* alphabet )
+{
+    unsigned int length = checkRandom ( state ) % ( CHECK_MAX_LENGTH + 1 );
+    unsigned int i;
+
+    for ( i = 0; i < length; i++ )
+    {
+        s[i] = alphabet[checkRandom ( state ) % strlen ( alphabet )];
+    }
+    s[length] = '\0';
+}
+
+//
+//  Compile the patterns into a set and check the set against each name.
+//  Returns the number of names the set got wrong.
+//
+static int checkSet ( char patterns[][CHECK_MAX_LENGTH + 1],
+                      unsigned int count, const char** names,
+                      unsigned int nameCount )
+{
+    TRviRightsTrie trie;
+    unsigned int   i;
+    unsigned int   j;
+    int            expected;
+    int            failures = 0;
+
+    rviRightsTrieInitialize ( &trie );
+
+    for ( i = 0; i < count; i++ )
+    {
+        if ( rviRightsTrieAdd ( &trie, patterns[i] ) != 0 )
+        {
+            fprintf ( stderr, "Unable to add pattern \"%s\"\n",
+                      patterns[i] );
+            exit ( 1 );
+        }
+    }
+    for ( j = 0; j < nameCount; j++ )
+    {
+        expected = 0;
+        for ( i = 0; i < count && !expected; i++ )
+        {
+            expected = rviComparePattern ( patterns[i], names[j] ) == 0;
+        }
+        if ( rviRightsTrieMatch ( &trie, names[j] ) != expected )
+        {
+            fprintf ( stderr, "Name \"%s\" %s by the set {", names[j],
+                      expected ? "not matched" : "wrongly matched" );
+            for ( i = 0; i < count; i++ )
+            {
+                fprintf ( stderr, "%s\"%s\"", i ? ", " : " ", patterns[i] );
+            }
+            fprintf ( stderr, " }\n" );
+            failures++;
+        }
+    }
+    rviRightsTrieDestroy ( &trie );
+
+    return failures;
+}
+
+
+int main ( int argc, char* argv[] )
+{
+    unsigned int rounds = argc > 1 ? atoi ( argv[1] ) : CHECK_ROUNDS;
+    unsigned int state  = argc > 2 ? (unsigned int)atoi ( argv[2] ) :
+                                     2463534242u;
+    char         patterns[CHECK_BIG_PATTERNS][CHECK_MAX_LENGTH + 1];
+    char         buffers[CHECK_NAMES][CHECK_MAX_LENGTH + 1];
+    const char*  names[CHECK_NAMES];
+    unsigned int count;
+    unsigned int round;
+    unsigned int i;
+    unsigned int j;
+    int          failures = 0;
+
+    if ( state == 0 )
+    {
+        state = 1;
+    }
+
+    //
+    //  Every fixed pattern on its own and with each other one.
+    //
+    for ( i = 0; i < COUNT_OF ( checkPatterns ); i++ )
+    {
+        for ( j = 0; j < COUNT_OF ( checkPatterns ); j++ )
+        {
+            strcpy ( patterns[0], checkPatterns[i] );
+            strcpy ( patterns[1], checkPatterns[j] );
+
+            failures += checkSet ( patterns, i == j ? 1 : 2, checkNames,
+                                   COUNT_OF ( checkNames ) );
+        }
+    }
+
+    //
+    //  Random sets, most of them small, every tenth one large.
+    //
+    for ( round = 0; round < rounds && failures < 10; round++ )
+    {
+        count = round % 10 == 9 ?
+                CHECK_BIG_PATTERNS :
+                1 + checkRandom ( &state ) % CHECK_MAX_PATTERNS;
+
+        for ( i = 0; i < count; i++ )
+        {
+            checkString ( &state, patterns[i], "ab/+++" );
+        }
+        for ( j = 0; j < CHECK_NAMES; j++ )
+        {
+            checkString ( &state, buffers[j], "ab//+" );
+            names[j] = buffers[j];
+        }
+        failures += checkSet ( patterns, count, names, CHECK_NAMES );
+    }
+
+    if ( failures )
+    {
+        fprintf ( stderr, "%d names were matched wrongly\n", failures );
+        return 1;
+    }
+    printf ( "%u rounds, the rights sets agree with rviComparePattern\n",
+             rounds );
+
+    return 0;
+}